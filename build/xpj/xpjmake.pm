@@ -235,9 +235,10 @@ sub process
 				my $dependsLibsFullPath = [];
 				$foundItems = {};
 				$om->get_target_depends_libraries_full_path( $target, $config, $dependsLibsFullPath, $foundItems );
-				foreach my $dependLib (@$dependsLibsFullPath) {
-					if ( length($allobjs) ) { $allobjs = $allobjs . " "; }
-					$allobjs = $allobjs . $dependLib;
+				my $dependsLibsStr = join( " ", @$dependsLibsFullPath );
+				#a static library only builds after its depends; archiving them would nest archives
+				if ( $configuration_type ne "static-library" ) {
+					$allobjs = $dependsLibsStr;
 				}
 
 				#output step to create the precompiled header
@@ -289,7 +290,7 @@ END
 				print $targetMakefile "\n";
 				if ( $configuration_type eq "static-library" ) {
 					print $targetMakefile <<END;
-$final_name: $allobjs
+$final_name: $allobjs | $dependsLibsStr
 	\@\$(MKDIR) $out_dir
 	\@\$(AR) r $final_name \$^
 	\@\$(RANLIB) $final_name
@@ -351,7 +351,10 @@ sub process_project_children {
 					my $dependsHash = $newTarget->{depends};
 					foreach my $line (@groupLines) {
 						my $trimmed = trim($line);
-						$dependsHash->{$trimmed} = 1;
+						#remember the listed order; static libraries have to be linked in it
+						if ( length( $trimmed ) && !$dependsHash->{$trimmed} ) {
+							$dependsHash->{$trimmed} = scalar( keys %$dependsHash ) + 1;
+						}
 					}
 				}
 				else {
@@ -511,19 +514,11 @@ sub get_path_list {
 		}
 	}
 	if ( $listname eq "linker-search-paths" ) {
-		my $project = $target->{project};
-		my $targets = $project->{targets};
-		my $depends = $target->{depends};
-		foreach my $depend (keys %$depends) {
-			foreach my $subTarget (@$targets) {
-				my $subName = $subTarget->{name};
-				if ( $subName eq $depend ) {
-					my $outDir = $om->get_target_out_dir( $subTarget, $configname );
-					if ( !$found_items->{$outDir} ) {
-						push( @retval, $outDir );
-						$found_items->{$outDir} = 1;
-					}
-				}
+		foreach my $subTarget (@{get_target_depends_targets( $target )}) {
+			my $outDir = $om->get_target_out_dir( $subTarget, $configname );
+			if ( !$found_items->{$outDir} ) {
+				push( @retval, $outDir );
+				$found_items->{$outDir} = 1;
 			}
 		}
 	}
@@ -545,31 +540,50 @@ sub get_target_input_libraries
 	}
 }
 
+#the targets a target depends on, directly or through other depends, in link order:
+#the listed order, with every target ahead of the ones it depends on.
+sub get_target_depends_targets
+{
+	my ($target) = @_;
+	my $targets = $target->{project}->{targets};
+	my $retval = [];
+	my $visited = {};
+	my $visit;
+	$visit = sub {
+		my ($current) = @_;
+		my $depends = $current->{depends};
+		#walked backwards and prepended so the listed order survives
+		foreach my $depend (sort { $depends->{$b} <=> $depends->{$a} } keys %$depends) {
+			next if ( $visited->{$depend} );
+			$visited->{$depend} = 1;
+			foreach my $subTarget (@$targets) {
+				if ( $subTarget->{name} eq $depend ) {
+					$visit->( $subTarget );
+					unshift( @$retval, $subTarget );
+				}
+			}
+		}
+	};
+	$visit->( $target );
+	return $retval;
+}
+
 sub get_target_depends_libraries 
 {
 	my ($om, $target, $configname, $retval, $found_items, $fullpath) = @_;
 	my $found_items = {};
 
-	my $project = $target->{project};
-	my $targets = $project->{targets};
-	my $depends = $target->{depends};
-	foreach my $depend (keys %$depends) {
-		foreach my $subTarget (@$targets) {
-			my $subName = $subTarget->{name};
-
-			if ( $subName eq $depend ) {
-				my $artifact_name = $om->get_target_property( $subTarget, $configname, "artifact-name" );
-				my $artifact_fullpath = catfile( $om->get_target_out_dir( $subTarget, $configname ), $artifact_name );
-				if ( !$found_items->{$artifact_fullpath} ) {
-					if ( $fullpath ) {
-						push( @$retval, $artifact_fullpath );
-					}
-					else {
-						push( @$retval, $artifact_name );
-					}
-					$found_items->{$artifact_fullpath} = 1;
-				}
+	foreach my $subTarget (@{get_target_depends_targets( $target )}) {
+		my $artifact_name = $om->get_target_property( $subTarget, $configname, "artifact-name" );
+		my $artifact_fullpath = catfile( $om->get_target_out_dir( $subTarget, $configname ), $artifact_name );
+		if ( !$found_items->{$artifact_fullpath} ) {
+			if ( $fullpath ) {
+				push( @$retval, $artifact_fullpath );
+			}
+			else {
+				push( @$retval, $artifact_name );
 			}
+			$found_items->{$artifact_fullpath} = 1;
 		}
 	}
 }
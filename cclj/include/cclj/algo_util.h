@@ -57,6 +57,26 @@ namespace cclj
 			container.insert( iter, item );
 	}
 	
+	//Spread the bits of a hash code (pointer hashes in particular have zero low bits)
+	//so it can be masked down to a power of 2 table size.
+	inline size_t hash_mix( size_t value )
+	{
+		uint64_t retval = static_cast<uint64_t>( value );
+		retval ^= retval >> 33;
+		retval *= 0xff51afd7ed558ccdULL;
+		retval ^= retval >> 33;
+		retval *= 0xc4ceb9fe1a85ec53ULL;
+		retval ^= retval >> 33;
+		return static_cast<size_t>( retval );
+	}
+
+	//Order sensitive; combining a then b gives a different result than b then a and
+	//combining the same value twice does not cancel out.
+	inline size_t hash_combine( size_t seed, size_t value )
+	{
+		return seed ^ ( hash_mix( value ) + 0x9e3779b97f4a7c15ULL + ( seed << 6 ) + ( seed >> 2 ) );
+	}
+
 	template<typename number_type>
 	inline number_type align_number( number_type data, uint8_t alignment )
 	{
@@ -51,6 +51,20 @@ namespace cclj {
 		//Create an allocator that, upon destruction, checks that everything has been
 		//deallocator and asserts if this isn't the case.
 		static shared_ptr<allocator> create_checking_allocator();
+
+		//Create an allocator for release builds.  Small allocations come from size class
+		//free lists and nothing is tracked per allocation, so deallocate never touches a
+		//global map.  check_ptr only verifies the allocation header.  If sample_rate is
+		//nonzero every sample_rate'th allocation is tracked like the checking allocator
+		//does and outstanding sampled allocations are written to stderr as leaks on
+		//destruction.
+		static shared_ptr<allocator> create_fast_allocator( uint32_t sample_rate = 0 );
+
+		//Create a thread safe allocator for code running on many threads.  Each thread
+		//allocates out of its own size class cache without locking; memory freed by a
+		//thread that doesn't own it is handed back to the owning cache through a lock free
+		//list.  Like the fast allocator, check_ptr only verifies the allocation header.
+		static shared_ptr<allocator> create_thread_caching_allocator();
 	};
 
 	typedef shared_ptr<allocator> allocator_ptr;
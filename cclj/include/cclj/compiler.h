@@ -10,12 +10,72 @@
 #pragma once
 #include "cclj/cclj.h"
 #include "cclj/lisp_types.h"
+#include "cclj/reader.h"
+#include "cclj/garbage_collector.h"
 
 namespace cclj
 {
 	class ast_node;
 	class module;
 
+	struct allocator_types
+	{
+		enum _enum
+		{
+			//Tracks every allocation and detects leaks; the default.
+			checking = 0,
+			//Size class free lists; see allocator::create_fast_allocator.
+			fast,
+		};
+	};
+
+	struct optimization_levels
+	{
+		enum _enum
+		{
+			//Fastest compile; locals stay on the stack.
+			O0 = 0,
+			O1,
+			//The default.
+			O2,
+			//O2 with more aggressive inlining.
+			O3,
+			//O2 that prefers smaller code; no vectorization or unrolling.
+			Os,
+		};
+	};
+
+	struct compiler_options
+	{
+		allocator_types::_enum	_allocator_type;
+		//Only used by the fast allocator.  0 disables leak sampling.
+		uint32_t				_allocation_sample_rate;
+		//gc-alloc collects once it has handed out this many bytes since the last collection.
+		uint32_t				_gc_collection_bytes;
+		optimization_levels::_enum	_optimization_level;
+		//When set, execute stores the machine code of each script in this directory and a
+		//later execute of the same text, with the same runtime functions and optimization
+		//level, maps that code instead of generating it; the text is still type checked.
+		//Uses MCJIT.  Each execute then only runs its own top level forms, not those of
+		//the scripts before it.
+		string					_object_cache_dir;
+		//Compile each function's body the first time it is called instead of before the
+		//module runs.  The module passes never see those bodies; each one instead gets the
+		//per function half of the level's pipeline (loop, GVN and vectorizer passes) but
+		//nothing is inlined across functions.  Needs the JIT, not MCJIT, so it can't be
+		//combined with the object cache.
+		bool					_lazy_compilation;
+
+		compiler_options()
+			: _allocator_type( allocator_types::checking )
+			, _allocation_sample_rate( 0 )
+			, _gc_collection_bytes( 8 * 1024 * 1024 )
+			, _optimization_level( optimization_levels::O2 )
+			, _lazy_compilation( false )
+		{
+		}
+	};
+
 	class compiler
 	{
 	protected:
@@ -29,16 +89,44 @@ namespace cclj
 		//transform text into the lisp datastructures.
 		virtual vector<lisp::object_ptr> read( const string& text ) = 0;
 
+		//Read the top level forms of the text on multiple threads.  Results are in source
+		//order.  A thread_count of 0 uses the hardware concurrency.
+		virtual vector<lisp::object_ptr> read_parallel( const string& text, uint32_t thread_count ) = 0;
+
+		//Readers that produce top level forms one at a time using this compiler's tables.
+		virtual form_reader_ptr create_file_reader( const string& path ) = 0;
+		virtual form_reader_ptr create_stream_reader( std::istream& stream, size_t chunk_size = 65536 ) = 0;
+
 		//Transform lisp datastructures into type-checked ast.
 		virtual void type_check( data_buffer<lisp::object_ptr> preprocess_result ) = 0;
 
+		//Type check a single top level form.
+		virtual void type_check_form( lisp::object_ptr form ) = 0;
+
 		//compile module to binary.
 		virtual pair<void*,type_ref_ptr> compile() = 0;
 
 		//Create a compiler and execute this text return the last value if it is a float else exception.
 		virtual float execute( const string& text ) = 0;
 
-		static shared_ptr<compiler> create();
+		//Type check each form as it is read, then compile and execute.
+		virtual float execute( form_reader& reader ) = 0;
+
+		virtual float execute_file( const string& path ) = 0;
+
+		//Compile the module to a native object file, or to a shared library when the path ends
+		//in .so, .dylib or .dll.  Functions the module defines are exported as cclj_<name>
+		//and the init function as cclj_module_init; header_path gets their C declarations.
+		//Link the result with aot_runtime.cpp.
+		virtual void compile_to_file( const string& output_path, const string& header_path ) = 0;
+
+		//Owns the memory compiled code gets from gc-alloc.
+		virtual shared_ptr<garbage_collector> managed_heap() = 0;
+
+		//Compiles whose code came from the object cache.
+		virtual uint32_t object_cache_hits() = 0;
+
+		static shared_ptr<compiler> create( const compiler_options& options = compiler_options() );
 	};
 
 	typedef shared_ptr<compiler> compiler_ptr;
@@ -0,0 +1,113 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#ifndef CCLJ_FLAT_HASH_MAP_H
+#define CCLJ_FLAT_HASH_MAP_H
+#pragma once
+#include "cclj/cclj.h"
+#include "cclj/algo_util.h"
+
+namespace cclj
+{
+	//Insert only open addressing map (linear probing, power of 2 capacity) that stores
+	//keys and values inline in one array.  Meant for the interning tables where entries
+	//are small, never removed and lookups vastly outnumber inserts.  Keys and values
+	//must be default constructible and cheap to copy.
+	template<typename tkey, typename tvalue, typename thasher = std::hash<tkey> >
+	class flat_hash_map
+	{
+		struct entry
+		{
+			tkey	_key;
+			tvalue	_value;
+			size_t	_hash_code;
+			bool	_occupied;
+			entry() : _hash_code( 0 ), _occupied( false ) {}
+		};
+
+		vector<entry>	_entries;
+		size_t			_count;
+		thasher			_hasher;
+
+		size_t probe( const tkey& key, size_t hash_code ) const
+		{
+			size_t mask = _entries.size() - 1;
+			for ( size_t idx = hash_code & mask; ; idx = ( idx + 1 ) & mask )
+			{
+				const entry& item( _entries[idx] );
+				if ( !item._occupied
+					|| ( item._hash_code == hash_code && item._key == key ) )
+					return idx;
+			}
+		}
+
+		void grow()
+		{
+			vector<entry> old_entries( _entries.size() * 2 );
+			old_entries.swap( _entries );
+			size_t mask = _entries.size() - 1;
+			for_each( old_entries.begin(), old_entries.end(), [&]( const entry& item )
+			{
+				if ( !item._occupied ) return;
+				size_t idx = item._hash_code & mask;
+				while( _entries[idx]._occupied ) idx = ( idx + 1 ) & mask;
+				_entries[idx] = item;
+			} );
+		}
+
+		size_t hash_key( const tkey& key ) const { return hash_mix( _hasher( key ) ); }
+
+	public:
+		flat_hash_map( size_t initial_capacity = 64 )
+			: _count( 0 )
+		{
+			size_t capacity = 16;
+			while( capacity < initial_capacity ) capacity *= 2;
+			_entries.resize( capacity );
+		}
+
+		size_t size() const { return _count; }
+		size_t capacity() const { return _entries.size(); }
+
+		//nullptr if the key isn't in the map.  The pointer is invalidated by insert.
+		tvalue* find( const tkey& key )
+		{
+			entry& item( _entries[probe( key, hash_key( key ) )] );
+			return item._occupied ? &item._value : nullptr;
+		}
+
+		//Adds the key if it isn't present; existing values are left alone.
+		tvalue& insert( const tkey& key, const tvalue& value )
+		{
+			//Keep the load factor under 1/2 so probe sequences stay short.
+			if ( ( _count + 1 ) * 2 > _entries.size() )
+				grow();
+			size_t hash_code = hash_key( key );
+			entry& item( _entries[probe( key, hash_code )] );
+			if ( !item._occupied )
+			{
+				item._key = key;
+				item._value = value;
+				item._hash_code = hash_code;
+				item._occupied = true;
+				++_count;
+			}
+			return item._value;
+		}
+
+		template<typename tvisitor>
+		void visit( tvisitor visitor )
+		{
+			for_each( _entries.begin(), _entries.end(), [&]( entry& item )
+			{
+				if ( item._occupied ) visitor( item._key, item._value );
+			} );
+		}
+	};
+}
+
+#endif
@@ -14,6 +14,7 @@
 #include "cclj/string_table.h"
 #include "cclj/noncopyable.h"
 #include "cclj/data_buffer.h"
+#include <iosfwd>
 
 namespace cclj
 {
@@ -71,14 +72,41 @@ namespace cclj
 			locked =			1 << 0,
 			mark_left =			1 << 1,
 			mark_right =		1 << 2,
+			//Survived a collection.  Sticky; only the generational collector uses it.
+			mature =			1 << 3,
+			//Never set; a mark_buffer using it reports every reference.
+			unmarked =			1 << 4,
 		};
 	};
 
 	//flags are maintained by the gc.   They are user-readable but do not write
-	//to them.
-	class gc_object_flags : public flags<gc_object_flag_values::val,uint16_t>
+	//to them.  Updates are atomic because mark threads set mark bits while the
+	//mutator may be locking the same object.
+	class gc_object_flags : noncopyable
 	{
+		atomic<uint16_t> _data;
 	public:
+		gc_object_flags() : _data( 0 ) {}
+
+		bool has_value( gc_object_flag_values::val flag ) const
+		{
+			return ( _data.load( std::memory_order_relaxed ) & flag ) == flag;
+		}
+
+		void set( gc_object_flag_values::val flag, bool value )
+		{
+			if ( value )
+				_data.fetch_or( static_cast<uint16_t>( flag ) );
+			else
+				_data.fetch_and( static_cast<uint16_t>( ~flag ) );
+		}
+
+		//Set the flag; returns true if this call is the one that set it.
+		bool try_set( gc_object_flag_values::val flag )
+		{
+			if ( has_value( flag ) ) return false;
+			return ( _data.fetch_or( static_cast<uint16_t>( flag ) ) & flag ) == 0;
+		}
 
 		bool is_locked() const { return has_value( gc_object_flag_values::locked ); }
 		void set_locked( bool val ) { set( gc_object_flag_values::locked, val ); }
@@ -88,6 +116,8 @@ namespace cclj
 		
 		bool is_marked_right() const { return has_value( gc_object_flag_values::mark_right ); }
 		void set_marked_right( bool val ) { set( gc_object_flag_values::mark_right, val ); }
+
+		bool is_mature() const { return has_value( gc_object_flag_values::mature ); }
 	};
 
 	class gc_object;
@@ -104,6 +134,7 @@ namespace cclj
 		uint16_t			_user_flags; //16 bits for you!
 		atomic<int32_t>		_refcount;
 	public:
+		gc_object() : _user_flags( 0 ), _refcount( 0 ) {}
 
 		const gc_object_flags& flags() const { return _flags; }
 
@@ -128,6 +159,142 @@ namespace cclj
 
 	typedef function<gc_object* (uint8_t* mem, size_t memLen)> object_constructor;
 
+	struct gc_options
+	{
+		//Threads used by the mark phase, including the thread calling perform_gc.
+		uint32_t	_mark_thread_count;
+		//Generational collector only; perform_gc does a full collection once the number
+		//of mature objects has grown by this factor since the last full collection.
+		float		_full_gc_growth;
+		//Release dead objects and reclaim their memory on a background thread after a
+		//full collection instead of during it.  gc_release must then be safe to call
+		//off the mutator's thread.
+		bool		_background_sweep;
+
+		gc_options()
+			: _mark_thread_count( 1 )
+			, _full_gc_growth( 2.0f )
+			, _background_sweep( false )
+		{
+		}
+	};
+
+	struct gc_collection_kinds
+	{
+		enum val
+		{
+			full,
+			//Generational collections of the objects allocated since the last one.
+			minor,
+			//A collection done with gc_step.
+			incremental,
+		};
+	};
+
+	//Sizes count the object's whole cell, header included.
+	struct gc_collection_stats
+	{
+		gc_collection_kinds::val	_kind;
+		//Longest time the collection stopped the mutator.  For incremental collections
+		//this is the longest step.
+		double						_pause_ms;
+		//Time spent collecting, whether the mutator was stopped or not.  Doesn't include
+		//a background sweep.
+		double						_work_ms;
+		size_t						_objects_marked;
+		size_t						_bytes_marked;
+		size_t						_objects_swept;
+		size_t						_bytes_swept;
+		//Young objects the collection looked at and those of them that became mature
+		//(generational collector only).
+		size_t						_young_objects;
+		size_t						_objects_promoted;
+		size_t						_bytes_promoted;
+
+		gc_collection_stats( gc_collection_kinds::val kind = gc_collection_kinds::full )
+			: _kind( kind )
+			, _pause_ms( 0 )
+			, _work_ms( 0 )
+			, _objects_marked( 0 )
+			, _bytes_marked( 0 )
+			, _objects_swept( 0 )
+			, _bytes_swept( 0 )
+			, _young_objects( 0 )
+			, _objects_promoted( 0 )
+			, _bytes_promoted( 0 )
+		{
+		}
+	};
+
+	//Totals over the collector's lifetime.
+	struct gc_stats
+	{
+		size_t						_collections;
+		size_t						_minor_collections;
+		double						_total_pause_ms;
+		double						_max_pause_ms;
+		size_t						_objects_swept;
+		size_t						_bytes_swept;
+		//Young objects minor collections looked at and how many of them survived.
+		size_t						_young_objects;
+		size_t						_objects_promoted;
+		gc_collection_stats			_last_collection;
+
+		gc_stats()
+			: _collections( 0 )
+			, _minor_collections( 0 )
+			, _total_pause_ms( 0 )
+			, _max_pause_ms( 0 )
+			, _objects_swept( 0 )
+			, _bytes_swept( 0 )
+			, _young_objects( 0 )
+			, _objects_promoted( 0 )
+		{
+		}
+
+		double promotion_rate() const
+		{
+			return _young_objects ? static_cast<double>( _objects_promoted ) / _young_objects : 0.0;
+		}
+
+		void add( const gc_collection_stats& collection )
+		{
+			++_collections;
+			if ( collection._kind == gc_collection_kinds::minor )
+				++_minor_collections;
+			_total_pause_ms += collection._pause_ms;
+			_max_pause_ms = std::max( _max_pause_ms, collection._pause_ms );
+			_objects_swept += collection._objects_swept;
+			_bytes_swept += collection._bytes_swept;
+			_young_objects += collection._young_objects;
+			_objects_promoted += collection._objects_promoted;
+			_last_collection = collection;
+		}
+	};
+
+	struct gc_size_class_stats
+	{
+		size_t		_cell_size;
+		size_t		_objects;
+		size_t		_bytes;
+		gc_size_class_stats( size_t cell_size = 0 ) : _cell_size( cell_size ), _objects( 0 ), _bytes( 0 ) {}
+	};
+
+	struct gc_heap_stats
+	{
+		size_t							_objects;
+		size_t							_object_bytes;
+		//Memory the collector holds from its allocator, free space included.
+		size_t							_reserved_bytes;
+		//Small objects by size class; the cell sizes go up by 16 bytes.
+		vector<gc_size_class_stats>		_size_classes;
+		gc_size_class_stats				_large_objects;
+
+		gc_heap_stats() : _objects( 0 ), _object_bytes( 0 ), _reserved_bytes( 0 ) {}
+	};
+
+	typedef function<void (const gc_collection_stats&)> gc_collection_callback;
+
 	class garbage_collector
 	{
 	protected:
@@ -136,7 +303,9 @@ namespace cclj
 
 		friend class shared_ptr<garbage_collector>;
 		
-		//If new_size_in_bytes isn't a multiple of type-instance_size() error is thrown.
+		//The constructor must place the object at the start of the memory it is given.
+		//New objects are not locked; lock them (or reference them from a locked object)
+		//before the next perform_gc.
 		virtual gc_object& allocate_object( size_t len, uint8_t alignment
 													, object_constructor constructor
 													, file_info alloc_info ) = 0;
@@ -144,14 +313,65 @@ namespace cclj
 		virtual void lock( gc_object& obj ) = 0;
 		virtual void unlock( gc_object& obj ) = 0;
 
+		//Stop the world mark from the locked objects followed by a sweep that releases
+		//everything not reached.  The generational collector usually only collects the
+		//objects allocated since the previous collection.
 		virtual void perform_gc() = 0;
+		//Always marks and sweeps every object.
+		virtual void perform_full_gc() = 0;
+		//Wait for the background sweep of the last collection to release every dead
+		//object.  Collections do this before they start.
+		virtual void finish_sweep() = 0;
+
+		//Do at most budget_us microseconds of incremental collection work, starting a new
+		//collection if none is running.  Returns true when this step finished one.  The
+		//clock is read every 16 units of work, a unit being scanning one object, sweeping or
+		//freeing one dead object or copying one object pointer, so a step overruns the budget
+		//by at most 16 units plus the collection callback of the step that finishes.  Pushes
+		//onto the gray stack occasionally grow it, which copies it.  The mutator may
+		//run between steps; objects it allocates meanwhile survive the collection and
+		//references it drops are reported by gc_refcount_ptr.  Collectors without an
+		//incremental mode do a whole collection.
+		virtual bool gc_step( uint32_t budget_us ) = 0;
 		//very transient data, useful for unit testing.
 		virtual const_gc_object_raw_ptr_buffer locked_objects() = 0;
 		virtual const_gc_object_raw_ptr_buffer all_objects() = 0;
 
 		virtual allocator_ptr allocator() = 0;
 
-		static shared_ptr<garbage_collector> create_mark_sweep( allocator_ptr alloc );
+		virtual gc_stats stats() = 0;
+		//Called on the collecting thread after each collection.
+		virtual void set_collection_callback( gc_collection_callback callback ) = 0;
+		//Walks the heap.  Like write_heap_snapshot this first finishes any collection that
+		//is in progress.
+		virtual gc_heap_stats heap_stats() = 0;
+		//Writes a line per object: id, user flags (the type tag), cell size, retained size
+		//and the ids of the objects it references.  The retained size is what would be
+		//freed if the object went away, from the dominator tree rooted at the locked
+		//objects.  Objects no root reaches count as roots.
+		virtual void write_heap_snapshot( std::ostream& out ) = 0;
+		void write_heap_snapshot( const string& path );
+
+		static shared_ptr<garbage_collector> create_mark_sweep( allocator_ptr alloc, const gc_options& options = gc_options() );
+		//Young objects are bump allocated per thread and promoted in place when they
+		//survive.  References between objects must be held by gc_refcount_ptr; a young
+		//object's refcount is how a minor collection knows old objects point at it.
+		//allocate_object may be called from several threads; everything else may not.
+		static shared_ptr<garbage_collector> create_generational( allocator_ptr alloc, const gc_options& options = gc_options() );
+
+		//Snapshot at the beginning write barrier: while an incremental mark is running,
+		//whatever drops a reference to obj has to report it first so obj is still marked.
+		//gc_refcount_ptr does this.
+		static void reference_dropped( gc_object& obj )
+		{
+			if ( incremental_marks.load( std::memory_order_relaxed ) )
+				shade( obj );
+		}
+
+		static void shade( gc_object& obj );
+
+		//Collectors in the middle of an incremental mark.
+		static atomic<uint32_t> incremental_marks;
 	};
 
 	typedef shared_ptr<garbage_collector> garbage_collector_ptr;
@@ -225,7 +445,9 @@ namespace cclj
 		bool operator != ( const this_type& other ) const { return _object != other._object; }
 	};
 
-	//Reference counting is used inside the object graph.
+	//Reference counting is used inside the object graph.  The count doubles as the
+	//generational collector's remembered set, so hold references to other gc objects
+	//through this rather than raw pointers.
 	template<typename tobj_type>
 	class gc_refcount_ptr
 	{
@@ -241,6 +463,7 @@ namespace cclj
 		{
 			if ( _object )
 			{
+				garbage_collector::reference_dropped( *_object );
 				_object->dec_ref();
 				_object = nullptr;
 			}
@@ -264,6 +487,11 @@ namespace cclj
 			acquire();
 		}
 
+		gc_refcount_ptr( const this_type& other ) : _object( other._object )
+		{
+			acquire();
+		}
+
 		gc_refcount_ptr& operator=( const this_type& other )
 		{
 			if ( this != &other )
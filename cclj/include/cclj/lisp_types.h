@@ -13,6 +13,7 @@
 #include "cclj/type_library.h"
 #include "cclj/allocator.h"
 #include "cclj/invasive_list.h"
+#include "cclj/number_scanner.h"
 
 namespace cclj { namespace lisp {
 	struct types
@@ -28,12 +29,16 @@ namespace cclj { namespace lisp {
 		};
 
 
+		//Objects carry their type in a one byte tag instead of a vtable so type() and
+		//object_traits::cast are a load and compare.  Objects live in factory pools and
+		//are never destroyed through an object pointer.
 		class object: public noncopyable
 		{
+			uint8_t _type;
 		protected:
+			object( types::_enum type ) : _type( static_cast<uint8_t>( type ) ) {}
 		public:
-			virtual ~object(){}
-			virtual types::_enum type() const = 0;
+			types::_enum type() const { return static_cast<types::_enum>( _type ); }
 		};
 
 
@@ -47,12 +52,12 @@ namespace cclj { namespace lisp {
 			object* _value;
 			object* _next;
 			cons_cell()
-				: _value( nullptr )
+				: object( types::cons_cell )
+				, _value( nullptr )
 				, _next( nullptr )
 			{
 			}
 			enum { item_type = types::cons_cell };
-			virtual types::_enum type() const { return types::cons_cell; }
 		};
 
 		CCLJ_DEFINE_INVASIVE_SINGLE_LIST(cons_cell);
@@ -63,8 +68,8 @@ namespace cclj { namespace lisp {
 		{
 		public:
 			object_ptr_buffer _data;
+			array() : object( types::array ) {}
 			enum { item_type = types::array };
-			virtual types::_enum type() const { return types::array; }
 		};
 
 
@@ -75,10 +80,9 @@ namespace cclj { namespace lisp {
 			type_ref*			_evaled_type;
 			//the type is evaluated at type check time.
 			cons_cell*			_unevaled_type;
-			symbol() : _evaled_type( nullptr ), _unevaled_type(nullptr) {}
+			symbol() : object( types::symbol ), _evaled_type( nullptr ), _unevaled_type(nullptr) {}
 
 			enum { item_type = types::symbol };
-			virtual types::_enum type() const { return types::symbol; }
 		};
 
 
@@ -86,11 +90,12 @@ namespace cclj { namespace lisp {
 		{
 		public:
 			string_table_str _unparsed_number;
+			//Parsed by the reader; the unparsed number is kept for error reporting.
+			numeric_literal	_value;
 			cons_cell*		_unevaled_type;
-			constant() : _unevaled_type( nullptr ) {}
+			constant() : object( types::constant ), _unevaled_type( nullptr ) {}
 
 			enum { item_type = types::constant };
-			virtual types::_enum type() const { return types::constant; }
 		};
 
 		class object_traits
@@ -119,6 +124,27 @@ namespace cclj { namespace lisp {
 			}
 		};
 
+		struct factory_type_stats
+		{
+			size_t _count;
+			//bytes of the objects themselves, not including pool slack.
+			size_t _bytes;
+			factory_type_stats() : _count( 0 ), _bytes( 0 ) {}
+		};
+
+		struct factory_stats
+		{
+			factory_type_stats _cells;
+			factory_type_stats _arrays;
+			factory_type_stats _symbols;
+			factory_type_stats _constants;
+			//array contents and allocate_data
+			factory_type_stats _buffers;
+			//everything the factory holds from its allocator
+			size_t _reserved_bytes;
+			factory_stats() : _reserved_bytes( 0 ) {}
+		};
+
 		class factory
 		{
 		protected:
@@ -132,6 +158,7 @@ namespace cclj { namespace lisp {
 			virtual constant* create_constant() = 0;
 			virtual uint8_t* allocate_data( size_t size, uint8_t alignment ) = 0;
 			virtual object_ptr_buffer allocate_obj_buffer(size_t size) = 0;
+			virtual factory_stats stats() = 0;
 
 			static shared_ptr<factory> create_factory( allocator_ptr allocator, const cons_cell& empty_cell );
 		};
@@ -31,6 +31,8 @@ namespace cclj
 		virtual void set_visibility(visibility::_enum visibility) = 0;
 		virtual variable_node& node() = 0;
 		virtual void set_value(void* value) = 0;
+		//Variables are constant unless compiled code writes to them.
+		virtual void set_constant(bool constant) = 0;
 	};
 
 	class variable_node
@@ -61,6 +63,8 @@ namespace cclj
 
 	typedef data_buffer<named_type> named_type_buffer;
 	typedef function<pair<llvm_value_ptr_opt, type_ref_ptr> (compiler_context&)> compile_pass_fn;
+	//Emits the function's instructions straight into the caller given the evaluated arguments.
+	typedef function<llvm_value_ptr (compiler_context&, data_buffer<llvm_value_ptr>)> intrinsic_fn;
 
 	class function_factory
 	{
@@ -70,6 +74,9 @@ namespace cclj
 		virtual void set_function_body(ast_node_buffer body) = 0;
 		virtual void set_function_body(void* fn_ptr) = 0;
 		virtual void set_function_override_body(compile_pass_fn) = 0;
+		//Call sites expand the intrinsic inline; a real function is only produced if
+		//something references it after all call sites are compiled.
+		virtual void set_function_intrinsic_body(intrinsic_fn) = 0;
 		virtual void set_visibility(visibility::_enum visibility) = 0;
 		virtual function_node& node() = 0;
 	};
@@ -92,6 +99,7 @@ namespace cclj
 		virtual ast_node_buffer get_function_body() = 0;
 		virtual void*			get_function_external_body() = 0;
 		virtual compile_pass_fn get_function_override_body() = 0;
+		virtual intrinsic_fn	get_function_intrinsic_body() = 0;
 		virtual void compile_first_pass(compiler_context& ctx) = 0;
 		virtual void compile_second_pass(compiler_context& ctx) = 0;
 		virtual llvm::Function& llvm() = 0;
@@ -590,6 +598,10 @@ namespace cclj
 		virtual type_ref& init_return_type() = 0;
 		virtual void compile_first_pass(compiler_context& ctx) = 0;
 		virtual void compile_second_pass(compiler_context& ctx) = 0;
+		//When the context compiles lazily the second pass leaves the bodies of functions in the
+		//context's _lazy_functions for compile_lazy_function, which runs the first time the JIT
+		//needs one of them.  ctx has to be the context that compiled fn's llvm module.
+		virtual void compile_lazy_function(compiler_context& ctx, llvm::Function& fn) = 0;
 		//Returns the initialization function
 		virtual llvm::Function& llvm() = 0;
 
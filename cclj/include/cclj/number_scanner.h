@@ -0,0 +1,239 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#ifndef CCLJ_NUMBER_SCANNER_H
+#define CCLJ_NUMBER_SCANNER_H
+#pragma once
+#include "cclj/cclj.h"
+
+namespace cclj
+{
+	struct numeric_literal_types
+	{
+		enum _enum
+		{
+			not_numeric = 0,
+			integer,
+			floating,
+		};
+	};
+
+	//Parsed value of a numeric literal.  Integers are stored as their 64 bit two's
+	//complement pattern so both i64 and u64 literals round trip.
+	struct numeric_literal
+	{
+		numeric_literal_types::_enum	_type;
+		union
+		{
+			uint64_t					_integer;
+			double						_floating;
+		};
+
+		numeric_literal()
+			: _type( numeric_literal_types::not_numeric )
+			, _integer( 0 )
+		{
+		}
+
+		static numeric_literal from_integer( int64_t val )
+		{
+			numeric_literal retval;
+			retval._type = numeric_literal_types::integer;
+			retval._integer = static_cast<uint64_t>( val );
+			return retval;
+		}
+
+		static numeric_literal from_floating( double val )
+		{
+			numeric_literal retval;
+			retval._type = numeric_literal_types::floating;
+			retval._floating = val;
+			return retval;
+		}
+
+		bool is_numeric() const { return _type != numeric_literal_types::not_numeric; }
+		bool is_floating() const { return _type == numeric_literal_types::floating; }
+
+		template<typename num_type>
+		num_type cast() const
+		{
+			if ( _type == numeric_literal_types::floating )
+				return static_cast<num_type>( _floating );
+			return static_cast<num_type>( static_cast<int64_t>( _integer ) );
+		}
+	};
+
+	template<> inline bool numeric_literal::cast<bool>() const
+	{
+		if ( _type == numeric_literal_types::floating )
+			return _floating != 0.0;
+		return _integer != 0;
+	}
+
+	//Classifies a token as a number or a symbol one character at a time so the reader
+	//can run it while it looks for the end of the token.  Accepted forms:
+	//[+-]digits, [+-]digits.digits*, either followed by e[+-]digits, [+-]0x hex and [+-]0b binary.
+	//Anything else is a symbol.
+	class number_scanner
+	{
+		struct states
+		{
+			enum _enum
+			{
+				start = 0,
+				sign,
+				zero,
+				decimal,
+				hex_prefix,
+				hex,
+				binary_prefix,
+				binary,
+				dot,
+				fraction,
+				exponent,
+				exponent_sign,
+				exponent_digits,
+				symbol,
+			};
+		};
+
+		states::_enum	_state;
+		bool			_negative;
+		bool			_exponent_negative;
+		//Set when the mantissa no longer fits in 64 bits.  Integers then fail and
+		//floats fall back to strtod.
+		bool			_truncated;
+		uint64_t		_mantissa;
+		//Power of ten applied to _mantissa by the digits after the dot.
+		int32_t			_decimal_exponent;
+		int32_t			_exponent;
+
+		void add_decimal_digit( char data )
+		{
+			uint32_t digit = static_cast<uint32_t>( data - '0' );
+			if ( !_truncated && _mantissa <= ( numeric_limits<uint64_t>::max() - digit ) / 10 )
+				_mantissa = _mantissa * 10 + digit;
+			else
+				_truncated = true;
+		}
+
+		void add_radix_digit( uint32_t digit, uint32_t shift )
+		{
+			if ( _mantissa >> ( 64 - shift ) )
+				_truncated = true;
+			_mantissa = ( _mantissa << shift ) | digit;
+		}
+
+		static int32_t hex_value( char data )
+		{
+			if ( data >= '0' && data <= '9' ) return data - '0';
+			if ( data >= 'a' && data <= 'f' ) return data - 'a' + 10;
+			if ( data >= 'A' && data <= 'F' ) return data - 'A' + 10;
+			return -1;
+		}
+
+		static bool is_digit( char data ) { return data >= '0' && data <= '9'; }
+
+	public:
+		number_scanner() { reset(); }
+
+		void reset()
+		{
+			_state = states::start;
+			_negative = false;
+			_exponent_negative = false;
+			_truncated = false;
+			_mantissa = 0;
+			_decimal_exponent = 0;
+			_exponent = 0;
+		}
+
+		//Once a token is known to be a symbol the rest of the characters are ignored.
+		bool is_symbol() const { return _state == states::symbol; }
+
+		void next( char data )
+		{
+			switch( _state )
+			{
+			case states::start:
+				if ( data == '+' || data == '-' ) { _negative = data == '-'; _state = states::sign; }
+				else if ( data == '0' ) _state = states::zero;
+				else if ( is_digit( data ) ) { add_decimal_digit( data ); _state = states::decimal; }
+				else _state = states::symbol;
+				break;
+			case states::sign:
+				if ( data == '0' ) _state = states::zero;
+				else if ( is_digit( data ) ) { add_decimal_digit( data ); _state = states::decimal; }
+				else _state = states::symbol;
+				break;
+			case states::zero:
+				if ( data == 'x' || data == 'X' ) _state = states::hex_prefix;
+				else if ( data == 'b' || data == 'B' ) _state = states::binary_prefix;
+				else if ( is_digit( data ) ) { add_decimal_digit( data ); _state = states::decimal; }
+				else if ( data == '.' ) _state = states::dot;
+				else if ( data == 'e' || data == 'E' ) _state = states::exponent;
+				else _state = states::symbol;
+				break;
+			case states::decimal:
+				if ( is_digit( data ) ) add_decimal_digit( data );
+				else if ( data == '.' ) _state = states::dot;
+				else if ( data == 'e' || data == 'E' ) _state = states::exponent;
+				else _state = states::symbol;
+				break;
+			case states::hex_prefix:
+			case states::hex:
+				{
+					int32_t value = hex_value( data );
+					if ( value >= 0 ) { add_radix_digit( static_cast<uint32_t>( value ), 4 ); _state = states::hex; }
+					else _state = states::symbol;
+				}
+				break;
+			case states::binary_prefix:
+			case states::binary:
+				if ( data == '0' || data == '1' ) { add_radix_digit( static_cast<uint32_t>( data - '0' ), 1 ); _state = states::binary; }
+				else _state = states::symbol;
+				break;
+			case states::dot:
+			case states::fraction:
+				if ( is_digit( data ) )
+				{
+					add_decimal_digit( data );
+					if ( !_truncated ) --_decimal_exponent;
+					_state = states::fraction;
+				}
+				else if ( data == 'e' || data == 'E' ) _state = states::exponent;
+				else _state = states::symbol;
+				break;
+			case states::exponent:
+				if ( data == '+' || data == '-' ) { _exponent_negative = data == '-'; _state = states::exponent_sign; break; }
+				//fallthrough
+			case states::exponent_sign:
+			case states::exponent_digits:
+				if ( is_digit( data ) )
+				{
+					//Anything past this is inf or zero anyway.
+					if ( _exponent < 100000 ) _exponent = _exponent * 10 + ( data - '0' );
+					_state = states::exponent_digits;
+				}
+				else _state = states::symbol;
+				break;
+			case states::symbol:
+				break;
+			}
+		}
+
+		//Produce the literal for the scanned characters.  The token text is only needed
+		//for floating point literals that cannot be converted exactly from the mantissa.
+		//Throws if an integer literal does not fit in 64 bits.
+		numeric_literal finish( const char* token, size_t token_len ) const;
+
+		static numeric_literal scan( const char* token, size_t token_len );
+		static numeric_literal scan( const char* token );
+	};
+}
+
+#endif
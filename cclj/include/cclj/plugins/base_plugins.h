@@ -43,6 +43,7 @@ namespace cclj { namespace plugins {
 
 	//Binary nodes are things that take two arguments and return an answer.
 	//Examples of those are things like low level operator + and comparison functions.
+	//They are intrinsics so calls compile to a single instruction.
 	class binary_low_level_ast_node
 	{
 	public:
@@ -40,6 +40,8 @@ namespace llvm
 	class Module;
 	class ExecutionEngine;
 	class BasicBlock;
+	class Function;
+	class GlobalVariable;
 }
 
 namespace cclj
@@ -137,13 +139,30 @@ namespace cclj
 	typedef unordered_map<string_table_str, user_compiler_data_ptr> string_compiler_data_map;
 
 	class module;
+	class variable_node;
+	class function_node;
+
+	//A stack slot the shadow stack frame lists, or a managed pointer inside an aggregate
+	//slot; field_path holds the struct indexes down to it.
+	struct gc_root
+	{
+		llvm::AllocaInst*	_slot;
+		vector<uint32_t>	_field_path;
+
+		gc_root( llvm::AllocaInst* slot, const vector<uint32_t>& path )
+			: _slot( slot )
+			, _field_path( path )
+		{
+		}
+	};
 
 
 	struct compiler_context
 	{
 		llvm::Module&				_llvm_module;
 		llvm::legacy::FunctionPassManager&	_fpm;
-		llvm::ExecutionEngine&		_eng;
+		//Null when compiling ahead of time.
+		llvm::ExecutionEngine*		_eng;
 		type_library_ptr			_type_library;
 		llvm_builder				_builder;
 		type_llvm_type_map			_type_map;
@@ -152,23 +171,61 @@ namespace cclj
 		compiler_scope_list			_scopes;
 		string_compiler_data_map	_user_compiler_data;
 		stringstream				_name_buffer;
+		//Stack slots of the function being compiled that hold managed pointers.  Every
+		//root of a slot is listed before the next slot's.
+		vector<gc_root>				_gc_roots;
+		//llvm names of the functions and variables the runtime supplies.
+		unordered_map<string, void*>	_global_mappings;
+		//Function bodies are compiled on first call instead of by the second pass.
+		bool						_lazy_compilation;
+		//With lazy compilation, the functions of this context's llvm module still waiting for
+		//a body.  The context lives as long as that module, later compiles get their own.
+		unordered_map<const llvm::Function*, function_node*>	_lazy_functions;
+		//Each compile is an MCJIT object of its own holding only what it defines: script
+		//functions are exported and the init function only runs this compile's top level forms.
+		bool						_separate_objects;
+		//With separate objects, llvm names of the script functions earlier compiles generated
+		//code for.  They are only declared and resolve to these addresses.
+		unordered_map<string, void*>	_compiled_functions;
+		//With separate objects, this compile's object comes from the object cache.  Functions
+		//are only declared and the second pass generates no code.
+		bool						_cached_object;
+		//The runtime's gc-shadow-stack variable; functions with managed locals push frames on it.
+		variable_node*				_gc_shadow_stack;
 
 		compiler_context( type_library_ptr tl
 							, qualified_name_table_ptr name_table
 							, shared_ptr<module> module
 							, llvm::Module& llvm_m,  llvm::legacy::FunctionPassManager& fpm
-							, llvm::ExecutionEngine& eng );
+							, llvm::ExecutionEngine* eng );
 
 
 		llvm_type_ptr_opt type_ref_type( type_ref& type );
 		void enter_scope();
 		void add_exit_block( llvm::BasicBlock& block );
 		void exit_scope();
+
+		//Functions with managed pointer locals push a shadow stack frame listing their slots
+		//so the collector can find them.  Record a local's slot if its type is managed, or
+		//each managed field if it is a tuple or struct.
+		void add_local( type_ref& type, llvm::AllocaInst& slot );
+		//A slot that keeps a managed temporary alive until the function returns.
+		llvm::AllocaInst& create_gc_root( type_ref& type );
+		void begin_gc_frame();
+		//Pushes the frame in the entry block and pops it at the insert point, which must be
+		//just ahead of the function's return.
+		void finish_gc_frame( llvm::Function& fn );
 		//uses the name buffer, so this is not safe to call in a reentrant context.
 
 		string qualified_name_to_llvm_name(qualified_name nm);
 		string qualified_name_to_llvm_name(qualified_name nm, type_ref_ptr_buffer specializations);
 		llvm::GlobalValue::LinkageTypes visibility_to_linkage(visibility::_enum vis);
+		//Bind a declaration to memory outside the module.
+		void map_global(llvm::GlobalValue& value, void* address);
+		//A function or variable of the module as declared in this context's llvm module.  The
+		//nodes hold the latest compile's; a lazily compiled body may belong to an earlier one.
+		llvm::Function& module_function(function_node& fn);
+		llvm::GlobalVariable& module_variable(variable_node& var);
 	};
 	
 	struct compiler_scope_watcher
@@ -30,21 +30,23 @@ namespace cclj
 		file_info			_alloc_info;
 		uint8_t				_item_alignment;
 
+		uint32_t actual_item_size() const
+		{
+			return align_number( std::max<uint32_t>( item_size, sizeof( free_entry ) ), _item_alignment );
+		}
+
 		void allocate_slab()
 		{
 			uint32_t actual_slab_size = align_number( slab_size, _item_alignment );
 			uint8_t* new_slab = _allocator->allocate( actual_slab_size, _item_alignment, _alloc_info );
 
-			uint32_t actual_item_size = align_number( std::max( item_size, sizeof( free_entry ) ), _item_alignment );
+			uint32_t item_stride = actual_item_size();
+			uint32_t num_items = actual_slab_size / item_stride;
 
-			uint32_t num_items = actual_slab_size / actual_item_size;
-			uint8_t* item_ptr = new_slab;
-
-			for ( uint32_t idx = 0; idx < num_items; ++idx )
-			{
-				add_free_entry( item_ptr );
-				item_ptr += actual_item_size;
-			}
+			//Push in reverse so items are handed out in address order; cells allocated one
+			//after another (a list being read) end up next to each other.
+			for ( uint32_t idx = num_items; idx > 0; --idx )
+				add_free_entry( new_slab + ( idx - 1 ) * item_stride );
 			_slab_list.push_back( new_slab );
 		}
 
@@ -91,6 +93,12 @@ namespace cclj
 			add_free_entry( data );
 		}
 
+		//Bytes of slab memory this pool is holding.
+		size_t reserved_bytes() const
+		{
+			return _slab_list.size() * align_number( slab_size, _item_alignment );
+		}
+
 
 		//Utility functions for creating/destroying objects.
 
@@ -53,26 +53,29 @@ namespace cclj
 
 		virtual string_table_ptr string_table() = 0;
 		virtual qualified_name register_name(string_table_str_buffer name) = 0;
-		qualified_name register_name(const char* nm)
+		qualified_name register_name(string_table_str str)
 		{
-			auto str = string_table()->register_str(nm);
 			string_table_str_buffer buf(&str, 1);
 			return register_name(buf);
 		}
+		qualified_name register_name(const char* nm)
+		{
+			return register_name(string_table()->register_str(nm));
+		}
 		qualified_name register_name(const string& nm)
 		{
-			return register_name(nm.c_str());
+			return register_name(string_table()->register_str(nm));
 		}
 
 		qualified_name register_name(data_buffer<string> name)
 		{
 			if (name.size() == 1)
-				return register_name(name[0].c_str());
+				return register_name(name[0]);
 
 			vector<string_table_str> data_buf(name.size());
 			auto str_table = string_table();
 			for (size_t idx = 0, end = name.size(); idx < end; ++idx)
-				data_buf[idx] = str_table->register_str(name[idx].c_str());
+				data_buf[idx] = str_table->register_str(name[idx]);
 			return register_name(data_buf);
 		}
 		static shared_ptr<qualified_name_table> create_table(string_table_ptr st);
@@ -0,0 +1,56 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#ifndef CCLJ_READER_H
+#define CCLJ_READER_H
+#pragma once
+#include "cclj/cclj.h"
+#include "cclj/lisp_types.h"
+#include "cclj/string_table.h"
+#include <istream>
+
+namespace cclj
+{
+	//Produces top level forms one at a time so callers can type check a form before the
+	//rest of the source has been read.  Forms are allocated out of the factory the reader
+	//was created with and live as long as that factory.
+	class form_reader
+	{
+	protected:
+		virtual ~form_reader(){}
+	public:
+		friend class shared_ptr<form_reader>;
+
+		//Returns nullptr once the input is exhausted.
+		virtual lisp::object_ptr next_form() = 0;
+
+		//Read out of memory owned by the caller; the data must outlive the reader.
+		static shared_ptr<form_reader> create_buffer_reader( string_table_ptr st, lisp::factory_ptr f
+																, const char* data, size_t len );
+
+		//Memory map the file and read directly out of the mapping.
+		static shared_ptr<form_reader> create_file_reader( string_table_ptr st, lisp::factory_ptr f
+																, const string& path );
+
+		//Read the stream chunk_size bytes at a time.  Only the form currently being read
+		//is buffered.
+		static shared_ptr<form_reader> create_stream_reader( string_table_ptr st, lisp::factory_ptr f
+																, std::istream& stream, size_t chunk_size );
+
+		//Split the buffer at top level form boundaries and parse the forms on one thread
+		//per factory.  Each thread allocates only from its own factory and registers
+		//strings through its own cache in front of a synchronized view of st, so st
+		//must not be used elsewhere until this returns.  Forms are returned in source order.
+		static vector<lisp::object_ptr> read_parallel( string_table_ptr st
+														, const vector<lisp::factory_ptr>& factories
+														, const char* data, size_t len );
+	};
+
+	typedef shared_ptr<form_reader> form_reader_ptr;
+}
+
+#endif
@@ -0,0 +1,69 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#ifndef CCLJ_RUNTIME_H
+#define CCLJ_RUNTIME_H
+#pragma once
+#include "cclj/cclj.h"
+#include "cclj/allocator.h"
+#include "cclj/garbage_collector.h"
+#include "cclj/noncopyable.h"
+
+namespace cclj
+{
+	//Pushed by every running compiled function with managed locals; roots holds the
+	//addresses of its slots.  Layout matches compiler_context::finish_gc_frame.
+	struct gc_shadow_frame
+	{
+		gc_shadow_frame*	_previous;
+		void**				_roots;
+		uint32_t			_root_count;
+	};
+
+	//What compiled code reaches through the rt variable: the memory behind malloc, free
+	//and gc-alloc.  The JIT gives every compiler one; code compiled ahead of time uses the
+	//one in aot_runtime.cpp.  Managed code runs on one thread at a time.
+	class runtime : noncopyable
+	{
+		allocator_ptr			_allocator;
+		//Data addresses of the live gc-alloc blocks.  Declared ahead of the heap so it
+		//outlives the blocks the heap releases when it goes away.
+		unordered_set<const void*>	_live_blocks;
+		garbage_collector_ptr	_managed_heap;
+		//The gc-shadow-stack variable; compiled code pushes and pops frames on it directly.
+		gc_shadow_frame**		_shadow_stack;
+		size_t					_collection_bytes;
+		size_t					_managed_bytes;
+
+	public:
+		//gc-alloc collects once collection_bytes have been handed out since the last collection.
+		runtime( allocator_ptr alloc, size_t collection_bytes, gc_shadow_frame** shadow_stack );
+
+		void* allocate( uint32_t size, uint8_t alignment );
+		void deallocate( void* data );
+		//Zeroed and 16 byte aligned.  Lives while a shadow stack slot or another live block
+		//points at it.  Blocks are scanned conservatively: any aligned word equal to the
+		//start of a live block keeps that block alive.  Managed pointers in malloc memory
+		//are not roots.
+		void* gc_allocate( uint32_t size );
+		//True if data is the start of a live gc-alloc block.
+		bool is_managed( const void* data ) const { return _live_blocks.count( data ) != 0; }
+		//Called as a block is released.
+		void forget_block( const void* data );
+		//Lock whatever the shadow stack's slots point at for the length of the collection.
+		void collect();
+
+		garbage_collector_ptr managed_heap() { return _managed_heap; }
+
+		//The bodies of malloc, free and gc-alloc; rt is the runtime.
+		static void* rt_malloc( void* rt, uint32_t size, uint8_t alignment );
+		static void rt_free( void* rt, void* data );
+		static void* rt_gc_alloc( void* rt, uint32_t size );
+	};
+}
+
+#endif
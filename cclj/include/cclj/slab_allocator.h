@@ -18,51 +18,91 @@ namespace cclj
 	template<typename data_type>
 	struct slab_alloc_destruct_traits
 	{
-		static void add_to_destruct_list(data_type* dtype, vector<function<void()> >& destructors)
-		{
-			(void)dtype;
-			(void)destructors;
-		}
+		enum { requires_destruction = 0 };
 	};
 
 
 #define CCLJ_SLAB_ALLOCATOR_REQUIRES_DESTRUCTION(data_type)							\
 	template<> struct slab_alloc_destruct_traits<data_type>							\
 	{																				\
-		static void add_to_destruct_list(data_type* dtype							\
-										, vector <function<void()> >& destructors)	\
-		{																			\
-			destructors.push_back([=](){ dtype->~data_type(); });					\
-		}																			\
+		enum { requires_destruction = 1 };											\
 	};
 
+	//Sits in the slab directly in front of each object that needs destruction.  The
+	//entries form a newest first chain through the slabs.
+	struct slab_destructor_entry
+	{
+		slab_destructor_entry*	_next;
+		void					(*_destroy)( void* object );
+		void* object() { return this + 1; }
+	};
+
+	//Allocator state captured by slab_allocator::mark.
+	struct slab_allocator_mark
+	{
+		size_t					_slab_count;
+		size_t					_freesize;
+		size_t					_large_count;
+		slab_destructor_entry*	_destruct_head;
+		slab_allocator_mark() : _slab_count( 0 ), _freesize( 0 ), _large_count( 0 ), _destruct_head( nullptr ) {}
+	};
 
 	template<uint32_t slab_size = 4096>
 	class slab_allocator
 	{
 		allocator_ptr _allocator;
+		//The last slab is the one being allocated from.
 		vector<uint8_t*> _allocations;
+		vector<uint8_t*> _large_allocations;
 		size_t _freesize;
-		vector < function<void() > > _destruct_list;
+		slab_destructor_entry* _destruct_head;
+
+		template<typename item_type>
+		static void destroy_item( void* object ) { reinterpret_cast<item_type*>( object )->~item_type(); }
+
+		void destruct_until( slab_destructor_entry* stop )
+		{
+			for ( ; _destruct_head != stop; _destruct_head = _destruct_head->_next )
+				_destruct_head->_destroy( _destruct_head->object() );
+		}
+
+		//Memory for an item; items that need destruction get a destructor entry in front
+		//of them which is linked by track_destruction once the item is constructed.
+		template<typename item_type>
+		uint8_t* allocate_item()
+		{
+			static_assert( sizeof( slab_destructor_entry ) % sizeof( void* ) == 0, "entry must keep items pointer aligned" );
+			if ( slab_alloc_destruct_traits<item_type>::requires_destruction )
+			{
+				uint8_t* mem = allocate( sizeof( slab_destructor_entry ) + sizeof( item_type ), sizeof( void* ), CCLJ_IMMEDIATE_FILE_INFO() );
+				return mem + sizeof( slab_destructor_entry );
+			}
+			return allocate( sizeof( item_type ), sizeof( void* ), CCLJ_IMMEDIATE_FILE_INFO() );
+		}
+
+		template<typename item_type>
+		item_type* track_destruction( item_type* item )
+		{
+			if ( slab_alloc_destruct_traits<item_type>::requires_destruction )
+			{
+				slab_destructor_entry* entry = reinterpret_cast<slab_destructor_entry*>( item ) - 1;
+				entry->_destroy = &slab_allocator::destroy_item<item_type>;
+				entry->_next = _destruct_head;
+				_destruct_head = entry;
+			}
+			return item;
+		}
+
 	public:
 		slab_allocator( allocator_ptr alloc )
 			: _allocator( alloc )
 			, _freesize( 0 )
+			, _destruct_head( nullptr )
 		{
 		}
 		~slab_allocator()
 		{
-			for_each(_destruct_list.begin(), _destruct_list.end(), [this]
-			(function<void()> destructor )
-			{
-				destructor();
-			});
-
-			for_each( _allocations.begin(), _allocations.end(), [this]
-			( uint8_t* alloc )
-			{
-				_allocator->deallocate( alloc );
-			} );
+			rewind( slab_allocator_mark() );
 		}
 
 		uint8_t* allocate( size_t size, uint8_t alignment, file_info alloc_info )
@@ -87,62 +127,81 @@ namespace cclj
 				_freesize = slab_size;
 				return allocate( size, alignment, alloc_info );
 			}
-			//else large allocation, allocate, record, and preserve invariant that the last open
-			//slab is at the end.
+			//else large allocation; these are kept separately so the open slab stays at the end.
+			_large_allocations.push_back( _allocator->allocate( size, alignment, alloc_info ) );
+			return _large_allocations.back();
+		}
+
+		//Bytes of slab and large allocation memory currently held.
+		size_t reserved_bytes() const
+		{
+			size_t retval = _allocations.size() * slab_size;
+			for_each( _large_allocations.begin(), _large_allocations.end(), [&]( uint8_t* alloc )
 			{
-				_allocations.push_back( _allocator->allocate( size, alignment, alloc_info ) );
-				uint8_t* retval = _allocations.back();
-				if ( _freesize )
-				{
-					//swap the end and the second to end
-					swap( *(_allocations.end() - 1), *(_allocations.end() - 2) );
-				}
-				return retval;
-			}
+				retval += _allocator->get_alloc_info( alloc ).alloc_size;
+			} );
+			return retval;
 		}
-		
-		//Utility functions for creating/destroying objects.
-		template<typename item_type>
-		item_type* check_for_destruction(item_type* dtype)
+
+		//Checkpoint the allocator.  Everything allocated after the mark can be released
+		//with rewind.
+		slab_allocator_mark mark() const
 		{
-			slab_alloc_destruct_traits<item_type>::add_to_destruct_list(dtype, _destruct_list);
-			return dtype;
+			slab_allocator_mark retval;
+			retval._slab_count = _allocations.size();
+			retval._freesize = _freesize;
+			retval._large_count = _large_allocations.size();
+			retval._destruct_head = _destruct_head;
+			return retval;
+		}
+
+		//Destroy (newest first) every object constructed after the mark and give back
+		//the memory allocated after it.  Marks taken after this one become invalid.
+		void rewind( const slab_allocator_mark& checkpoint )
+		{
+			destruct_until( checkpoint._destruct_head );
+			while( _large_allocations.size() > checkpoint._large_count )
+			{
+				_allocator->deallocate( _large_allocations.back() );
+				_large_allocations.pop_back();
+			}
+			while( _allocations.size() > checkpoint._slab_count )
+			{
+				_allocator->deallocate( _allocations.back() );
+				_allocations.pop_back();
+			}
+			_freesize = checkpoint._freesize;
 		}
 
 		template<typename item_type>
 		item_type* construct()
 		{
-			item_type* retval = reinterpret_cast<item_type*>( allocate(sizeof(item_type), sizeof(void*), CCLJ_IMMEDIATE_FILE_INFO() ) );
-			return check_for_destruction( new(retval) item_type() );
+			return track_destruction( new (allocate_item<item_type>()) item_type() );
 		}
 		
 		//constructors overloaded for up to 4 args
 		template<typename item_type, typename a0>
 		item_type* construct(const a0& arg)
 		{
-			item_type* retval = reinterpret_cast<item_type*>( allocate(sizeof(item_type), sizeof(void*), CCLJ_IMMEDIATE_FILE_INFO() ) );
-			return check_for_destruction(new (retval)item_type(arg) );
+			return track_destruction( new (allocate_item<item_type>()) item_type(arg) );
 		}
 
 		template<typename item_type, typename a0, typename a1>
 		item_type* construct(const a0& arg0, const a1& arg1)
 		{
-			item_type* retval = reinterpret_cast<item_type*>( allocate(sizeof(item_type), sizeof(void*), CCLJ_IMMEDIATE_FILE_INFO() ) );
-			return check_for_destruction(new (retval)item_type(arg0, arg1) );
+			return track_destruction( new (allocate_item<item_type>()) item_type(arg0, arg1) );
 		}
 		
 		template<typename item_type, typename a0, typename a1, typename a2>
 		item_type* construct(const a0& arg0, const a1& arg1, const a2& arg2)
 		{
-			item_type* retval = reinterpret_cast<item_type*>( allocate(sizeof(item_type), sizeof(void*), CCLJ_IMMEDIATE_FILE_INFO() ) );
-			return check_for_destruction(new (retval)item_type(arg0, arg1, arg2) );
+			return track_destruction( new (allocate_item<item_type>()) item_type(arg0, arg1, arg2) );
 		}
 		
 		template<typename item_type, typename a0, typename a1, typename a2, typename a3>
 		item_type* construct(const a0& arg0, const a1& arg1, const a2& arg2, const a3& arg3)
 		{
-			item_type* retval = reinterpret_cast<item_type*>( allocate(sizeof(item_type), sizeof(void*), CCLJ_IMMEDIATE_FILE_INFO() ) );
-			return check_for_destruction( new (retval)item_type(arg0, arg1, arg2, arg3) );
+			return track_destruction( new (allocate_item<item_type>()) item_type(arg0, arg1, arg2, arg3) );
 		}
 	};
 
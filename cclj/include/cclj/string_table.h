@@ -42,6 +42,13 @@ namespace cclj
 
 		bool empty() const { return data == nullptr || *data == 0; }
 
+		//Table strings are stored with their length directly in front of the characters.
+		size_t size() const
+		{
+			if ( empty() ) return 0;
+			return *( reinterpret_cast<const uint32_t*>( data ) - 1 );
+		}
+
 		bool operator==( const string_table_str& other )
 		{
 			return data == other.data;
@@ -52,7 +59,8 @@ namespace cclj
 			return data != other.data;
 		}
 
-		//called if you already have a registered string.
+		//called if you already have a registered string.  The pointer must have come from
+		//a string table (or be empty) so that size() works.
 		static string_table_str unsafe_create_string_table_str( const char* table_str )
 		{
 			string_table_str retval;
@@ -61,17 +69,66 @@ namespace cclj
 		}
 	};
 
+	//Names the compiler compares against constantly.  They are interned once when the
+	//table is created so hot paths compare pointers instead of registering strings.
+	struct well_known_symbols
+	{
+		string_table_str _ptr;
+		string_table_str _gcptr;
+		string_table_str _void;
+		string_table_str _tuple;
+		string_table_str _unqual;
+		string_table_str _fn;
+		string_table_str _quote;
+		string_table_str _unquote;
+		string_table_str _scope_value;
+		string_table_str _lhs;
+		string_table_str _rhs;
+		//One per base numeric type (CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES).
+		string_table_str _f32;
+		string_table_str _f64;
+		string_table_str _i1;
+		string_table_str _i8;
+		string_table_str _u8;
+		string_table_str _i16;
+		string_table_str _u16;
+		string_table_str _i32;
+		string_table_str _u32;
+		string_table_str _i64;
+		string_table_str _u64;
+
+		void initialize( string_table& table );
+	};
+
 	class string_table
 	{
 	protected:
+		well_known_symbols _well_known;
 		virtual ~string_table(){}
 	public:
-		virtual string_table_str register_str( const char* data ) = 0;
-		string_table_str register_str( const string& data ) { return register_str( data.c_str() ); }
+		//Register a span of characters.  The data does not need to be null terminated so
+		//callers (the reader) can register tokens directly out of their source buffer.
+		virtual string_table_str register_str( const char* data, size_t len ) = 0;
+		string_table_str register_str( const char* data ) 
+		{ 
+			if ( is_trivial( data ) ) return string_table_str();
+			return register_str( data, strlen( data ) ); 
+		}
+		string_table_str register_str( const string& data ) { return register_str( data.c_str(), data.size() ); }
+
+		const well_known_symbols& well_known() const { return _well_known; }
 
 		friend class shared_ptr<string_table>;
 
 		static shared_ptr<string_table> create();
+
+		//Serialize all access to the wrapped table with a mutex.
+		static shared_ptr<string_table> create_synchronized( shared_ptr<string_table> table );
+
+		//Single threaded front end that remembers strings already registered with the
+		//backing table so repeated registrations do not touch it.  Strings returned are
+		//the backing table's strings.
+		static shared_ptr<string_table> create_cache( shared_ptr<string_table> backing );
 	};
 
 	typedef shared_ptr<string_table> string_table_ptr;
@@ -0,0 +1,45 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#ifndef CCLJ_THREAD_EXIT_SLOT_H
+#define CCLJ_THREAD_EXIT_SLOT_H
+#pragma once
+#include "cclj/cclj.h"
+
+//Visual Studio 2013 has no thread_local, and neither keyword runs constructors or
+//destructors, so only use this for plain pointers and flags.
+#ifdef _WIN32
+#define CCLJ_THREAD_LOCAL __declspec(thread)
+#define CCLJ_THREAD_EXIT_CALL __stdcall
+#else
+#define CCLJ_THREAD_LOCAL __thread
+#define CCLJ_THREAD_EXIT_CALL
+#endif
+
+namespace cclj {
+
+	//Hands each thread's value to _on_exit when that thread exits; the cleanup half of
+	//per thread state kept in a CCLJ_THREAD_LOCAL pointer.  Fiber local storage on windows,
+	//a pthread key elsewhere.  Threads still running when the process exits, the main
+	//thread included, may never be called back.
+	//
+	//An aggregate so slots at namespace scope are ready before any constructor runs:
+	//	thread_exit_slot g_slot = { &release_state };
+	struct thread_exit_slot
+	{
+		typedef void (CCLJ_THREAD_EXIT_CALL *exit_fn)( void* value );
+
+		exit_fn					_on_exit;
+		//The platform key plus one, zero until the first set.
+		std::atomic<uintptr_t>	_key;
+
+		//value must not be null.
+		void set( void* value );
+	};
+}
+
+#endif
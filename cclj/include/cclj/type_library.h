@@ -101,6 +101,22 @@ CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
 	template<> struct numeric_type_to_c_type_map<base_numeric_types::u64> { typedef uint64_t numeric_type; };
 
 
+	struct type_kinds
+	{
+		enum _enum
+		{
+			datatype = 0,
+			base_numeric,
+			pointer,
+			tuple,
+			fn,
+			void_type,
+			unqual,
+			//gcptr[type]; points at memory the garbage collector owns.
+			managed_pointer,
+		};
+	};
+
 	class type_ref;
 	typedef type_ref* type_ref_ptr;
 	typedef data_buffer<type_ref_ptr> type_ref_ptr_buffer;
@@ -109,6 +125,15 @@ CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
 	public:
 		string_table_str			_name;
 		type_ref_ptr_buffer			_specializations;
+		//Classification assigned once by the type library when the type is created.
+		type_kinds::_enum			_kind;
+		base_numeric_types::_enum	_base_numeric_type;
+
+		type_ref() 
+			: _kind( type_kinds::datatype )
+			, _base_numeric_type( base_numeric_types::no_known_type ) 
+		{
+		}
 		string to_string();
 	};
 
@@ -121,6 +146,9 @@ CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
 
 		virtual string_table_ptr string_table() = 0;
 
+		//Same as string_table()->well_known() without copying the table pointer.
+		virtual const well_known_symbols& well_known() = 0;
+
 		//type system ensures the type refs are pointer-comparable.
 		virtual type_ref& get_type_ref( string_table_str name
 									, type_ref_ptr_buffer _specializations = type_ref_ptr_buffer() ) = 0;
@@ -134,25 +162,32 @@ CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
 		{
 			type_ref* type_ptr( &type );
 			type_ref_ptr_buffer specs( &type_ptr, 1 );
-			return get_type_ref( "ptr", specs );
+			return get_type_ref( well_known()._ptr, specs );
 		}
 
 		//void ptr
 		type_ref& get_unqual_ptr_type()
 		{
-			return get_ptr_type( get_type_ref( "unqual" ) );
+			return get_ptr_type( get_type_ref( well_known()._unqual ) );
 		}
 
 		type_ref& get_ptr_type( base_numeric_types::_enum type )
 		{
 			type_ref* num_type = &get_type_ref( type );
 			type_ref_ptr_buffer specs( &num_type, 1 );
-			return get_type_ref( "ptr", specs );
+			return get_type_ref( well_known()._ptr, specs );
+		}
+
+		type_ref& get_managed_ptr_type( type_ref& type )
+		{
+			type_ref* type_ptr( &type );
+			type_ref_ptr_buffer specs( &type_ptr, 1 );
+			return get_type_ref( well_known()._gcptr, specs );
 		}
 
 		type_ref& deref_ptr_type( type_ref& src_type )
 		{
-			if ( src_type._name == string_table()->register_str( "ptr" ) 
+			if ( ( src_type._kind == type_kinds::pointer || src_type._kind == type_kinds::managed_pointer )
 				&& src_type._specializations[0] )
 				return *src_type._specializations[0];
 			throw runtime_error( "invalid ptr deref" );
@@ -160,30 +195,34 @@ CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
 
 		bool is_pointer_type( type_ref& type )
 		{
-			return ( type._name == string_table()->register_str( "ptr" )
-					&& type._specializations.size() == 1);
+			return type._kind == type_kinds::pointer;
+		}
+
+		bool is_managed_pointer_type( const type_ref& type )
+		{
+			return type._kind == type_kinds::managed_pointer;
 		}
 
 		bool is_tuple_type(type_ref& type)
 		{
-			return (type._name == string_table()->register_str("tuple"));
+			return type._kind == type_kinds::tuple;
 		}
 
 		bool is_void_type(const type_ref& type)
 		{
-			return &type == &get_void_type();
+			return type._kind == type_kinds::void_type;
 		}
 
 		type_ref& get_void_type()
 		{
-			return get_type_ref( "void" );
+			return get_type_ref( well_known()._void );
 		}
 
 		type_ref& get_type_ref( base_numeric_types::_enum type )
 		{
 			switch( type )
 			{
-#define CCLJ_HANDLE_LIST_NUMERIC_TYPE( name ) case base_numeric_types::name: return get_type_ref( #name );
+#define CCLJ_HANDLE_LIST_NUMERIC_TYPE( name ) case base_numeric_types::name: return get_type_ref( well_known()._##name );
 CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
 #undef CCLJ_HANDLE_LIST_NUMERIC_TYPE
 			default: break;
@@ -195,14 +234,7 @@ CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
 
 		base_numeric_types::_enum to_base_numeric_type( const type_ref& dtype )
 		{
-			if ( dtype._specializations.size() )
-				return base_numeric_types::no_known_type;
-#define CCLJ_HANDLE_LIST_NUMERIC_TYPE(name) \
-			if ( dtype._name == string_table()->register_str( #name ) ) \
-				return base_numeric_types::name;
-				CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
-#undef CCLJ_HANDLE_LIST_NUMERIC_TYPE
-			return base_numeric_types::no_known_type;
+			return dtype._base_numeric_type;
 		}
 
 		static shared_ptr<type_library> create_type_library( allocator_ptr allocator, string_table_ptr str_table );
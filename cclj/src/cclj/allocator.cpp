@@ -9,6 +9,10 @@
 #include "cclj/allocator.h"
 #include "cclj/variant.h"
 #include "cclj/algo_util.h"
+#include "cclj/noncopyable.h"
+#include "cclj/thread_exit_slot.h"
+#include <mutex>
+#include <iostream>
 
 using namespace cclj;
 
@@ -96,7 +100,494 @@ namespace {
 	};
 }
 
+namespace {
+
+	//Sits directly in front of every pointer handed out by the size class allocators.
+	struct size_class_header
+	{
+		uint64_t	alloc_size;
+		uint16_t	magic;
+		//index of the thread cache that owns the chunk (thread caching allocator only).
+		uint16_t	owner;
+		uint8_t		alignment;
+		uint8_t		size_class;
+		//bytes from the start of the chunk (or the malloc'd block) to the user pointer.
+		uint8_t		offset;
+		uint8_t		flags;
+	};
+
+	static_assert( sizeof( size_class_header ) == 16, "size class header must stay 16 bytes" );
+
+	struct size_class_flags
+	{
+		enum _enum
+		{
+			live = 1,
+			sampled = 1 << 1,
+		};
+	};
+
+	//Free chunks are linked through their first bytes.
+	struct free_chunk
+	{
+		free_chunk* next;
+		uint32_t	size_class;
+	};
+
+	struct size_classes
+	{
+		enum
+		{
+			header_size = sizeof( size_class_header ),
+			header_magic = 0xa10c,
+			//16 byte classes up to 256 bytes then powers of two up to 32k
+			small_class_count = 16,
+			class_count = small_class_count + 7,
+			large_class = 0xff,
+			min_page_size = 64 * 1024,
+		};
+
+		static uint32_t class_index( size_t chunk_size )
+		{
+			if ( chunk_size <= 256 )
+				return static_cast<uint32_t>( ( chunk_size - 1 ) / 16 );
+			uint32_t retval = small_class_count;
+			for ( size_t class_size = 512; class_size < chunk_size; class_size <<= 1 )
+			{
+				++retval;
+				if ( retval == class_count ) return large_class;
+			}
+			return retval;
+		}
+
+		static size_t class_size( uint32_t idx )
+		{
+			if ( idx < small_class_count ) return ( idx + 1 ) * 16;
+			return static_cast<size_t>( 512 ) << ( idx - small_class_count );
+		}
+
+		//Chunk size needed for the allocation.  Chunks are 16 byte aligned so the user
+		//pointer is too; bigger alignments need room to slide the pointer forward.
+		static size_t chunk_size_for( size_t size, uint8_t alignment )
+		{
+			size_t retval = header_size + size;
+			if ( alignment > 16 )
+				retval += alignment - 16;
+			return retval;
+		}
+
+		//Malloc a page, keep it in pages and push all but the first chunk onto the free
+		//list.  Returns the first chunk.
+		static uint8_t* carve_page( uint32_t idx, free_chunk*& free_list, vector<void*>& pages )
+		{
+			size_t chunk_size = class_size( idx );
+			size_t page_size = std::max( static_cast<size_t>( min_page_size ), chunk_size * 8 );
+			uint8_t* page = reinterpret_cast<uint8_t*>( malloc( page_size + 15 ) );
+			if ( page == nullptr ) throw std::bad_alloc();
+			pages.push_back( page );
+			uint8_t* chunk = reinterpret_cast<uint8_t*>( align_number( reinterpret_cast<size_t>( page ), 16 ) );
+			size_t chunk_count = page_size / chunk_size;
+			for ( size_t chunk_idx = chunk_count - 1; chunk_idx > 0; --chunk_idx )
+			{
+				free_chunk* item = reinterpret_cast<free_chunk*>( chunk + chunk_idx * chunk_size );
+				item->next = free_list;
+				free_list = item;
+			}
+			return chunk;
+		}
+
+		static uint8_t* allocate_large( size_t chunk_size )
+		{
+			uint8_t* retval = reinterpret_cast<uint8_t*>( malloc( chunk_size + 15 ) );
+			if ( retval == nullptr ) throw std::bad_alloc();
+			return retval;
+		}
+
+		//Place the header and return the user pointer for a chunk.
+		static uint8_t* initialize_chunk( uint8_t* chunk, uint32_t idx, size_t size, uint8_t alignment, uint16_t owner )
+		{
+			uint8_t* user_ptr = reinterpret_cast<uint8_t*>( align_number( reinterpret_cast<size_t>( chunk ), 16 ) ) + header_size;
+			if ( alignment > 16 )
+				user_ptr = reinterpret_cast<uint8_t*>( align_number( reinterpret_cast<size_t>( user_ptr ), alignment ) );
+			size_class_header* header = get_header( user_ptr );
+			header->alloc_size = size;
+			header->magic = header_magic;
+			header->owner = owner;
+			header->alignment = alignment;
+			header->size_class = static_cast<uint8_t>( idx );
+			header->offset = static_cast<uint8_t>( user_ptr - chunk );
+			header->flags = size_class_flags::live;
+			return user_ptr;
+		}
+
+		static size_class_header* get_header( void* user_ptr )
+		{
+			return reinterpret_cast<size_class_header*>( reinterpret_cast<uint8_t*>( user_ptr ) - header_size );
+		}
+
+		static bool is_live( size_class_header* header )
+		{
+			return header->magic == header_magic && ( header->flags & size_class_flags::live );
+		}
+
+		static alloc_info get_alloc_info( void* ptr )
+		{
+			if ( ptr == nullptr ) return alloc_info();
+			size_class_header* header = get_header( ptr );
+			return alloc_info( static_cast<size_t>( header->alloc_size ), header->alignment );
+		}
+
+		//Marks the allocation dead and returns its chunk.  Large chunks are freed
+		//immediately and nullptr is returned.
+		static free_chunk* release( void* memory )
+		{
+			size_class_header* header = get_header( memory );
+			if ( !is_live( header ) )
+				throw std::runtime_error( "deallocating memory that was not allocated" );
+			header->flags = 0;
+			uint32_t idx = header->size_class;
+			uint8_t* chunk = reinterpret_cast<uint8_t*>( memory ) - header->offset;
+			if ( idx == large_class )
+			{
+				free( chunk );
+				return nullptr;
+			}
+			free_chunk* retval = reinterpret_cast<free_chunk*>( chunk );
+			retval->size_class = idx;
+			return retval;
+		}
+	};
+
+	struct fast_alloc : public allocator
+	{
+		free_chunk*				_free_lists[size_classes::class_count];
+		vector<void*>			_pages;
+		uint32_t				_sample_rate;
+		uint32_t				_until_sample;
+		ptr_to_info_map			_sampled;
+
+		fast_alloc( uint32_t sample_rate )
+			: _sample_rate( sample_rate )
+			, _until_sample( sample_rate )
+		{
+			memset( _free_lists, 0, sizeof( _free_lists ) );
+		}
+
+		//Sampled allocations still outstanding are reported as leaks along with where they
+		//were allocated.
+		~fast_alloc()
+		{
+			for_each( _sampled.begin(), _sampled.end(), []( const pair<void* const, file_info>& entry )
+			{
+				std::cerr << "allocator detected memory leak: " << size_classes::get_header( entry.first )->alloc_size
+					<< " bytes allocated at " << entry.second.file << "(" << entry.second.line << ")" << std::endl;
+			} );
+			for_each( _pages.begin(), _pages.end(), []( void* page ) { free( page ); } );
+		}
+
+		virtual uint8_t* allocate( size_t size, uint8_t alignment, file_info location )
+		{
+			if ( !size ) return nullptr;
+			size_t chunk_size = size_classes::chunk_size_for( size, alignment );
+			uint32_t idx = size_classes::class_index( chunk_size );
+			uint8_t* chunk;
+			if ( idx == size_classes::large_class )
+				chunk = size_classes::allocate_large( chunk_size );
+			else if ( _free_lists[idx] )
+			{
+				chunk = reinterpret_cast<uint8_t*>( _free_lists[idx] );
+				_free_lists[idx] = _free_lists[idx]->next;
+			}
+			else
+				chunk = size_classes::carve_page( idx, _free_lists[idx], _pages );
+
+			uint8_t* user_ptr = size_classes::initialize_chunk( chunk, idx, size, alignment, 0 );
+			if ( _sample_rate && --_until_sample == 0 )
+			{
+				_until_sample = _sample_rate;
+				size_classes::get_header( user_ptr )->flags |= size_class_flags::sampled;
+				_sampled.insert( make_pair( user_ptr, location ) );
+			}
+			return user_ptr;
+		}
+
+		virtual alloc_info get_alloc_info( void* ptr ) { return size_classes::get_alloc_info( ptr ); }
+
+		virtual void deallocate( void* memory )
+		{
+			if ( !memory ) return;
+			if ( size_classes::get_header( memory )->flags & size_class_flags::sampled )
+				_sampled.erase( memory );
+			free_chunk* item = size_classes::release( memory );
+			if ( item )
+			{
+				item->next = _free_lists[item->size_class];
+				_free_lists[item->size_class] = item;
+			}
+		}
+
+		virtual bool check_ptr( void* ptr )
+		{
+			if ( ptr == nullptr ) return false;
+			size_class_header* header = size_classes::get_header( ptr );
+			if ( !size_classes::is_live( header ) )
+				return false;
+			if ( header->flags & size_class_flags::sampled )
+				return _sampled.find( ptr ) != _sampled.end();
+			return true;
+		}
+	};
+
+	//One per thread using a thread caching allocator.  Only the thread that claimed the
+	//cache touches _free_lists and _pages; other threads hand chunks back through
+	//_remote_frees.
+	struct thread_cache : noncopyable
+	{
+		free_chunk*				_free_lists[size_classes::class_count];
+		std::atomic<free_chunk*> _remote_frees;
+		vector<void*>			_pages;
+		uint16_t				_index;
+		bool					_claimed;
+
+		thread_cache( uint16_t index )
+			: _remote_frees( nullptr )
+			, _index( index )
+			, _claimed( false )
+		{
+			memset( _free_lists, 0, sizeof( _free_lists ) );
+		}
+
+		~thread_cache()
+		{
+			for_each( _pages.begin(), _pages.end(), []( void* page ) { free( page ); } );
+		}
+
+		void push_remote( free_chunk* item )
+		{
+			free_chunk* head = _remote_frees.load( std::memory_order_relaxed );
+			do
+			{
+				item->next = head;
+			} while( !_remote_frees.compare_exchange_weak( head, item, std::memory_order_release, std::memory_order_relaxed ) );
+		}
+
+		//Move everything other threads freed back onto the local lists.
+		void drain_remote()
+		{
+			free_chunk* item = _remote_frees.exchange( nullptr, std::memory_order_acquire );
+			while( item )
+			{
+				free_chunk* next = item->next;
+				item->next = _free_lists[item->size_class];
+				_free_lists[item->size_class] = item;
+				item = next;
+			}
+		}
+
+		uint8_t* allocate_chunk( uint32_t idx )
+		{
+			if ( _free_lists[idx] == nullptr )
+				drain_remote();
+			free_chunk* retval = _free_lists[idx];
+			if ( retval )
+			{
+				_free_lists[idx] = retval->next;
+				return reinterpret_cast<uint8_t*>( retval );
+			}
+			return size_classes::carve_page( idx, _free_lists[idx], _pages );
+		}
+	};
+
+	//State shared between a thread caching allocator and the threads that have a cache
+	//claimed from it.  Threads keep it alive until they exit or notice it was closed.
+	struct thread_cache_heap : noncopyable
+	{
+		enum { max_caches = 1024 };
+
+		std::mutex					_mutex;
+		std::atomic<thread_cache*>	_caches[max_caches];
+		uint32_t					_cache_count;
+		std::atomic<bool>			_closed;
+
+		thread_cache_heap()
+			: _cache_count( 0 )
+			, _closed( false )
+		{
+			for ( size_t idx = 0; idx < max_caches; ++idx )
+				_caches[idx].store( nullptr, std::memory_order_relaxed );
+		}
+
+		~thread_cache_heap()
+		{
+			for ( size_t idx = 0; idx < _cache_count; ++idx )
+				delete _caches[idx].load();
+		}
+
+		//Reuse a cache left behind by an exited thread if there is one.
+		thread_cache* claim()
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			for ( size_t idx = 0; idx < _cache_count; ++idx )
+			{
+				thread_cache* cache = _caches[idx].load( std::memory_order_relaxed );
+				if ( !cache->_claimed )
+				{
+					cache->_claimed = true;
+					return cache;
+				}
+			}
+			if ( _cache_count == max_caches )
+				throw runtime_error( "too many threads using the allocator" );
+			thread_cache* retval = new thread_cache( static_cast<uint16_t>( _cache_count ) );
+			retval->_claimed = true;
+			_caches[_cache_count].store( retval, std::memory_order_release );
+			++_cache_count;
+			return retval;
+		}
+
+		void unclaim( thread_cache* cache )
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			cache->_claimed = false;
+		}
+
+		thread_cache* get_cache( uint16_t index ) { return _caches[index].load( std::memory_order_acquire ); }
+	};
+
+	typedef shared_ptr<thread_cache_heap> thread_cache_heap_ptr;
+
+	//The caches the current thread has claimed, one per live allocator it has used.
+	struct thread_cache_bindings
+	{
+		vector<pair<thread_cache_heap_ptr, thread_cache*> > _bindings;
+
+		~thread_cache_bindings()
+		{
+			for_each( _bindings.begin(), _bindings.end(), []( pair<thread_cache_heap_ptr, thread_cache*>& binding )
+			{
+				binding.first->unclaim( binding.second );
+			} );
+		}
+
+		thread_cache& find_cache( const thread_cache_heap_ptr& heap )
+		{
+			for ( size_t idx = 0, end = _bindings.size(); idx < end; ++idx )
+			{
+				if ( _bindings[idx].first == heap )
+					return *_bindings[idx].second;
+			}
+			//Drop heaps whose allocator has gone away so their memory is released.
+			_bindings.erase( remove_if( _bindings.begin(), _bindings.end(), []( pair<thread_cache_heap_ptr, thread_cache*>& binding )
+			{
+				return binding.first->_closed.load();
+			} ), _bindings.end() );
+			thread_cache* retval = heap->claim();
+			_bindings.push_back( make_pair( heap, retval ) );
+			return *retval;
+		}
+	};
+
+	CCLJ_THREAD_LOCAL thread_cache_bindings* g_thread_cache_bindings = nullptr;
+	//Set once the current thread's bindings have been released.  Other exit callbacks may
+	//still free memory on the thread after that.
+	CCLJ_THREAD_LOCAL bool g_thread_cache_bindings_released = false;
+
+	void CCLJ_THREAD_EXIT_CALL release_thread_cache_bindings( void* value )
+	{
+		g_thread_cache_bindings = nullptr;
+		g_thread_cache_bindings_released = true;
+		delete static_cast<thread_cache_bindings*>( value );
+	}
+
+	thread_exit_slot g_thread_cache_bindings_exit = { &release_thread_cache_bindings };
+
+	thread_cache_bindings& current_thread_cache_bindings()
+	{
+		if ( g_thread_cache_bindings == nullptr )
+		{
+			g_thread_cache_bindings = new thread_cache_bindings();
+			g_thread_cache_bindings_exit.set( g_thread_cache_bindings );
+		}
+		return *g_thread_cache_bindings;
+	}
+
+	struct thread_caching_alloc : public allocator
+	{
+		thread_cache_heap_ptr	_heap;
+
+		thread_caching_alloc() : _heap( make_shared<thread_cache_heap>() ) {}
+		~thread_caching_alloc() { _heap->_closed.store( true ); }
+
+		thread_cache& current_cache()
+		{
+			//Most threads only ever use one allocator.
+			thread_cache_bindings& thread_bindings( current_thread_cache_bindings() );
+			vector<pair<thread_cache_heap_ptr, thread_cache*> >& bindings( thread_bindings._bindings );
+			if ( !bindings.empty() && bindings.front().first == _heap )
+				return *bindings.front().second;
+			return thread_bindings.find_cache( _heap );
+		}
+
+		virtual uint8_t* allocate( size_t size, uint8_t alignment, file_info )
+		{
+			if ( !size ) return nullptr;
+			size_t chunk_size = size_classes::chunk_size_for( size, alignment );
+			uint32_t idx = size_classes::class_index( chunk_size );
+			if ( idx == size_classes::large_class )
+				return size_classes::initialize_chunk( size_classes::allocate_large( chunk_size ), idx, size, alignment, 0 );
+			if ( g_thread_cache_bindings_released )
+			{
+				//Borrow a cache for just this chunk; frees of it go back through the remote list.
+				thread_cache* cache = _heap->claim();
+				uint8_t* retval = size_classes::initialize_chunk( cache->allocate_chunk( idx ), idx, size, alignment, cache->_index );
+				_heap->unclaim( cache );
+				return retval;
+			}
+			thread_cache& cache( current_cache() );
+			return size_classes::initialize_chunk( cache.allocate_chunk( idx ), idx, size, alignment, cache._index );
+		}
+
+		virtual alloc_info get_alloc_info( void* ptr ) { return size_classes::get_alloc_info( ptr ); }
+
+		virtual void deallocate( void* memory )
+		{
+			if ( !memory ) return;
+			uint16_t owner = size_classes::get_header( memory )->owner;
+			free_chunk* item = size_classes::release( memory );
+			if ( item == nullptr ) return;
+			if ( g_thread_cache_bindings_released )
+			{
+				_heap->get_cache( owner )->push_remote( item );
+				return;
+			}
+			thread_cache& cache( current_cache() );
+			if ( cache._index == owner )
+			{
+				item->next = cache._free_lists[item->size_class];
+				cache._free_lists[item->size_class] = item;
+			}
+			else
+				_heap->get_cache( owner )->push_remote( item );
+		}
+
+		virtual bool check_ptr( void* ptr )
+		{
+			return ptr != nullptr && size_classes::is_live( size_classes::get_header( ptr ) );
+		}
+	};
+}
+
 allocator_ptr allocator::create_checking_allocator()
 {
 	return make_shared<tracking_alloc>();
+}
+
+allocator_ptr allocator::create_fast_allocator( uint32_t sample_rate )
+{
+	return make_shared<fast_alloc>( sample_rate );
+}
+
+allocator_ptr allocator::create_thread_caching_allocator()
+{
+	return make_shared<thread_caching_alloc>();
 }
\ No newline at end of file
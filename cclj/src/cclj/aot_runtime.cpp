@@ -0,0 +1,36 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+//The symbols code from compiler::compile_to_file links against.  Build this with
+//runtime.cpp, allocator.cpp and garbage_collector.cpp; none of them need llvm.
+#include "precompile.h"
+#include "cclj/runtime.h"
+
+using namespace cclj;
+
+extern "C"
+{
+	gc_shadow_frame* cclj_gc_shadow_stack = nullptr;
+
+	//Compiled code passes this object's address as rt.
+	runtime cclj_rt( allocator::create_thread_caching_allocator(), 8 * 1024 * 1024, &cclj_gc_shadow_stack );
+
+	void* cclj_malloc( void* rt, uint32_t size, uint8_t alignment )
+	{
+		return runtime::rt_malloc( rt, size, alignment );
+	}
+
+	void cclj_free( void* rt, void* data )
+	{
+		runtime::rt_free( rt, data );
+	}
+
+	void* cclj_gc_alloc( void* rt, uint32_t size )
+	{
+		return runtime::rt_gc_alloc( rt, size );
+	}
+}
@@ -50,17 +50,27 @@ namespace
 			for (auto iter = children().begin(), end = children().end(); iter != end; ++iter)
 			{
 				ast_node& node(*iter);
-				auto pass_result = node.compile_second_pass(context).first;
-				if (pass_result)
-					fn_args.push_back(pass_result.get());
+				auto pass_result = node.compile_second_pass(context);
+				if (pass_result.first)
+				{
+					fn_args.push_back(pass_result.first.get());
+					//Later arguments may allocate, so managed ones need a root until the call.
+					if (node.next_node() && context._type_library->is_managed_pointer_type(*pass_result.second))
+						context._builder.CreateStore(pass_result.first.get(), &context.create_gc_root(*pass_result.second));
+				}
 			}
 
 			type_ref& rettype = _function->return_type();
 			const char* twine = "calltmp";
-			bool is_void = &rettype == &context._type_library->get_void_type();
+			bool is_void = context._type_library->is_void_type(rettype);
 			if (is_void)
 				twine = "";
-			Value* retval = context._builder.CreateCall(&_function->llvm(), fn_args, twine);
+			intrinsic_fn intrinsic = _function->get_function_intrinsic_body();
+			Value* retval = nullptr;
+			if (intrinsic)
+				retval = intrinsic(context, fn_args);
+			else
+				retval = context._builder.CreateCall(&context.module_function(*_function), fn_args, twine);
 			if (is_void)
 				retval = nullptr;
 			return make_pair(retval
@@ -119,7 +129,7 @@ namespace
 vector<string> base_language_plugins::split_symbol(symbol& sym)
 {
 	vector<string> retval;
-	string temp(sym._name.c_str());
+	string temp(sym._name.c_str(), sym._name.size());
 	size_t last_offset = 0;
 	for (size_t off = temp.find('.'); off != string::npos;
 		off = temp.find('.', off + 1))
@@ -187,31 +197,12 @@ ast_node& base_language_plugins::type_check_symbol(reader_context& context, lisp
 
 namespace
 {
-	template<typename num_type>
-	struct str_to_num
-	{
-	};
-
 	//Lots of things to do here.  First would be to allow compile time expressions as constants and not just numbers.
-	//Second would be to allow number of different bases
-	//third would be to have careful checking of ranges.
-	template<> struct str_to_num<bool> { static bool parse(const string& val) { return std::stol(val) ? true : false; } };
-	template<> struct str_to_num<uint8_t> { static uint8_t parse(const string& val) { return static_cast<uint8_t>(std::stol(val)); } };
-	template<> struct str_to_num<int8_t> { static int8_t parse(const string& val) { return static_cast<int8_t>(std::stol(val)); } };
-	template<> struct str_to_num<uint16_t> { static uint16_t parse(const string& val) { return static_cast<uint16_t>(std::stol(val)); } };
-	template<> struct str_to_num<int16_t> { static int16_t parse(const string& val) { return static_cast<int16_t>(std::stol(val)); } };
-	template<> struct str_to_num<uint32_t> { static uint32_t parse(const string& val) { return static_cast<uint32_t>(std::stoll(val)); } };
-	template<> struct str_to_num<int32_t> { static int32_t parse(const string& val) { return static_cast<int32_t>(std::stoll(val)); } };
-	template<> struct str_to_num<uint64_t> { static uint64_t parse(const string& val) { return static_cast<uint64_t>(std::stoll(val)); } };
-	template<> struct str_to_num<int64_t> { static int64_t parse(const string& val) { return static_cast<int64_t>(std::stoll(val)); } };
-	template<> struct str_to_num<float> { static float parse(const string& val) { return static_cast<float>(std::stof(val)); } };
-	template<> struct str_to_num<double> { static double parse(const string& val) { return static_cast<double>(std::stod(val)); } };
-
-
+	//Second would be to have careful checking of ranges.
 	template<typename number_type>
-	uint8_t* parse_constant_value(reader_context& context, const std::string& val)
+	uint8_t* parse_constant_value(reader_context& context, const numeric_literal& val)
 	{
-		number_type parse_val = str_to_num<number_type>::parse(val);
+		number_type parse_val = val.cast<number_type>();
 		uint8_t* retval = context._factory->allocate_data(sizeof(number_type), sizeof(number_type));
 		memcpy(retval, &parse_val, sizeof(number_type));
 		return retval;
@@ -273,12 +264,12 @@ ast_node& base_language_plugins::type_check_numeric_constant(reader_context& con
 {
 	constant& cell_constant = cell;
 	type_ref_ptr constant_type = nullptr;
-	string number_string(cell_constant._unparsed_number.c_str());
+	const numeric_literal& number_value(cell_constant._value);
 	if (cell_constant._unevaled_type)
 		constant_type = &context._type_evaluator(*cell_constant._unevaled_type);
 	else
 	{
-		if (number_string.find('.'))
+		if (number_value.is_floating())
 			constant_type = &context._type_library->get_type_ref(base_numeric_types::f64);
 		else
 			constant_type = &context._type_library->get_type_ref(base_numeric_types::i64);
@@ -289,7 +280,7 @@ ast_node& base_language_plugins::type_check_numeric_constant(reader_context& con
 #define CCLJ_HANDLE_LIST_NUMERIC_TYPE( name )	\
 	case base_numeric_types::name:	\
 	num_value			\
-	= parse_constant_value<numeric_type_to_c_type_map<base_numeric_types::name>::numeric_type>(context, number_string);	\
+	= parse_constant_value<numeric_type_to_c_type_map<base_numeric_types::name>::numeric_type>(context, number_value);	\
 	break;
 		CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
 #undef CCLJ_HANDLE_LIST_NUMERIC_TYPE
@@ -351,17 +342,6 @@ namespace
 {
 	typedef function<llvm::Value* (IRBuilder<>& builder, llvm_value_ptr lhs, llvm_value_ptr rhs)> binary_fn_implementation;
 
-	pair<llvm_value_ptr_opt, type_ref_ptr> implement_binary_function(compiler_context& ctx, const binary_fn_implementation& impl, type_ref& rettype)
-	{
-		variable_lookup_chain chain;
-		chain.name = ctx._name_table->register_name("lhs");
-		llvm_value_ptr lhs = ctx._module->load_variable(ctx, chain).first;
-		chain.name = ctx._name_table->register_name("rhs");
-		llvm_value_ptr rhs = ctx._module->load_variable(ctx, chain).first;
-		llvm_value_ptr retval = impl(ctx._builder, lhs, rhs);
-		return make_pair(retval, &rettype);
-	}
-
 	void register_binary_function(module_ptr module
 									, const char* name
 									, qualified_name_table_ptr name_table
@@ -371,17 +351,16 @@ namespace
 									, const binary_fn_implementation& impl)
 	{
 		auto str_table = name_table->string_table();
-		auto lhs_name = str_table->register_str("lhs");
-		auto rhs_name = str_table->register_str("rhs");
+		auto lhs_name = str_table->well_known()._lhs;
+		auto rhs_name = str_table->well_known()._rhs;
 		named_type arg_names[] = { named_type(lhs_name, &lhs_type), named_type(rhs_name, &rhs_type) };
 		named_type_buffer arg_buffer(arg_names, 2);
 		function_factory& new_fn = module->define_function(name_table->register_name(name), arg_buffer, retval_type);
-		type_ref_ptr retval_type_ptr(&retval_type);
-		compile_pass_fn fn_body = [=](compiler_context&ctx)
+		intrinsic_fn fn_body = [=](compiler_context& ctx, data_buffer<llvm_value_ptr> args)
 		{
-			return implement_binary_function(ctx, impl, *retval_type_ptr);
+			return impl(ctx._builder, args[0], args[1]);
 		};
-		new_fn.set_function_override_body(fn_body);
+		new_fn.set_function_intrinsic_body(fn_body);
 	}
 
 	void register_numeric_binary_fn(module_ptr module
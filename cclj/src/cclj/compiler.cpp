@@ -11,25 +11,42 @@
 #include "cclj/plugins/preprocessor_plugins.h"
 #include "cclj/plugins/language_plugins.h"
 #include "cclj/module.h"
-extern "C"
-{
-#include "pcre.h"
-}
+#include "cclj/reader.h"
+#include "cclj/runtime.h"
+#include <thread>
+#include <fstream>
+#include <iomanip>
 #ifdef _WIN32
 #pragma warning(push,2)
 #endif
 #include "llvm/Analysis/Passes.h"
 #include "llvm/Analysis/Verifier.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ExecutionEngine/JIT.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/GVMaterializer.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/PassManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Vectorize.h"
 #ifdef _WIN32
 #pragma warning(pop)
 #endif
@@ -43,291 +60,6 @@ using namespace llvm;
 namespace {
 
 
-	struct pcre_simple_regex
-	{
-		pcre* _re;
-		const char* _errorMsg;
-		int _errOffset;
-		pcre_simple_regex( const char* pattern )
-		{
-			_re = pcre_compile( pattern, 0, &_errorMsg, &_errOffset, nullptr );
-			if (!_re )
-				throw runtime_error( "invalid regex" );
-		}
-		~pcre_simple_regex()
-		{
-			pcre_free( _re );
-		}
-
-		bool match( const char* str )
-		{
-			if ( str == nullptr ) return false;
-			int rc = pcre_exec( _re, nullptr, str, strlen(str), 0, 0, nullptr, 0 );
-			return rc >= 0;
-		}
-
-	};
-
-	struct reader
-	{
-		string_table_ptr	_str_table;
-		type_library_ptr	_type_library;
-		factory_ptr			_factory;
-		const string&		_str;
-		string				_temp_str;
-		size_t				_cur_ptr;
-		size_t				_end_ptr;
-		pcre_simple_regex	_number_regex;
-
-		reader( string_table_ptr st, type_library_ptr tl, factory_ptr f, const string& data )
-			: _str_table( st )
-			, _type_library( tl )
-			, _factory( f )
-			, _str( data )
-			, _cur_ptr( 0 )
-			, _end_ptr( data.size() )
-			, _number_regex( "^[\\+-]?\\d+\\.?\\d*e?\\d*" ) 
-		{
-		}
-		
-
-		static bool is_white(char data)
-		{
-			return data == ' '
-					|| data == '\t'
-					|| data == '\n'
-					|| data == '\r';
-		}
-		static bool is_delimiter(char data )
-		{
-			return is_white( data )
-				|| data == '|'
-				|| data == '['
-				|| data == '('
-				|| data == ']'
-				|| data == ')'
-				|| data == ';';
-		}
-		char current_char()
-		{
-			if ( _cur_ptr < _end_ptr )
-				return _str[_cur_ptr];
-			throw runtime_error( "str access out of bounds" );
-		}
-		void eatwhite()
-		{
-			while( _cur_ptr != _end_ptr && ( is_white( current_char() ) || current_char() == ';' ) )
-			{
-				if ( current_char() == ';' )
-					for ( ; _cur_ptr != _end_ptr && current_char() != '\n'; ++_cur_ptr ) {}
-				else
-					 for ( ; _cur_ptr != _end_ptr && is_white( current_char() ); ++_cur_ptr ) {}
-			}
-		}
-
-		void find_delimiter()
-		{
-			for ( ; _cur_ptr != _end_ptr && !is_delimiter( current_char() ); ++_cur_ptr ) {}
-		}
-
-		bool atend()
-		{
-			return _cur_ptr >= _end_ptr || _cur_ptr == string::npos;
-		}
-
-		bool isnum()
-		{
-			return current_char() >= '0' && current_char() <= '9';
-		}
-
-		bool isplusminus()
-		{
-			return current_char() == '-' || current_char() == '+';
-		}
-
-		const char* substr( size_t start, size_t end )
-		{
-			if ( start >= _end_ptr || start == string::npos ) throw runtime_error( "fail" );
-			if ( end > _end_ptr ) end = _end_ptr;
-			_temp_str = _str;
-			_temp_str.erase( _temp_str.begin(), _temp_str.begin() + start );
-			_temp_str.resize( end-start );
-			return _temp_str.c_str();
-		}
-
-		cons_cell* parse_type()
-		{
-			object_ptr item = parse_next_item();
-			if ( item->type() == types::symbol )
-			{
-				cons_cell* retval = _factory->create_cell();
-				retval->_value = item;
-				if ( current_char() == '[' )
-				{
-					cons_cell* next_cell = _factory->create_cell();
-					retval->_next = next_cell;
-					next_cell->_value = parse_next_item();
-				}
-				return retval;
-			}
-			else if ( item->type() == types::array )
-			{
-				cons_cell* retval = _factory->create_cell();
-				cons_cell* next_cell = _factory->create_cell();
-				retval->_next = next_cell;
-				next_cell->_value = item;
-				return retval;
-			}
-			return &object_traits::cast_ref<cons_cell>( item );
-		}
-
-
-		
-		object_ptr parse_number_or_symbol(size_t token_start, size_t token_end)
-		{
-			substr( token_start, token_end );
-			bool is_number = _number_regex.match( _temp_str.c_str() );
-
-			//Parse each token.
-			if ( is_number )
-			{
-				string number_string( _temp_str );
-				constant* new_constant = _factory->create_constant();
-				new_constant->_unparsed_number = _str_table->register_str( number_string.c_str() );
-				//Define the type.  If the data is suffixed, then we have it.
-				if( current_char() == '|' )
-				{
-					++_cur_ptr;
-					new_constant->_unevaled_type = parse_type();
-				}
-				else
-				{
-					new_constant->_unevaled_type = _factory->create_cell();
-					symbol* type_name = _factory->create_symbol();
-					if ( number_string.find( "." ) != string::npos )
-						type_name->_name = _str_table->register_str( "f64" );
-					else
-						type_name->_name = _str_table->register_str( "i64" );
-					new_constant->_unevaled_type->_value = type_name;
-				}
-
-				return new_constant;
-			}
-			//symbol
-			else
-			{
-				//symbols are far harder to parse.
-				auto symbol_name = _str_table->register_str( _temp_str.c_str() );
-
-				cons_cell* type_info = nullptr;
-				if ( !atend() && current_char() == '|' )
-				{
-					++_cur_ptr;
-					type_info = parse_type();
-				}
-				symbol* retval = _factory->create_symbol();
-				retval->_name = symbol_name;
-				retval->_unevaled_type = type_info;
-				return retval;
-			}
-
-		}
-
-		object_ptr parse_next_item()
-		{
-			eatwhite();
-			size_t token_start = _cur_ptr;
-			size_t token_char = current_char();
-			switch( token_char )
-			{
-			case '(': return parse_list();
-			case '[': return parse_array();
-				break;
-			default:
-				find_delimiter();
-				return parse_number_or_symbol( token_start, _cur_ptr );
-			}
-		}
-
-		object_ptr parse_array() 
-		{ 
-			array* retval = _factory->create_array();
-			++_cur_ptr;
-			if ( atend() ) throw runtime_error( "fail" );
-			if ( current_char() == ']' ) {
-				++_cur_ptr;
-				return retval;
-			}
-
-			vector<object_ptr> array_contents;
-			eatwhite();
-
-			while( current_char() != ']' )
-			{
-				array_contents.push_back( parse_next_item() );
-				eatwhite();
-			}
-			++_cur_ptr;
-
-			if ( array_contents.size() )
-			{
-				retval->_data = _factory->allocate_obj_buffer( array_contents.size() );
-				memcpy( retval->_data.begin(), &array_contents[0], array_contents.size() * sizeof( object_ptr ) );
-			}
-			return retval; 
-		}
-
-		object_ptr parse_list()
-		{
-			if ( current_char() != '(' ) throw runtime_error( "fail" );
-			++_cur_ptr;
-			eatwhite();
-			if ( atend() ) throw runtime_error( "fail" );
-
-			if (current_char() == ')' ) { ++_cur_ptr; return const_cast<cons_cell*>( &_factory->empty_cell() ); };
-
-			if ( current_char() == '(' ) throw runtime_error( "nested lists; invalid parsing" );
-			
-			cons_cell* retval = _factory->create_cell();
-			cons_cell* next_cell = nullptr;
-			while( current_char() != ')' )
-			{
-				if ( next_cell == nullptr )
-					next_cell = retval;
-				else
-				{
-					auto temp = _factory->create_cell();
-					next_cell->_next = temp;
-					next_cell = temp;
-				}
-				next_cell->_value = parse_next_item();
-				eatwhite();
-			}
-			//inc past the )
-			++_cur_ptr;
-			return retval;
-		}
-		vector<object_ptr> read()
-		{
-			_cur_ptr = 0;
-			_end_ptr = _str.size();
-			vector<object_ptr> retval;
-			while( atend() == false )
-			{
-				eatwhite();
-				find_delimiter();
-				if ( atend() == false )
-				{
-					if ( current_char() == '(' )
-						retval.push_back( parse_list() );
-					else if ( current_char() == '[' )
-						retval.push_back( parse_array() );
-				}
-			}
-			return retval;
-		}
-	};
-
 	struct type_checker
 	{
 		shared_ptr<reader_context>				_context;
@@ -433,9 +165,180 @@ namespace {
 	};
 
 
+	//64 bit FNV-1a; unlike std::hash it is the same in every process.
+	struct stable_hash
+	{
+		uint64_t _value;
+
+		stable_hash() : _value( 14695981039346656037ULL ) {}
+
+		void add( const char* data, size_t len )
+		{
+			for ( size_t idx = 0; idx < len; ++idx )
+			{
+				_value ^= static_cast<uint8_t>( data[idx] );
+				_value *= 1099511628211ULL;
+			}
+			//So "ab","c" and "a","bc" differ.
+			_value ^= len;
+			_value *= 1099511628211ULL;
+		}
+
+		void add( const string& data ) { add( data.c_str(), data.size() ); }
+
+		void add( qualified_name name )
+		{
+			for_each( name.begin(), name.end(), [this]( string_table_str part ) { add( part.c_str(), part.size() ); } );
+		}
+	};
+
+	//Objects MCJIT generated, one file per cache key.
+	class module_object_cache : public ObjectCache
+	{
+		string	_directory;
+		string	_key;
+
+		string entry_path( const string& key ) { return _directory + "/" + key + ".o"; }
+
+	public:
+		//Modules whose object came from the cache.
+		uint32_t	_hits;
+
+		module_object_cache( const string& directory )
+			: _directory( directory )
+			, _hits( 0 )
+		{
+			bool existed;
+			sys::fs::create_directories( directory, existed );
+		}
+
+		bool contains( const string& key )
+		{
+			bool retval = false;
+			sys::fs::exists( entry_path( key ), retval );
+			return retval;
+		}
+
+		//The next module MCJIT generates code for is loaded from or stored under key.
+		//An empty key disables the cache for that module.
+		void begin_module( const string& key ) { _key = key; }
+
+		virtual void notifyObjectCompiled( const Module*, const MemoryBuffer* obj )
+		{
+			if ( _key.empty() )
+				return;
+			string path = entry_path( _key );
+			_key.clear();
+			//Written aside and renamed so other processes never map half an entry.
+			SmallString<128> temp_path;
+			int temp_file;
+			if ( sys::fs::createUniqueFile( path + ".%%%%%%", temp_file, temp_path ) )
+				return;
+			{
+				raw_fd_ostream output( temp_file, true );
+				output.write( obj->getBufferStart(), obj->getBufferSize() );
+			}
+			if ( sys::fs::rename( temp_path.str(), path ) )
+			{
+				bool existed;
+				sys::fs::remove( temp_path.str(), existed );
+			}
+		}
+
+		virtual MemoryBuffer* getObject( const Module* )
+		{
+			if ( _key.empty() )
+				return nullptr;
+			std::ifstream input( entry_path( _key ).c_str(), std::ios_base::in | std::ios_base::binary );
+			if ( !input )
+				return nullptr;
+			string object( ( std::istreambuf_iterator<char>( input ) ), std::istreambuf_iterator<char>() );
+			_key.clear();
+			++_hits;
+			return MemoryBuffer::getMemBufferCopy( object );
+		}
+	};
+
+	//MCJIT does not look at global mappings when it links an object, so the runtime's
+	//functions and variables are resolved here by name.
+	class runtime_memory_manager : public SectionMemoryManager
+	{
+	public:
+		unordered_map<string, void*> _symbols;
+
+		virtual uint64_t getSymbolAddress( const std::string& name )
+		{
+			auto iter = _symbols.find( name );
+			//Some platforms prefix every symbol with an underscore.
+			if ( iter == _symbols.end() && !name.empty() && name[0] == '_' )
+				iter = _symbols.find( name.substr( 1 ) );
+			if ( iter != _symbols.end() )
+				return static_cast<uint64_t>( reinterpret_cast<uintptr_t>( iter->second ) );
+			return SectionMemoryManager::getSymbolAddress( name );
+		}
+	};
+
+	//Compiles a function's body when the JIT first needs its code, which with lazy
+	//compilation is the first call through the function's stub.  Owned by the llvm module;
+	//keeps the context and function passes that module's compile created, since later
+	//compiles replace the compiler's.
+	class lazy_function_materializer : public GVMaterializer
+	{
+		shared_ptr<compiler_context>	_context;
+		shared_ptr<FunctionPassManager>	_fpm;
+	public:
+		lazy_function_materializer( shared_ptr<compiler_context> context, shared_ptr<FunctionPassManager> fpm )
+			: _context( context )
+			, _fpm( fpm )
+		{
+		}
+
+		virtual bool isMaterializable( const GlobalValue* value ) const
+		{
+			const Function* fn = dyn_cast<Function>( value );
+			return fn && _context->_lazy_functions.count( fn );
+		}
+
+		virtual bool isDematerializable( const GlobalValue* ) const { return false; }
+
+		//Returns true on failure.
+		virtual bool Materialize( GlobalValue* value, std::string* error_info )
+		{
+			Function* fn = dyn_cast<Function>( value );
+			if ( !fn || !_context->_lazy_functions.count( fn ) )
+				return false;
+			try
+			{
+				_context->_module->compile_lazy_function( *_context, *fn );
+			}
+			catch( std::exception& e )
+			{
+				if ( error_info )
+					*error_info = e.what();
+				return true;
+			}
+			return false;
+		}
+
+		virtual bool MaterializeModule( Module* llvm_module, std::string* error_info )
+		{
+			for ( Module::iterator iter = llvm_module->begin(), end = llvm_module->end(); iter != end; ++iter )
+			{
+				if ( Materialize( iter, error_info ) )
+					return true;
+			}
+			return false;
+		}
+	};
+
 	struct compiler_impl : public compiler
 	{
+		compiler_options				_options;
 		allocator_ptr					_allocator;
+		//Backs malloc and free for compiled code, which may run on any thread.
+		allocator_ptr					_runtime_allocator;
+		gc_shadow_frame*				_shadow_stack;
+		runtime							_runtime;
 		string_table_ptr				_str_table;
 		type_library_ptr				_type_library;
 		factory_ptr						_factory;
@@ -443,34 +346,63 @@ namespace {
 		string_plugin_map_ptr			_special_forms;
 		string_plugin_map_ptr			_top_level_special_forms;
 		slab_allocator_ptr				_ast_allocator;
+		//Only with _object_cache_dir set; must outlive the engine.
+		shared_ptr<module_object_cache>	_object_cache;
+		//Owned by the engine.
+		runtime_memory_manager*			_memory_manager;
+		//Key the next compile stores its object under.
+		string							_cache_key;
+		//Script functions earlier objects define, by llvm name.
+		unordered_map<string, void*>	_compiled_functions;
 		Module*							_llvm_module;
 		shared_ptr<ExecutionEngine>		_exec_engine;
 		shared_ptr<FunctionPassManager> _fpm;
+		shared_ptr<PassManager>			_mpm;
+		//The latest compile's.
+		shared_ptr<compiler_context>	_context;
 		string_lisp_evaluator_map		_evaluators;
 		qualified_name_table_ptr		_name_table;
 		module_ptr						_module;
+		//The gc-shadow-stack variable every compile hands its context.
+		variable_node_ptr				_shadow_stack_variable;
+		shared_ptr<type_checker>		_type_checker;
+		//Factories used by read_parallel's worker threads; each has its own allocator
+		//and lives as long as the forms read into it.
+		vector<factory_ptr>				_worker_factories;
 
-		compiler_impl()
-			: _allocator( allocator::create_checking_allocator() )
+		compiler_impl( const compiler_options& options )
+			: _options( options )
+			, _allocator( create_allocator() )
+			, _runtime_allocator( allocator::create_thread_caching_allocator() )
+			, _shadow_stack( nullptr )
+			, _runtime( _runtime_allocator, options._gc_collection_bytes, &_shadow_stack )
 			, _str_table( string_table::create() )
 			, _type_library( type_library::create_type_library( _allocator, _str_table ) )
 			, _factory( factory::create_factory( _allocator, _empty_cell ) )
 			, _special_forms( make_shared<string_plugin_map>() )
 			, _top_level_special_forms( make_shared<string_plugin_map>() )
 			, _ast_allocator( make_shared<slab_allocator<> >( _allocator ) )
+			, _memory_manager( nullptr )
 			, _llvm_module( nullptr )
 			, _name_table(qualified_name_table::create_table(_str_table))
 			, _module(module::create_module(_str_table, _type_library, _name_table))
+			, _shadow_stack_variable( nullptr )
 		{
 			base_language_plugins::register_base_compiler_plugins( _str_table, _top_level_special_forms, _special_forms, _evaluators );
 			preprocessor_plugins::register_plugins(_name_table, _top_level_special_forms, _special_forms, _evaluators);
 			language_plugins::register_plugins(_name_table, _top_level_special_forms, _special_forms);
 			binary_low_level_ast_node::register_binary_functions( _module, _type_library, _name_table );
+			if ( !_options._object_cache_dir.empty() )
+			{
+				if ( _options._lazy_compilation )
+					throw runtime_error( "lazy compilation cannot be combined with the object cache" );
+				_object_cache = make_shared<module_object_cache>( _options._object_cache_dir );
+			}
 			type_ref& base_type = _type_library->get_type_ref( base_numeric_types::i32 );
 			type_ref& ptr_lvl1 = _type_library->get_ptr_type( base_type );
 			type_ref& runtime_type = ptr_lvl1;
 			variable_node_factory& rt_variable = _module->define_variable(_name_table->register_name("rt"), ptr_lvl1);
-			rt_variable.set_value(this);
+			rt_variable.set_value(&_runtime);
 
 			{
 				type_ref& ret_type = _type_library->get_ptr_type( base_numeric_types::u8 );
@@ -481,56 +413,118 @@ namespace {
 				};
 
 				function_factory& fn = _module->define_function(_name_table->register_name("malloc"), type_ref_ptr_buffer(arg_types,3), ret_type);
-				fn.set_function_body(reinterpret_cast<void*>(&compiler_impl::rt_malloc));
+				fn.set_function_body(reinterpret_cast<void*>(&runtime::rt_malloc));
 			}
 			{
 				type_ref& ret_type = _type_library->get_void_type();
 				type_ref* arg_types[2] = { &runtime_type, &_type_library->get_unqual_ptr_type() };
 				function_factory& fn = _module->define_function(_name_table->register_name("free"), type_ref_ptr_buffer(arg_types, 2), ret_type);
-				fn.set_function_body(reinterpret_cast<void*>(&compiler_impl::rt_free));
+				fn.set_function_body(reinterpret_cast<void*>(&runtime::rt_free));
 			}
+			variable_node_factory& stack_variable = _module->define_variable(_name_table->register_name("gc-shadow-stack")
+																			, _type_library->get_ptr_type( base_numeric_types::u8 ));
+			stack_variable.set_value(&_shadow_stack);
+			stack_variable.set_constant(false);
+			_shadow_stack_variable = &stack_variable.node();
+			{
+				type_ref& ret_type = _type_library->get_managed_ptr_type( _type_library->get_type_ref( base_numeric_types::u8 ) );
+				type_ref* arg_types[2] = { &runtime_type, &_type_library->get_type_ref( base_numeric_types::u32 ) };
+				function_factory& fn = _module->define_function(_name_table->register_name("gc-alloc"), type_ref_ptr_buffer(arg_types, 2), ret_type);
+				fn.set_function_body(reinterpret_cast<void*>(&runtime::rt_gc_alloc));
+			}
+		}
+
+		allocator_ptr create_allocator()
+		{
+			switch( _options._allocator_type )
+			{
+			case allocator_types::checking: return allocator::create_checking_allocator();
+			case allocator_types::fast: return allocator::create_fast_allocator( _options._allocation_sample_rate );
+			}
+			throw runtime_error( "unrecognized allocator type" );
 		}
 
 		virtual module_ptr module() { return _module; }
 
+		virtual garbage_collector_ptr managed_heap() { return _runtime.managed_heap(); }
+
+		virtual uint32_t object_cache_hits() { return _object_cache ? _object_cache->_hits : 0; }
+
 		//transform text into the lisp datastructures.
 		virtual vector<lisp::object_ptr> read( const string& text )
 		{
-			reader _reader( _str_table, _type_library, _factory, text );
-			return _reader.read();
+			form_reader_ptr reader = form_reader::create_buffer_reader( _str_table, _factory, text.c_str(), text.size() );
+			vector<object_ptr> retval;
+			for ( object_ptr form = reader->next_form(); form; form = reader->next_form() )
+				retval.push_back( form );
+			return retval;
+		}
+
+		virtual vector<lisp::object_ptr> read_parallel( const string& text, uint32_t thread_count )
+		{
+			if ( thread_count == 0 )
+				thread_count = std::max( std::thread::hardware_concurrency(), 1U );
+			while( _worker_factories.size() + 1 < thread_count )
+				_worker_factories.push_back( factory::create_factory( create_allocator(), _empty_cell ) );
+
+			vector<factory_ptr> factories;
+			factories.push_back( _factory );
+			factories.insert( factories.end(), _worker_factories.begin(), _worker_factories.begin() + ( thread_count - 1 ) );
+			return form_reader::read_parallel( _str_table, factories, text.c_str(), text.size() );
+		}
+
+		virtual form_reader_ptr create_file_reader( const string& path )
+		{
+			return form_reader::create_file_reader( _str_table, _factory, path );
+		}
+
+		virtual form_reader_ptr create_stream_reader( std::istream& stream, size_t chunk_size )
+		{
+			return form_reader::create_stream_reader( _str_table, _factory, stream, chunk_size );
 		}
 
 		//Transform lisp datastructures into type-checked ast.
 		virtual void type_check( data_buffer<lisp::object_ptr> preprocess_result )
 		{
-			type_checker checker( _allocator, _factory, _type_library
-								, _str_table, _special_forms
-								, _top_level_special_forms, _ast_allocator
-								, _evaluators, _name_table, _module );
-
-			for_each( preprocess_result.begin(), preprocess_result.end(), [&,this]
+			for_each( preprocess_result.begin(), preprocess_result.end(), [this]
 			( object_ptr pp_result )
 			{
-				if ( pp_result->type() == types::cons_cell )
+				type_check_form( pp_result );
+			} );
+		}
+
+		type_checker& get_type_checker()
+		{
+			if ( !_type_checker )
+				_type_checker = make_shared<type_checker>( _allocator, _factory, _type_library
+															, _str_table, _special_forms
+															, _top_level_special_forms, _ast_allocator
+															, _evaluators, _name_table, _module );
+			return *_type_checker;
+		}
+
+		virtual void type_check_form( object_ptr pp_result )
+		{
+			type_checker& checker( get_type_checker() );
+			if ( pp_result->type() == types::cons_cell )
+			{
+				cons_cell& top_cell = object_traits::cast_ref<cons_cell>( pp_result );
+				symbol& first_item = object_traits::cast_ref<symbol>( top_cell._value );
+				string_plugin_map::iterator iter = _top_level_special_forms->find( first_item._name );
+				ast_node_ptr typecheck_result = nullptr;
+				if ( iter != _top_level_special_forms->end() )
 				{
-					cons_cell& top_cell = object_traits::cast_ref<cons_cell>( pp_result );
-					symbol& first_item = object_traits::cast_ref<symbol>( top_cell._value );
-					string_plugin_map::iterator iter = _top_level_special_forms->find( first_item._name );
-					ast_node_ptr typecheck_result = nullptr;
-					if ( iter != _top_level_special_forms->end() )
-					{
-						typecheck_result = iter->second->type_check(*checker._context, top_cell);
-					}
-					else
-					{
-						typecheck_result = &checker._applier.type_check_apply(*checker._context, top_cell);
-					}
-					if (typecheck_result)
-						_module->append_init_ast_node(*typecheck_result);
+					typecheck_result = iter->second->type_check(*checker._context, top_cell);
 				}
 				else
-					throw runtime_error( "invalid program, top level item is not a list" );
-			} );
+				{
+					typecheck_result = &checker._applier.type_check_apply(*checker._context, top_cell);
+				}
+				if (typecheck_result)
+					_module->append_init_ast_node(*typecheck_result);
+			}
+			else
+				throw runtime_error( "invalid program, top level item is not a list" );
 		}
 
 		//compile ast to binary.
@@ -546,66 +540,569 @@ namespace {
 
 				// Create the JIT.  This takes ownership of the module.
 				string ErrStr;
-				_exec_engine = shared_ptr<ExecutionEngine>(EngineBuilder(_llvm_module).setErrorStr(&ErrStr).create());
+				EngineBuilder engine_builder(_llvm_module);
+				engine_builder.setErrorStr(&ErrStr).setOptLevel(codegen_level());
+				//Only MCJIT produces objects that can be cached.
+				if (_object_cache)
+				{
+					InitializeNativeTargetAsmPrinter();
+					_memory_manager = new runtime_memory_manager();
+					engine_builder.setUseMCJIT(true).setMCJITMemoryManager(_memory_manager);
+				}
+				_exec_engine = shared_ptr<ExecutionEngine>(engine_builder.create());
 				if (!_exec_engine) {
 					throw runtime_error( "Could not create ExecutionEngine\n" );
 				}
-				_fpm = make_shared<FunctionPassManager>(_llvm_module);
-
-				// Set up the optimizer pipeline.  Start with registering info about how the
-				// target lays out data structures.
-				_fpm->add(new DataLayout(*_exec_engine->getDataLayout()));
-				// Provide basic AliasAnalysis support for GVN.
-				_fpm->add(createBasicAliasAnalysisPass());
-				// Promote allocas to registers.
-				_fpm->add(createPromoteMemoryToRegisterPass());
-				// Do simple "peephole" optimizations and bit-twiddling optzns.
-				_fpm->add(createInstructionCombiningPass());
-				// Reassociate expressions.
-				_fpm->add(createReassociatePass());
-				// Eliminate Common SubExpressions.
-				_fpm->add(createGVNPass());
-				// Simplify the control flow graph (deleting unreachable blocks, etc).
-				_fpm->add(createCFGSimplificationPass());
-				_fpm->doInitialization(); 
-			}
-
-			compiler_context comp_context(_type_library, _name_table, _module, *_llvm_module, *_fpm, *_exec_engine);
-
-			_module->compile_first_pass(comp_context);
-			_module->compile_second_pass(comp_context);
+				if (_object_cache)
+					_exec_engine->setObjectCache(_object_cache.get());
+				//Calls to a function the materializer has not compiled go through a stub.
+				if (_options._lazy_compilation)
+					_exec_engine->DisableLazyCompilation(false);
+			}
+			else
+			{
+				//Every compile rebuilds all of the module's functions, so each gets an llvm
+				//module of its own and the module passes only see this compile's code.
+				//MCJIT cannot add to a module it has generated code for either.
+				_llvm_module = new Module("my cool jit", Context);
+				_exec_engine->addModule(_llvm_module);
+			}
+			create_jit_pass_managers();
+
+			_context = make_shared<compiler_context>(_type_library, _name_table, _module, *_llvm_module, *_fpm, _exec_engine.get());
+			_context->_lazy_compilation = _options._lazy_compilation;
+			_context->_gc_shadow_stack = _shadow_stack_variable;
+			if (_options._lazy_compilation)
+				_llvm_module->setMaterializer(new lazy_function_materializer(_context, _fpm));
+			//A cached object has every body, so only the declarations are built.
+			bool cached = _object_cache && !_cache_key.empty() && _object_cache->contains(_cache_key);
+			if (_object_cache)
+			{
+				_context->_separate_objects = true;
+				_context->_compiled_functions = _compiled_functions;
+				_context->_cached_object = cached;
+			}
+
+			_module->compile_first_pass(*_context);
+			_module->compile_second_pass(*_context);
+			if (!_options._lazy_compilation && !cached)
+				_mpm->run(*_llvm_module);
+
+			if (_object_cache)
+			{
+				_memory_manager->_symbols.insert(_context->_global_mappings.begin(), _context->_global_mappings.end());
+				_object_cache->begin_module(_cache_key);
+				_cache_key.clear();
+				_exec_engine->finalizeObject();
+				//Later objects only declare these.  Looked up by name in the loaded object since
+				//a cached compile only has declarations.
+				for (Module::iterator iter = _llvm_module->begin(), end = _llvm_module->end(); iter != end; ++iter)
+				{
+					string name = iter->getName().str();
+					if (!iter->hasExternalLinkage() || &*iter == &_module->llvm()
+						|| _context->_global_mappings.count(name))
+						continue;
+					uint64_t address = _exec_engine->getFunctionAddress(name);
+					if (address)
+						_compiled_functions[name] = reinterpret_cast<void*>(static_cast<uintptr_t>(address));
+				}
+				void* init_fn = reinterpret_cast<void*>(static_cast<uintptr_t>(_exec_engine->getFunctionAddress(_module->llvm().getName().str())));
+				return make_pair(init_fn, &_module->init_return_type());
+			}
 
 			return make_pair(_exec_engine->getPointerToFunction(&_module->llvm()), &_module->init_return_type());
 		}
 
+		static void add_function_signature( stable_hash& hash, function_node_ptr fn )
+		{
+			if ( fn == nullptr )
+			{
+				hash.add( "none" );
+				return;
+			}
+			hash.add( fn->name() );
+			hash.add( fn->type().to_string() );
+			hash.add( fn->return_type().to_string() );
+			if ( fn->is_external() )
+				hash.add( "external" );
+			else if ( fn->get_function_override_body() )
+				hash.add( "override" );
+			else if ( fn->get_function_intrinsic_body() )
+				hash.add( "intrinsic" );
+			else
+				hash.add( "script" );
+		}
+
+		static void add_properties( stable_hash& hash, data_buffer<datatype_property> properties )
+		{
+			for_each( properties.begin(), properties.end(), [&]( datatype_property& property )
+			{
+				if ( property.type() == datatype_property_type::field )
+				{
+					named_type& field = property.data<named_type>();
+					hash.add( "field" );
+					hash.add( field.name.c_str(), field.name.size() );
+					hash.add( field.type->to_string() );
+				}
+				else if ( property.type() == datatype_property_type::accessor )
+				{
+					accessor& access = property.data<accessor>();
+					hash.add( "accessor" );
+					hash.add( access.name.c_str(), access.name.size() );
+					hash.add( access.type->to_string() );
+					add_function_signature( hash, access.getter );
+					add_function_signature( hash, access.setter );
+				}
+			} );
+		}
+
+		//The source text, the optimization level, the host and the signature or layout of every
+		//symbol defined before this script: what the runtime, the plugins and earlier scripts
+		//supply.  Earlier scripts' function bodies live in their own objects and are reached by
+		//name, so only their signatures are in the key; a warm start that runs the same scripts
+		//in order hits on every one of them, and changing a type an earlier script defines misses.
+		string cache_key( const string& text )
+		{
+			stable_hash hash;
+			hash.add( "cclj object cache 3" );
+			hash.add( sys::getProcessTriple() );
+			hash.add( text );
+			vector<module_symbol> symbols( _module->symbols() );
+			for_each( symbols.begin(), symbols.end(), [&]( module_symbol& symbol )
+			{
+				switch( symbol.type() )
+				{
+				case module_symbol_type::variable:
+					{
+						variable_node_ptr variable = symbol.data<variable_node_ptr>();
+						hash.add( "variable" );
+						hash.add( variable->name() );
+						hash.add( variable->type().to_string() );
+					}
+					break;
+				case module_symbol_type::function:
+					{
+						function_node_buffer functions = symbol.data<function_node_buffer>();
+						for_each( functions.begin(), functions.end(), [&]( function_node_ptr fn )
+						{
+							add_function_signature( hash, fn );
+						} );
+					}
+					break;
+				case module_symbol_type::datatype:
+					{
+						datatype_node_ptr datatype = symbol.data<datatype_node_ptr>();
+						hash.add( "datatype" );
+						hash.add( datatype->name() );
+						hash.add( const_cast<type_ref&>( datatype->type() ).to_string() );
+						vector<datatype_property> properties( datatype->properties() );
+						add_properties( hash, properties );
+						hash.add( "static" );
+						add_properties( hash, datatype->static_properties() );
+						for ( int op = datatype_predefined_operators::constructor; op <= datatype_predefined_operators::apply; ++op )
+						{
+							function_node_buffer operators = datatype->get_predefined_operator( static_cast<datatype_predefined_operators::_enum>( op ) );
+							hash.add( datatype_predefined_operators::to_string( static_cast<datatype_predefined_operators::_enum>( op ) ) );
+							for_each( operators.begin(), operators.end(), [&]( function_node_ptr fn )
+							{
+								add_function_signature( hash, fn );
+							} );
+						}
+					}
+					break;
+				default:
+					break;
+				}
+			} );
+			char level = static_cast<char>( '0' + _options._optimization_level );
+			hash.add( &level, 1 );
+			stringstream retval;
+			retval << std::hex << std::setw( 16 ) << std::setfill( '0' ) << hash._value << "-" << std::dec << text.size();
+			return retval.str();
+		}
+
+		CodeGenOpt::Level codegen_level()
+		{
+			switch( _options._optimization_level )
+			{
+			case optimization_levels::O0: return CodeGenOpt::None;
+			case optimization_levels::O1: return CodeGenOpt::Less;
+			case optimization_levels::O3: return CodeGenOpt::Aggressive;
+			default: return CodeGenOpt::Default;
+			}
+		}
+
+		//What populateModulePassManager runs after the inliner that stays within one
+		//function, in the same order.  Lazily compiled bodies never reach the module passes.
+		static void add_per_function_passes( FunctionPassManager& fpm, unsigned opt_level, unsigned size_level )
+		{
+			if ( opt_level == 0 )
+				return;
+			bool vectorize = opt_level > 1 && size_level == 0;
+			fpm.add(createJumpThreadingPass());
+			fpm.add(createCorrelatedValuePropagationPass());
+			fpm.add(createCFGSimplificationPass());
+			fpm.add(createInstructionCombiningPass());
+			fpm.add(createTailCallEliminationPass());
+			fpm.add(createCFGSimplificationPass());
+			fpm.add(createReassociatePass());
+			fpm.add(createLoopRotatePass());
+			fpm.add(createLICMPass());
+			fpm.add(createLoopUnswitchPass(size_level > 0 || opt_level < 3));
+			fpm.add(createInstructionCombiningPass());
+			fpm.add(createIndVarSimplifyPass());
+			fpm.add(createLoopIdiomPass());
+			fpm.add(createLoopDeletionPass());
+			if ( size_level == 0 )
+				fpm.add(createLoopUnrollPass());
+			if ( opt_level > 1 )
+				fpm.add(createGVNPass());
+			fpm.add(createMemCpyOptPass());
+			fpm.add(createSCCPPass());
+			fpm.add(createInstructionCombiningPass());
+			fpm.add(createJumpThreadingPass());
+			fpm.add(createCorrelatedValuePropagationPass());
+			fpm.add(createDeadStoreEliminationPass());
+			if ( vectorize )
+			{
+				fpm.add(createLoopVectorizePass());
+				fpm.add(createSLPVectorizerPass());
+				fpm.add(createInstructionCombiningPass());
+			}
+			fpm.add(createAggressiveDCEPass());
+			fpm.add(createCFGSimplificationPass());
+			fpm.add(createInstructionCombiningPass());
+		}
+
+		//Function passes run as each function is finished; the module passes (inliner,
+		//IPSCCP, loop passes, vectorizers, GlobalDCE) run once the whole module is built.
+		//With per_function set the function pass manager also gets add_per_function_passes.
+		void create_pass_managers( Module* llvm_module, const DataLayout& layout, TargetMachine* target
+									, bool per_function
+									, shared_ptr<FunctionPassManager>& fpm, shared_ptr<PassManager>& mpm )
+		{
+			unsigned opt_level = 2;
+			unsigned size_level = 0;
+			switch( _options._optimization_level )
+			{
+			case optimization_levels::O0: opt_level = 0; break;
+			case optimization_levels::O1: opt_level = 1; break;
+			case optimization_levels::O2: opt_level = 2; break;
+			case optimization_levels::O3: opt_level = 3; break;
+			case optimization_levels::Os: opt_level = 2; size_level = 1; break;
+			default: throw runtime_error( "unrecognized optimization level" );
+			}
+			fpm = make_shared<FunctionPassManager>(llvm_module);
+			mpm = make_shared<PassManager>();
+			fpm->add(new DataLayout(layout));
+			mpm->add(new DataLayout(layout));
+			//Without the target's cost model the vectorizers assume there are no vector registers.
+			if ( target )
+			{
+				target->addAnalysisPasses(*fpm);
+				target->addAnalysisPasses(*mpm);
+			}
+			PassManagerBuilder builder;
+			builder.OptLevel = opt_level;
+			builder.SizeLevel = size_level;
+			if ( opt_level > 0 )
+				builder.Inliner = createFunctionInliningPass(opt_level, size_level);
+			builder.LoopVectorize = opt_level > 1 && size_level == 0;
+			builder.SLPVectorize = opt_level > 1 && size_level == 0;
+			builder.DisableUnrollLoops = opt_level == 0 || size_level > 0;
+			builder.populateFunctionPassManager(*fpm);
+			builder.populateModulePassManager(*mpm);
+			if ( per_function )
+				add_per_function_passes( *fpm, opt_level, size_level );
+			fpm->doInitialization();
+		}
+
+		void create_jit_pass_managers()
+		{
+			create_pass_managers( _llvm_module, *_exec_engine->getDataLayout(), _exec_engine->getTargetMachine()
+									, _options._lazy_compilation, _fpm, _mpm );
+		}
+
+		virtual void compile_to_file( const string& output_path, const string& header_path )
+		{
+			InitializeNativeTarget();
+			InitializeNativeTargetAsmPrinter();
+			string triple = sys::getDefaultTargetTriple();
+			string error;
+			const Target* target = TargetRegistry::lookupTarget( triple, error );
+			if ( !target )
+				throw runtime_error( error );
+			//Position independent so the object can go into a shared library as well.
+			shared_ptr<TargetMachine> machine( target->createTargetMachine( triple, sys::getHostCPUName(), ""
+																			, TargetOptions(), Reloc::PIC_
+																			, CodeModel::Default, codegen_level() ) );
+			if ( !machine )
+				throw runtime_error( "failed to create target machine" );
+			shared_ptr<Module> llvm_module = make_shared<Module>( "cclj aot", getGlobalContext() );
+			llvm_module->setTargetTriple( triple );
+			llvm_module->setDataLayout( machine->getDataLayout()->getStringRepresentation() );
+			shared_ptr<FunctionPassManager> fpm;
+			shared_ptr<PassManager> mpm;
+			create_pass_managers( llvm_module.get(), *machine->getDataLayout(), machine.get(), false, fpm, mpm );
+
+			compiler_context comp_context( _type_library, _name_table, _module, *llvm_module, *fpm, nullptr );
+			comp_context._gc_shadow_stack = _shadow_stack_variable;
+			_module->compile_first_pass( comp_context );
+			_module->compile_second_pass( comp_context );
+			vector<pair<string, function_node_ptr> > exports = export_symbols();
+			mpm->run( *llvm_module );
+
+			bool shared_library = ends_with( output_path, ".so" ) || ends_with( output_path, ".dylib" ) || ends_with( output_path, ".dll" );
+			string object_path = shared_library ? output_path + ".o" : output_path;
+			{
+				string error_info;
+				raw_fd_ostream output( object_path.c_str(), error_info, sys::fs::F_Binary );
+				if ( !error_info.empty() )
+					throw runtime_error( error_info );
+				formatted_raw_ostream formatted_output( output );
+				PassManager emit;
+				emit.add( new DataLayout( *machine->getDataLayout() ) );
+				machine->addAnalysisPasses( emit );
+				if ( machine->addPassesToEmitFile( emit, formatted_output, TargetMachine::CGFT_ObjectFile ) )
+					throw runtime_error( "target cannot emit object files" );
+				emit.run( *llvm_module );
+			}
+			if ( shared_library )
+				link_shared_library( object_path, output_path );
+			write_header( header_path, exports );
+		}
+
+		static bool ends_with( const string& value, const char* suffix )
+		{
+			size_t len = strlen( suffix );
+			return value.size() >= len && value.compare( value.size() - len, len, suffix ) == 0;
+		}
+
+		//llvm has no linker of its own so the system compiler driver does it.  The library
+		//leaves the runtime's symbols undefined.
+		static void link_shared_library( const string& object_path, const string& output_path )
+		{
+			string driver = sys::FindProgramByName( "cc" );
+			if ( driver.empty() )
+				throw runtime_error( "no cc found to link a shared library" );
+			const char* args[] = { driver.c_str(), "-shared", "-o", output_path.c_str(), object_path.c_str(), nullptr };
+			string error;
+			int result = sys::ExecuteAndWait( driver, args, nullptr, nullptr, 0, 0, &error );
+			bool existed;
+			sys::fs::remove( object_path, existed );
+			if ( result != 0 )
+				throw runtime_error( "failed to link shared library: " + error );
+		}
+
+		//cclj_ followed by the name with anything that can't be in a C identifier replaced
+		//by _.  Overloaded functions append their argument types.
+		static string c_symbol_name( qualified_name name, function_node_ptr overload )
+		{
+			string retval( "cclj" );
+			for_each( name.begin(), name.end(), [&]( string_table_str part )
+			{
+				retval.append( "_" );
+				retval.append( part.c_str(), part.size() );
+			} );
+			if ( overload )
+			{
+				data_buffer<named_type> args( overload->arguments() );
+				for_each( args.begin(), args.end(), [&]( named_type& arg )
+				{
+					retval.append( "_" );
+					retval.append( arg.type->to_string() );
+				} );
+			}
+			for ( size_t idx = 0, end = retval.size(); idx < end; ++idx )
+			{
+				if ( !isalnum( static_cast<unsigned char>( retval[idx] ) ) )
+					retval[idx] = '_';
+			}
+			return retval;
+		}
+
+		//C names for every symbol of the module.  Runtime symbols match aot_runtime.cpp;
+		//functions the module defines become external so the module passes keep them.
+		vector<pair<string, function_node_ptr> > export_symbols()
+		{
+			vector<pair<string, function_node_ptr> > retval;
+			vector<module_symbol> symbols( _module->symbols() );
+			for_each( symbols.begin(), symbols.end(), [&]( module_symbol& symbol )
+			{
+				switch( symbol.type() )
+				{
+				case module_symbol_type::variable:
+					{
+						variable_node_ptr variable = symbol.data<variable_node_ptr>();
+						variable->llvm_variable().setName( c_symbol_name( variable->name(), nullptr ) );
+					}
+					break;
+				case module_symbol_type::function:
+					{
+						function_node_buffer functions = symbol.data<function_node_buffer>();
+						for_each( functions.begin(), functions.end(), [&]( function_node_ptr fn )
+						{
+							//Builtins stay private and unused intrinsics are already gone.
+							if ( fn->get_function_intrinsic_body() || fn->get_function_override_body() )
+								return;
+							string name = c_symbol_name( fn->name(), functions.size() > 1 ? fn : nullptr );
+							fn->llvm().setName( name );
+							if ( !fn->is_external() )
+							{
+								fn->llvm().setLinkage( GlobalValue::ExternalLinkage );
+								retval.push_back( make_pair( name, fn ) );
+							}
+						} );
+					}
+					break;
+				default:
+					break;
+				}
+			} );
+			_module->llvm().setName( "cclj_module_init" );
+			return retval;
+		}
+
+		//Empty if the type has no C equivalent.
+		static string c_type_name( type_ref& type )
+		{
+			switch( type._kind )
+			{
+			case type_kinds::void_type:
+			case type_kinds::unqual:
+				return "void";
+			case type_kinds::base_numeric:
+				switch( type._base_numeric_type )
+				{
+				case base_numeric_types::f32: return "float";
+				case base_numeric_types::f64: return "double";
+				case base_numeric_types::i1: return "bool";
+				case base_numeric_types::i8: return "int8_t";
+				case base_numeric_types::u8: return "uint8_t";
+				case base_numeric_types::i16: return "int16_t";
+				case base_numeric_types::u16: return "uint16_t";
+				case base_numeric_types::i32: return "int32_t";
+				case base_numeric_types::u32: return "uint32_t";
+				case base_numeric_types::i64: return "int64_t";
+				case base_numeric_types::u64: return "uint64_t";
+				default: return string();
+				}
+			case type_kinds::pointer:
+			case type_kinds::managed_pointer:
+				{
+					string pointee = c_type_name( *type._specializations[0] );
+					return pointee.empty() ? pointee : pointee + "*";
+				}
+			default:
+				return string();
+			}
+		}
+
+		static string c_declaration( const string& name, type_ref& return_type, data_buffer<named_type> args )
+		{
+			string retval = c_type_name( return_type );
+			if ( retval.empty() )
+				return retval;
+			retval.append( " " );
+			retval.append( name );
+			retval.append( "(" );
+			bool first = true;
+			for ( size_t idx = 0, end = args.size(); idx < end; ++idx )
+			{
+				//void arguments are dropped from the llvm signature as well.
+				if ( args[idx].type->_kind == type_kinds::void_type )
+					continue;
+				string arg_type = c_type_name( *args[idx].type );
+				if ( arg_type.empty() )
+					return arg_type;
+				if ( !first )
+					retval.append( ", " );
+				first = false;
+				string arg_name( args[idx].name.c_str(), args[idx].name.size() );
+				for_each( arg_name.begin(), arg_name.end(), []( char& item ) { if ( !isalnum( static_cast<unsigned char>( item ) ) ) item = '_'; } );
+				retval.append( arg_type + " " + arg_name );
+			}
+			if ( first )
+				retval.append( "void" );
+			retval.append( ");" );
+			return retval;
+		}
+
+		void write_header( const string& header_path, const vector<pair<string, function_node_ptr> >& exports )
+		{
+			std::ofstream output( header_path.c_str(), std::ios_base::out | std::ios_base::binary );
+			if ( !output )
+				throw runtime_error( "failed to open header for writing" );
+			output << "//Generated by cclj.  Link with the compiled module and the cclj runtime library." << "\n"
+				<< "#pragma once" << "\n"
+				<< "#include <stdint.h>" << "\n"
+				<< "#include <stdbool.h>" << "\n"
+				<< "#ifdef __cplusplus" << "\n" << "extern \"C\" {" << "\n" << "#endif" << "\n";
+			output << c_declaration( "cclj_module_init", _module->init_return_type(), data_buffer<named_type>() ) << "\n";
+			for_each( exports.begin(), exports.end(), [&]( const pair<string, function_node_ptr>& entry )
+			{
+				string declaration = c_declaration( entry.first, entry.second->return_type(), entry.second->arguments() );
+				if ( declaration.empty() )
+					output << "//" << entry.first << " has argument or return types with no C equivalent." << "\n";
+				else
+					output << declaration << "\n";
+			} );
+			output << "#ifdef __cplusplus" << "\n" << "}" << "\n" << "#endif" << "\n";
+		}
+
 		//Create a compiler and execute this text return the last value if it is a float else exception.
 		virtual float execute( const string& text )
 		{
-			vector<object_ptr> read_result = read( text );
-			type_check( read_result );
-			pair<void*,type_ref_ptr> compile_result = compile();
-			if ( _type_library->to_base_numeric_type( *compile_result.second ) != base_numeric_types::f32 )
-				throw runtime_error( "failed to evaluate lisp data to float function" );
-			typedef float (*anon_fn_type)();
-			anon_fn_type exec_fn = reinterpret_cast<anon_fn_type>( compile_result.first );
-			return exec_fn();
+			//The text is still type checked so later scripts see what it defines; on a hit
+			//compile maps the cached object instead of generating code.
+			if ( _object_cache )
+				_cache_key = cache_key( text );
+			try
+			{
+				form_reader_ptr reader = form_reader::create_buffer_reader( _str_table, _factory, text.c_str(), text.size() );
+				return execute( *reader );
+			}
+			catch( ... )
+			{
+				_cache_key.clear();
+				throw;
+			}
 		}
 
-		static void* rt_malloc( void* comp_ptr, uint32_t item_size, uint8_t item_align )
+		virtual float execute_file( const string& path )
 		{
-			compiler_impl* compiler = reinterpret_cast<compiler_impl*>( comp_ptr );
-			return compiler->_allocator->allocate( item_size, item_align, CCLJ_IMMEDIATE_FILE_INFO() );
+			//The cache key needs the whole text up front.
+			if ( _object_cache )
+			{
+				std::ifstream input( path.c_str(), std::ios_base::in | std::ios_base::binary );
+				if ( !input )
+					throw runtime_error( "failed to open file" );
+				string text( ( std::istreambuf_iterator<char>( input ) ), std::istreambuf_iterator<char>() );
+				return execute( text );
+			}
+			return execute( *create_file_reader( path ) );
 		}
 
-		static void rt_free( void* comp_ptr, void* value )
+		virtual float execute( form_reader& reader )
 		{
-			compiler_impl* compiler = reinterpret_cast<compiler_impl*>( comp_ptr );
-			compiler->_allocator->deallocate( value );
+			for ( object_ptr form = reader.next_form(); form; form = reader.next_form() )
+				type_check_form( form );
+			pair<void*,type_ref_ptr> compile_result = compile();
+			if ( _type_library->to_base_numeric_type( *compile_result.second ) != base_numeric_types::f32 )
+				throw runtime_error( "failed to evaluate lisp data to float function" );
+			return call_init( compile_result.first );
+		}
+
+		static float call_init( void* init_fn )
+		{
+			typedef float (*anon_fn_type)();
+			anon_fn_type exec_fn = reinterpret_cast<anon_fn_type>( init_fn );
+			return exec_fn();
 		}
 	}; 
 }
 
-compiler_ptr compiler::create()
+compiler_ptr compiler::create( const compiler_options& options )
 {
-	return make_shared<compiler_impl>();
+	return make_shared<compiler_impl>( options );
 }
@@ -39,7 +39,7 @@ compiler_context::compiler_context(type_library_ptr tl
 					, qualified_name_table_ptr name_table
 					, module_ptr module
 					, llvm::Module& m,  llvm::FunctionPassManager& fpm
-					, llvm::ExecutionEngine& eng )
+					, llvm::ExecutionEngine* eng )
 	: _llvm_module( m )
 	, _name_table( name_table )
 	, _module( module )
@@ -47,6 +47,10 @@ compiler_context::compiler_context(type_library_ptr tl
 	, _eng( eng )
 	, _type_library( tl )
 	, _builder( getGlobalContext() )
+	, _lazy_compilation( false )
+	, _separate_objects( false )
+	, _cached_object( false )
+	, _gc_shadow_stack( nullptr )
 {
 }
 
@@ -79,17 +83,140 @@ void compiler_context::exit_scope()
 	_scopes.pop_back();
 }
 
+namespace
+{
+	//llvm struct index paths to the managed pointers in a value of type.
+	void find_managed_fields( compiler_context& context, type_ref& type, vector<uint32_t>& path
+								, vector<vector<uint32_t> >& fields )
+	{
+		if ( context._type_library->is_managed_pointer_type( type ) )
+			fields.push_back( path );
+		else if ( context._type_library->is_tuple_type( type ) )
+		{
+			//void members have no llvm field.
+			uint32_t field_idx = 0;
+			for ( auto iter = type._specializations.begin(), end = type._specializations.end()
+				; iter != end; ++iter )
+			{
+				if ( context._type_library->is_void_type( **iter ) )
+					continue;
+				path.push_back( field_idx );
+				find_managed_fields( context, **iter, path, fields );
+				path.pop_back();
+				++field_idx;
+			}
+		}
+		else if ( type._kind == type_kinds::datatype )
+		{
+			datatype_node_ptr dtype = context._module->find_datatype( type );
+			if ( dtype == nullptr )
+				return;
+			vector<named_type> dtype_fields = dtype->fields();
+			for ( auto iter = dtype_fields.begin(), end = dtype_fields.end(); iter != end; ++iter )
+			{
+				path.push_back( static_cast<uint32_t>( dtype->index_of_field( iter->name ) ) );
+				find_managed_fields( context, *iter->type, path, fields );
+				path.pop_back();
+			}
+		}
+	}
+}
+
+void compiler_context::add_local( type_ref& type, llvm::AllocaInst& slot )
+{
+	vector<uint32_t> path;
+	vector<vector<uint32_t> > fields;
+	find_managed_fields( *this, type, path, fields );
+	for_each( fields.begin(), fields.end(), [&]( const vector<uint32_t>& field )
+	{
+		_gc_roots.push_back( gc_root( &slot, field ) );
+	} );
+}
+
+llvm::AllocaInst& compiler_context::create_gc_root( type_ref& type )
+{
+	Function* function = _builder.GetInsertBlock()->getParent();
+	IRBuilder<> entry_builder( &function->getEntryBlock(), function->getEntryBlock().begin() );
+	AllocaInst* retval = entry_builder.CreateAlloca( type_ref_type( type ).get(), 0, "gc temp" );
+	_gc_roots.push_back( gc_root( retval, vector<uint32_t>() ) );
+	return *retval;
+}
+
+void compiler_context::begin_gc_frame()
+{
+	_gc_roots.clear();
+}
+
+//The frame is { previous frame, root slot addresses, root count } and has to match
+//gc_shadow_frame in cclj/runtime.h.  The gc-shadow-stack variable is the runtime's pointer
+//to the innermost frame.
+void compiler_context::finish_gc_frame( llvm::Function& fn )
+{
+	if ( _gc_roots.empty() ) return;
+	if ( _gc_shadow_stack == nullptr )
+		throw runtime_error( "managed pointers need the gc-shadow-stack runtime variable" );
+	Value* stack_head = &module_variable( *_gc_shadow_stack );
+	LLVMContext& llvm_context( getGlobalContext() );
+	Type* i8_ptr = Type::getInt8PtrTy( llvm_context );
+	Type* i32 = Type::getInt32Ty( llvm_context );
+	Type* frame_members[3] = { i8_ptr, PointerType::getUnqual( i8_ptr ), i32 };
+	//Through ArrayRef; the bare array would convert to get's isPacked flag instead.
+	StructType* frame_type = StructType::get( llvm_context, ArrayRef<Type*>( frame_members ) );
+	uint32_t root_count = static_cast<uint32_t>( _gc_roots.size() );
+
+	BasicBlock& entry( fn.getEntryBlock() );
+	IRBuilder<> alloca_builder( &entry, entry.begin() );
+	AllocaInst* roots = alloca_builder.CreateAlloca( ArrayType::get( i8_ptr, root_count ), 0, "gc roots" );
+	AllocaInst* frame = alloca_builder.CreateAlloca( frame_type, 0, "gc frame" );
+	//Slots have to be null before anything can collect, so set up after the allocas and
+	//ahead of everything else.
+	BasicBlock::iterator setup_point = entry.begin();
+	while( setup_point != entry.end() && isa<AllocaInst>( setup_point ) )
+		++setup_point;
+	IRBuilder<> setup( &entry, setup_point );
+	AllocaInst* last_slot = nullptr;
+	for ( uint32_t idx = 0; idx < root_count; ++idx )
+	{
+		const gc_root& root( _gc_roots[idx] );
+		if ( root._slot != last_slot )
+		{
+			setup.CreateStore( Constant::getNullValue( root._slot->getAllocatedType() ), root._slot );
+			last_slot = root._slot;
+		}
+		Value* address = root._slot;
+		if ( !root._field_path.empty() )
+		{
+			vector<Value*> indexes( 1, ConstantInt::get( i32, 0 ) );
+			for_each( root._field_path.begin(), root._field_path.end(), [&]( uint32_t field )
+			{
+				indexes.push_back( ConstantInt::get( i32, field ) );
+			} );
+			address = setup.CreateGEP( root._slot, indexes );
+		}
+		setup.CreateStore( setup.CreateBitCast( address, i8_ptr ), setup.CreateConstGEP2_32( roots, 0, idx ) );
+	}
+	setup.CreateStore( setup.CreateLoad( stack_head ), setup.CreateStructGEP( frame, 0 ) );
+	setup.CreateStore( setup.CreateConstGEP2_32( roots, 0, 0 ), setup.CreateStructGEP( frame, 1 ) );
+	setup.CreateStore( ConstantInt::get( i32, root_count ), setup.CreateStructGEP( frame, 2 ) );
+	setup.CreateStore( setup.CreateBitCast( frame, i8_ptr ), stack_head );
+
+	_builder.CreateStore( _builder.CreateLoad( _builder.CreateStructGEP( frame, 0 ) ), stack_head );
+	_gc_roots.clear();
+}
+
 
 
 string compiler_context::qualified_name_to_llvm_name(qualified_name nm)
 {
+	//Names end up in cached objects so they must not depend on earlier calls.
+	_name_buffer.str(string());
 	_name_buffer.clear();
 	bool first = true;
 	for_each(nm.begin(), nm.end(), [&](string_table_str data){
 		if (!first)
 			_name_buffer << "_";
 		first = false;
-		_name_buffer << data.c_str();
+		_name_buffer.write(data.c_str(), data.size());
 	});
 	return _name_buffer.str();
 }
@@ -98,7 +225,7 @@ namespace
 {
 	void type_ref_to_llvm_name(type_ref& type, stringstream& str)
 	{
-		str << type._name.c_str();
+		str.write(type._name.c_str(), type._name.size());
 		if (type._specializations.size())
 		{
 			str << "[";
@@ -143,58 +270,90 @@ llvm::GlobalValue::LinkageTypes compiler_context::visibility_to_linkage(visibili
 	}
 }
 
+void compiler_context::map_global(llvm::GlobalValue& value, void* address)
+{
+	if (_eng)
+		_eng->addGlobalMapping(&value, address);
+	if (address)
+		_global_mappings[value.getName().str()] = address;
+}
+
+llvm::Function& compiler_context::module_function(function_node& fn)
+{
+	llvm::Function& latest = fn.llvm();
+	if (latest.getParent() == &_llvm_module)
+		return latest;
+	llvm::Function* retval = _llvm_module.getFunction(latest.getName());
+	if (retval == nullptr)
+		throw runtime_error("function is not in the context's llvm module");
+	return *retval;
+}
+
+llvm::GlobalVariable& compiler_context::module_variable(variable_node& var)
+{
+	llvm::GlobalVariable& latest = var.llvm_variable();
+	if (latest.getParent() == &_llvm_module)
+		return latest;
+	llvm::GlobalVariable* retval = _llvm_module.getGlobalVariable(latest.getName(), true);
+	if (retval == nullptr)
+		throw runtime_error("variable is not in the context's llvm module");
+	return *retval;
+}
+
 namespace
 {
 
 	llvm_type_ptr_opt do_get_type_ref( compiler_context& context, type_ref& type )
 	{
-		if ( context._type_library->is_pointer_type( type ) )
-		{
-
-			llvm_type_ptr_opt llvm_ptr = context.type_ref_type( context._type_library->deref_ptr_type( type ) );
-			if ( llvm_ptr )
-				return PointerType::get( llvm_ptr.get(), 0 );
-			return llvm_type_ptr_opt();
-		}
-		else if (context._type_library->is_tuple_type(type))
+		switch( type._kind )
 		{
-			vector<llvm_type_ptr> arg_types;
-			for (auto iter = type._specializations.begin(), end = type._specializations.end()
-				;  iter != end; ++iter)
+		case type_kinds::pointer:
+		case type_kinds::managed_pointer:
 			{
-				if (!context._type_library->is_void_type(**iter))
-					arg_types.push_back(context.type_ref_type(**iter).get());
+				llvm_type_ptr_opt llvm_ptr = context.type_ref_type( context._type_library->deref_ptr_type( type ) );
+				if ( llvm_ptr )
+					return PointerType::get( llvm_ptr.get(), 0 );
+				return llvm_type_ptr_opt();
 			}
-			//Create struct type definition to llvm.
-			return StructType::create(getGlobalContext(), arg_types);
-		}
-		else
-		{
-			if ( type._name == context._type_library->string_table()->register_str( "unqual" ) )
+		case type_kinds::tuple:
+			{
+				vector<llvm_type_ptr> arg_types;
+				for (auto iter = type._specializations.begin(), end = type._specializations.end()
+					;  iter != end; ++iter)
+				{
+					if (!context._type_library->is_void_type(**iter))
+						arg_types.push_back(context.type_ref_type(**iter).get());
+				}
+				//Create struct type definition to llvm.
+				return StructType::create(getGlobalContext(), arg_types);
+			}
+		case type_kinds::unqual:
 			{
 				Type* intType = IntegerType::getInt32Ty( getGlobalContext() );
 				return PointerType::getUnqual( intType );
 			}
-			if ( &type == &context._type_library->get_void_type() )
-				return Type::getVoidTy( getGlobalContext() );
-			if ( &type == &context._type_library->get_void_type() )
-				return llvm_type_ptr_opt();
-			//else we inserted something, so we need to ensure it is valid.
-			base_numeric_types::_enum val = context._type_library->to_base_numeric_type( type );
-			llvm_type_ptr base_type = nullptr;
-			switch( val )
+		case type_kinds::void_type:
+			return Type::getVoidTy( getGlobalContext() );
+		case type_kinds::base_numeric:
 			{
-		#define CCLJ_HANDLE_LIST_NUMERIC_TYPE( name )					\
-			case base_numeric_types::name: base_type					\
-				= llvm_helper::llvm_constant_map<base_numeric_types::name>::type(); break;
-				CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
-		#undef CCLJ_HANDLE_LIST_NUMERIC_TYPE
-			default:
-				throw runtime_error( "unable to find type" );
+				llvm_type_ptr base_type = nullptr;
+				switch( type._base_numeric_type )
+				{
+			#define CCLJ_HANDLE_LIST_NUMERIC_TYPE( name )					\
+				case base_numeric_types::name: base_type					\
+					= llvm_helper::llvm_constant_map<base_numeric_types::name>::type(); break;
+					CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
+			#undef CCLJ_HANDLE_LIST_NUMERIC_TYPE
+				default:
+					break;
+				}
+				if ( base_type == nullptr ) throw runtime_error( "unable to find type" );
+				return base_type;
 			}
-			if ( base_type == nullptr ) throw runtime_error( "unable to find type" );
-			return base_type;
+		default:
+			break;
 		}
+		throw runtime_error( "unable to find type" );
 	}
 
 }
@@ -0,0 +1,1934 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#include "precompile.h"
+#include "cclj/garbage_collector.h"
+#include "cclj/algo_util.h"
+#include "cclj/thread_exit_slot.h"
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <ostream>
+#include <fstream>
+
+using namespace cclj;
+
+namespace
+{
+	//Sits directly in front of every object the collector hands out.
+	struct gc_header
+	{
+		uint32_t	lock_count;
+		//position in the locked object list while lock_count is nonzero.  Free cells in
+		//generational blocks keep their length here instead.
+		uint32_t	locked_index;
+		uint16_t	size_class;
+		//bytes from the start of the allocation to the object (large objects only).
+		uint8_t		offset;
+		//set once a minor collection has released the object.
+		uint8_t		released;
+		//owning collector's slot in the registry, for the write barrier.
+		uint16_t	collector_index;
+		uint8_t		padding[2];
+	};
+
+	static_assert( sizeof( gc_header ) == 16, "gc header must stay 16 bytes" );
+
+	//Objects up to max_small_size (plus header) come from slabs of equally sized cells,
+	//one free list per 16 byte size class.  Everything else is allocated directly.
+	class gc_slabs : noncopyable
+	{
+	public:
+		enum
+		{
+			granularity = 16,
+			max_small_size = 1024,
+			class_count = max_small_size / granularity,
+			large_class = 0xffff,
+			slab_size = 64 * 1024,
+		};
+
+	private:
+		struct free_cell { free_cell* next; };
+
+		allocator_ptr		_allocator;
+		free_cell*			_free_lists[class_count];
+		//Cells a background sweep has freed, waiting for the allocating thread.
+		atomic<free_cell*>	_returned[class_count];
+		vector<uint8_t*>	_slabs;
+
+	public:
+		gc_slabs( allocator_ptr alloc )
+			: _allocator( alloc )
+		{
+			memset( _free_lists, 0, sizeof( _free_lists ) );
+			for ( size_t idx = 0; idx < class_count; ++idx )
+				_returned[idx].store( nullptr, std::memory_order_relaxed );
+		}
+
+		~gc_slabs()
+		{
+			for_each( _slabs.begin(), _slabs.end(), [this]( uint8_t* slab ) { _allocator->deallocate( slab ); } );
+		}
+
+		static uint16_t class_index( size_t cell_size )
+		{
+			if ( cell_size > max_small_size ) return large_class;
+			return static_cast<uint16_t>( ( cell_size - 1 ) / granularity );
+		}
+
+		static size_t class_size( uint16_t idx ) { return ( static_cast<size_t>( idx ) + 1 ) * granularity; }
+
+		const vector<uint8_t*>& slabs() const { return _slabs; }
+
+		//nullptr when a new slab is needed.
+		uint8_t* try_allocate( uint16_t idx )
+		{
+			if ( _free_lists[idx] == nullptr )
+			{
+				if ( _returned[idx].load( std::memory_order_relaxed ) == nullptr ) return nullptr;
+				_free_lists[idx] = _returned[idx].exchange( nullptr );
+			}
+			free_cell* retval = _free_lists[idx];
+			_free_lists[idx] = retval->next;
+			return reinterpret_cast<uint8_t*>( retval );
+		}
+
+		uint8_t* allocate( uint16_t idx, file_info alloc_info )
+		{
+			uint8_t* retval = try_allocate( idx );
+			if ( retval ) return retval;
+			size_t cell_size = class_size( idx );
+			uint8_t* slab = _allocator->allocate( slab_size, granularity, alloc_info );
+			_slabs.push_back( slab );
+			for ( size_t cell_idx = slab_size / cell_size; cell_idx > 0; --cell_idx )
+				deallocate( idx, slab + ( cell_idx - 1 ) * cell_size );
+			return try_allocate( idx );
+		}
+
+		//Called from the sweeper; the cells show up for allocation all at once.
+		void give_back( uint16_t idx, const vector<uint8_t*>& cells )
+		{
+			if ( cells.empty() ) return;
+			for ( size_t cell_idx = 0, end = cells.size() - 1; cell_idx < end; ++cell_idx )
+				reinterpret_cast<free_cell*>( cells[cell_idx] )->next = reinterpret_cast<free_cell*>( cells[cell_idx + 1] );
+			free_cell* head = reinterpret_cast<free_cell*>( cells.front() );
+			free_cell* tail = reinterpret_cast<free_cell*>( cells.back() );
+			free_cell* expected = _returned[idx].load( std::memory_order_relaxed );
+			do
+			{
+				tail->next = expected;
+			} while( !_returned[idx].compare_exchange_weak( expected, head ) );
+		}
+
+		void deallocate( uint16_t idx, uint8_t* cell )
+		{
+			free_cell* item = reinterpret_cast<free_cell*>( cell );
+			item->next = _free_lists[idx];
+			_free_lists[idx] = item;
+		}
+	};
+
+	//Blocks the generational collector bump allocates in.  Every cell in a block starts
+	//with a gc_header so a block can be walked front to back; free memory is a cell with
+	//size_class == free_class.
+	class gc_blocks : noncopyable
+	{
+	public:
+		enum
+		{
+			block_size = 64 * 1024,
+			free_class = 0xfffe,
+		};
+
+	private:
+		allocator_ptr		_allocator;
+		vector<uint8_t*>	_blocks;
+		//Blocks with free space that no nursery has taken.
+		vector<uint8_t*>	_recyclable;
+
+		//Merge neighbouring free cells and return the bytes still in use.
+		static size_t coalesce( uint8_t* block )
+		{
+			size_t used = 0;
+			uint8_t* free_start = nullptr;
+			for ( uint8_t* cell = block, *end = block + block_size; cell < end; )
+			{
+				size_t len = cell_size( cell );
+				if ( is_free( cell ) )
+				{
+					if ( free_start ) set_free( free_start, cell + len - free_start );
+					else free_start = cell;
+				}
+				else
+				{
+					free_start = nullptr;
+					used += len;
+				}
+				cell += len;
+			}
+			return used;
+		}
+
+	public:
+		gc_blocks( allocator_ptr alloc )
+			: _allocator( alloc )
+		{
+		}
+
+		~gc_blocks()
+		{
+			for_each( _blocks.begin(), _blocks.end(), [this]( uint8_t* block ) { _allocator->deallocate( block ); } );
+		}
+
+		static gc_header& cell_header( uint8_t* cell ) { return *reinterpret_cast<gc_header*>( cell ); }
+		static bool is_free( uint8_t* cell ) { return cell_header( cell ).size_class == free_class; }
+
+		static size_t cell_size( uint8_t* cell )
+		{
+			gc_header& header( cell_header( cell ) );
+			if ( header.size_class == free_class ) return header.locked_index;
+			return gc_slabs::class_size( header.size_class );
+		}
+
+		static void set_free( uint8_t* cell, size_t len )
+		{
+			gc_header& header( cell_header( cell ) );
+			memset( &header, 0, sizeof( gc_header ) );
+			header.size_class = free_class;
+			header.locked_index = static_cast<uint32_t>( len );
+		}
+
+		uint8_t* acquire( file_info alloc_info )
+		{
+			if ( !_recyclable.empty() )
+			{
+				uint8_t* retval = _recyclable.back();
+				_recyclable.pop_back();
+				return retval;
+			}
+			uint8_t* retval = _allocator->allocate( block_size, gc_slabs::granularity, alloc_info );
+			_blocks.push_back( retval );
+			set_free( retval, block_size );
+			return retval;
+		}
+
+		//Hand back a block a nursery was using.
+		void recycle( uint8_t* block )
+		{
+			if ( coalesce( block ) < block_size )
+				_recyclable.push_back( block );
+		}
+
+		size_t block_count() const { return _blocks.size(); }
+
+		//Take every block out of circulation ahead of a full collection's sweep, which
+		//recycles them again.  No nursery may be holding a block.
+		vector<uint8_t*> take_all()
+		{
+			_recyclable.clear();
+			return _blocks;
+		}
+
+		//Give recyclable blocks that are completely free back to the allocator.
+		void release_empty_blocks()
+		{
+			vector<uint8_t*> empty;
+			_recyclable.erase( remove_if( _recyclable.begin(), _recyclable.end(), [&]( uint8_t* block ) -> bool
+			{
+				if ( !is_free( block ) || cell_size( block ) != block_size ) return false;
+				empty.push_back( block );
+				return true;
+			} ), _recyclable.end() );
+			if ( empty.empty() ) return;
+			sort( empty.begin(), empty.end() );
+			_blocks.erase( remove_if( _blocks.begin(), _blocks.end(), [&]( uint8_t* block )
+			{
+				return binary_search( empty.begin(), empty.end(), block );
+			} ), _blocks.end() );
+			for_each( empty.begin(), empty.end(), [this]( uint8_t* block ) { _allocator->deallocate( block ); } );
+		}
+	};
+
+	//A thread's young generation: the free span it is bump allocating in, the blocks it
+	//has taken since the last collection and the objects it allocated since then.
+	struct nursery : noncopyable
+	{
+		uint8_t*			_bump;
+		uint8_t*			_limit;
+		uint8_t*			_block;
+		//next cell of _block to look at for free space.
+		uint8_t*			_cursor;
+		vector<uint8_t*>	_touched_blocks;
+		obj_ptr_list		_objects;
+		bool				_claimed;
+
+		nursery()
+			: _bump( nullptr )
+			, _limit( nullptr )
+			, _block( nullptr )
+			, _cursor( nullptr )
+			, _claimed( false )
+		{
+		}
+
+		uint8_t* try_bump( size_t len )
+		{
+			if ( static_cast<size_t>( _limit - _bump ) < len ) return nullptr;
+			uint8_t* retval = _bump;
+			_bump += len;
+			return retval;
+		}
+
+		//Give the unused end of the current span back to the block.
+		void retire_span()
+		{
+			if ( _bump != _limit )
+				gc_blocks::set_free( _bump, _limit - _bump );
+			_bump = _limit = nullptr;
+		}
+
+		bool next_span()
+		{
+			if ( _block == nullptr ) return false;
+			for ( uint8_t* end = _block + gc_blocks::block_size; _cursor < end; )
+			{
+				uint8_t* cell = _cursor;
+				_cursor += gc_blocks::cell_size( cell );
+				if ( gc_blocks::is_free( cell ) )
+				{
+					_bump = cell;
+					_limit = _cursor;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void take_block( uint8_t* block )
+		{
+			_block = _cursor = block;
+			_touched_blocks.push_back( block );
+		}
+
+		//Collections start by leaving every block walkable.
+		void reset()
+		{
+			retire_span();
+			_block = _cursor = nullptr;
+		}
+	};
+
+	typedef shared_ptr<nursery> nursery_ptr;
+
+	//The nurseries of one generational collector.  Threads claim one the first time they
+	//allocate and give it back when they exit.
+	struct nursery_heap : noncopyable
+	{
+		std::mutex				_mutex;
+		vector<nursery_ptr>		_nurseries;
+		atomic<bool>			_closed;
+
+		nursery_heap() : _closed( false ) {}
+
+		nursery* claim()
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			for ( size_t idx = 0, end = _nurseries.size(); idx < end; ++idx )
+			{
+				if ( !_nurseries[idx]->_claimed )
+				{
+					_nurseries[idx]->_claimed = true;
+					return _nurseries[idx].get();
+				}
+			}
+			_nurseries.push_back( make_shared<nursery>() );
+			_nurseries.back()->_claimed = true;
+			return _nurseries.back().get();
+		}
+
+		void unclaim( nursery* item )
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			item->_claimed = false;
+		}
+
+		vector<nursery*> nurseries()
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			vector<nursery*> retval;
+			for_each( _nurseries.begin(), _nurseries.end(), [&]( nursery_ptr& item ) { retval.push_back( item.get() ); } );
+			return retval;
+		}
+	};
+
+	typedef shared_ptr<nursery_heap> nursery_heap_ptr;
+
+	//The nurseries the current thread has claimed, one per live collector it allocated from.
+	struct nursery_bindings
+	{
+		vector<pair<nursery_heap_ptr, nursery*> > _bindings;
+
+		~nursery_bindings()
+		{
+			for_each( _bindings.begin(), _bindings.end(), []( pair<nursery_heap_ptr, nursery*>& binding )
+			{
+				binding.first->unclaim( binding.second );
+			} );
+		}
+
+		nursery& find_nursery( const nursery_heap_ptr& heap )
+		{
+			for ( size_t idx = 0, end = _bindings.size(); idx < end; ++idx )
+			{
+				if ( _bindings[idx].first == heap )
+					return *_bindings[idx].second;
+			}
+			//Drop collectors that have gone away.
+			_bindings.erase( remove_if( _bindings.begin(), _bindings.end(), []( pair<nursery_heap_ptr, nursery*>& binding )
+			{
+				return binding.first->_closed.load();
+			} ), _bindings.end() );
+			nursery* retval = heap->claim();
+			_bindings.push_back( make_pair( heap, retval ) );
+			return *retval;
+		}
+	};
+
+	CCLJ_THREAD_LOCAL nursery_bindings* g_nursery_bindings = nullptr;
+
+	void CCLJ_THREAD_EXIT_CALL release_nursery_bindings( void* value )
+	{
+		g_nursery_bindings = nullptr;
+		delete static_cast<nursery_bindings*>( value );
+	}
+
+	thread_exit_slot g_nursery_bindings_exit = { &release_nursery_bindings };
+
+	nursery_bindings& current_nursery_bindings()
+	{
+		if ( g_nursery_bindings == nullptr )
+		{
+			g_nursery_bindings = new nursery_bindings();
+			g_nursery_bindings_exit.set( g_nursery_bindings );
+		}
+		return *g_nursery_bindings;
+	}
+
+	//Threads that sit idle between collections and run a job together when asked.
+	//The thread calling run is worker 0.
+	class gc_thread_pool : noncopyable
+	{
+		vector<std::thread>			_threads;
+		std::mutex					_mutex;
+		std::condition_variable		_start;
+		std::condition_variable		_finished;
+		function<void (uint32_t)>	_job;
+		uint64_t					_generation;
+		uint32_t					_running;
+		bool						_exit;
+
+		void thread_main( uint32_t worker_idx )
+		{
+			uint64_t seen_generation = 0;
+			for(;;)
+			{
+				function<void (uint32_t)> job;
+				{
+					std::unique_lock<std::mutex> lock( _mutex );
+					_start.wait( lock, [&]() { return _exit || _generation != seen_generation; } );
+					if ( _exit ) return;
+					seen_generation = _generation;
+					job = _job;
+				}
+				job( worker_idx );
+				std::lock_guard<std::mutex> lock( _mutex );
+				if ( --_running == 0 )
+					_finished.notify_one();
+			}
+		}
+
+	public:
+		gc_thread_pool( uint32_t thread_count )
+			: _generation( 0 )
+			, _running( 0 )
+			, _exit( false )
+		{
+			for ( uint32_t idx = 1; idx < thread_count; ++idx )
+				_threads.push_back( std::thread( [this, idx]() { thread_main( idx ); } ) );
+		}
+
+		~gc_thread_pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock( _mutex );
+				_exit = true;
+			}
+			_start.notify_all();
+			for_each( _threads.begin(), _threads.end(), []( std::thread& thread ) { thread.join(); } );
+		}
+
+		uint32_t thread_count() const { return static_cast<uint32_t>( _threads.size() ) + 1; }
+
+		void run( function<void (uint32_t)> job )
+		{
+			if ( _threads.empty() )
+			{
+				job( 0 );
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock( _mutex );
+				_job = job;
+				_running = static_cast<uint32_t>( _threads.size() );
+				++_generation;
+			}
+			_start.notify_all();
+			job( 0 );
+			std::unique_lock<std::mutex> lock( _mutex );
+			_finished.wait( lock, [this]() { return _running == 0; } );
+		}
+	};
+
+	//Runs one job at a time on its own thread so a collection can hand off releasing
+	//dead objects and get back to the mutator.
+	class gc_background_thread : noncopyable
+	{
+		std::mutex					_mutex;
+		std::condition_variable		_changed;
+		function<void ()>			_job;
+		bool						_busy;
+		bool						_exit;
+		std::thread					_thread;
+
+		void thread_main()
+		{
+			for(;;)
+			{
+				function<void ()> job;
+				{
+					std::unique_lock<std::mutex> lock( _mutex );
+					_changed.wait( lock, [this]() { return _exit || _job; } );
+					if ( !_job ) return;
+					job.swap( _job );
+				}
+				job();
+				{
+					std::lock_guard<std::mutex> lock( _mutex );
+					_busy = false;
+				}
+				_changed.notify_all();
+			}
+		}
+
+	public:
+		gc_background_thread()
+			: _busy( false )
+			, _exit( false )
+		{
+			_thread = std::thread( [this]() { thread_main(); } );
+		}
+
+		~gc_background_thread()
+		{
+			wait();
+			{
+				std::lock_guard<std::mutex> lock( _mutex );
+				_exit = true;
+			}
+			_changed.notify_all();
+			_thread.join();
+		}
+
+		void post( function<void ()> job )
+		{
+			wait();
+			{
+				std::lock_guard<std::mutex> lock( _mutex );
+				_job = job;
+				_busy = true;
+			}
+			_changed.notify_all();
+		}
+
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock( _mutex );
+			_changed.wait( lock, [this]() { return !_busy; } );
+		}
+
+		bool busy()
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			return _busy;
+		}
+	};
+
+	//End of an incremental step's budget.  The clock is only read every few units of
+	//work; a unit is scanning or sweeping one object.
+	class gc_deadline
+	{
+		typedef std::chrono::steady_clock clock;
+		enum { check_interval = 16 };
+
+		clock::time_point	_end;
+		uint32_t			_count;
+		bool				_bounded;
+
+		gc_deadline() : _count( 0 ), _bounded( false ) {}
+
+	public:
+		gc_deadline( uint32_t budget_us )
+			: _end( clock::now() + std::chrono::microseconds( budget_us ) )
+			, _count( 0 )
+			, _bounded( true )
+		{
+		}
+
+		static gc_deadline unbounded() { return gc_deadline(); }
+
+		bool expired()
+		{
+			if ( !_bounded || ++_count % check_interval ) return false;
+			return clock::now() >= _end;
+		}
+	};
+
+	class gc_stopwatch
+	{
+		typedef std::chrono::steady_clock clock;
+		clock::time_point _start;
+	public:
+		gc_stopwatch() : _start( clock::now() ) {}
+		double elapsed_ms() const
+		{
+			return std::chrono::duration<double, std::milli>( clock::now() - _start ).count();
+		}
+	};
+
+	class gc_base;
+
+	//Collectors by the index stored in their objects' headers so the write barrier can
+	//find the collector an object belongs to.
+	class gc_registry : noncopyable
+	{
+	public:
+		enum { max_collectors = 4096 };
+
+	private:
+		std::mutex			_mutex;
+		atomic<gc_base*>	_collectors[max_collectors];
+
+	public:
+		gc_registry()
+		{
+			for ( size_t idx = 0; idx < max_collectors; ++idx )
+				_collectors[idx].store( nullptr, std::memory_order_relaxed );
+		}
+
+		uint16_t add( gc_base* collector )
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			for ( size_t idx = 0; idx < max_collectors; ++idx )
+			{
+				if ( _collectors[idx].load( std::memory_order_relaxed ) == nullptr )
+				{
+					_collectors[idx].store( collector );
+					return static_cast<uint16_t>( idx );
+				}
+			}
+			throw runtime_error( "too many garbage collectors" );
+		}
+
+		void remove( uint16_t index ) { _collectors[index].store( nullptr ); }
+		gc_base* find( uint16_t index ) { return _collectors[index].load(); }
+	};
+
+	gc_registry g_gc_registry;
+
+	//Per thread mark state.  The private stack is only touched by its owner; when it
+	//grows the oldest half is published to the shared deque where idle threads can
+	//steal it.
+	struct mark_worker : noncopyable
+	{
+		enum { spill_threshold = 256 };
+
+		obj_ptr_list				_stack;
+		std::mutex					_shared_mutex;
+		std::deque<gc_object*>		_shared;
+		atomic<size_t>				_shared_size;
+
+		mark_worker() : _shared_size( 0 ) {}
+
+		void publish( gc_object* obj )
+		{
+			std::lock_guard<std::mutex> lock( _shared_mutex );
+			_shared.push_back( obj );
+			_shared_size.store( _shared.size() );
+		}
+
+		void spill()
+		{
+			if ( _stack.size() < spill_threshold || _shared_size.load( std::memory_order_relaxed ) )
+				return;
+			size_t count = _stack.size() / 2;
+			std::lock_guard<std::mutex> lock( _shared_mutex );
+			_shared.insert( _shared.end(), _stack.begin(), _stack.begin() + count );
+			_stack.erase( _stack.begin(), _stack.begin() + count );
+			_shared_size.store( _shared.size() );
+		}
+
+		//Move half (at least one) of victim's shared work onto this worker's stack.
+		bool take_from( mark_worker& victim )
+		{
+			if ( victim._shared_size.load( std::memory_order_relaxed ) == 0 )
+				return false;
+			std::lock_guard<std::mutex> lock( victim._shared_mutex );
+			size_t count = ( victim._shared.size() + 1 ) / 2;
+			if ( count == 0 ) return false;
+			_stack.insert( _stack.end(), victim._shared.begin(), victim._shared.begin() + count );
+			victim._shared.erase( victim._shared.begin(), victim._shared.begin() + count );
+			victim._shared_size.store( victim._shared.size() );
+			return true;
+		}
+	};
+
+	//Marks from the roots on every pool thread.  Each thread drains its own stack,
+	//then its own shared deque, then steals.  A thread that finds nothing counts
+	//itself idle; a thread only goes idle with its own stack and deque empty and
+	//work only moves between deques through active threads, so once every thread
+	//is idle there is no work left anywhere.
+	class parallel_marker : noncopyable
+	{
+		gc_thread_pool&				_pool;
+		vector<shared_ptr<mark_worker> > _workers;
+		atomic<uint32_t>			_idle_count;
+
+		bool find_work( uint32_t worker_idx )
+		{
+			mark_worker& self( *_workers[worker_idx] );
+			if ( self.take_from( self ) ) return true;
+			for ( size_t offset = 1, end = _workers.size(); offset < end; ++offset )
+			{
+				if ( self.take_from( *_workers[( worker_idx + offset ) % end] ) )
+					return true;
+			}
+			return false;
+		}
+
+		bool any_shared_work()
+		{
+			for ( size_t idx = 0, end = _workers.size(); idx < end; ++idx )
+				if ( _workers[idx]->_shared_size.load( std::memory_order_relaxed ) ) return true;
+			return false;
+		}
+
+		void mark_thread( uint32_t worker_idx, gc_object_flag_values::val current_mark )
+		{
+			mark_worker& self( *_workers[worker_idx] );
+			mark_buffer buffer( self._stack, current_mark );
+			uint32_t worker_count = static_cast<uint32_t>( _workers.size() );
+			for(;;)
+			{
+				while( !self._stack.empty() )
+				{
+					gc_object* obj = self._stack.back();
+					self._stack.pop_back();
+					if ( obj->gc_only_writeable_flags().try_set( current_mark ) )
+					{
+						obj->mark_references( buffer );
+						if ( worker_count > 1 )
+							self.spill();
+					}
+				}
+				if ( find_work( worker_idx ) )
+					continue;
+				if ( worker_count == 1 )
+					return;
+				_idle_count.fetch_add( 1 );
+				for(;;)
+				{
+					if ( _idle_count.load() == worker_count )
+						return;
+					if ( any_shared_work() )
+					{
+						_idle_count.fetch_sub( 1 );
+						break;
+					}
+					std::this_thread::yield();
+				}
+			}
+		}
+
+	public:
+		parallel_marker( gc_thread_pool& pool )
+			: _pool( pool )
+			, _idle_count( 0 )
+		{
+			for ( uint32_t idx = 0, end = pool.thread_count(); idx < end; ++idx )
+				_workers.push_back( make_shared<mark_worker>() );
+		}
+
+		void mark( const obj_ptr_list& roots, gc_object_flag_values::val current_mark )
+		{
+			//Deal the roots out so every thread starts with work.
+			for ( size_t idx = 0, end = roots.size(); idx < end; ++idx )
+				_workers[idx % _workers.size()]->publish( roots[idx] );
+			_idle_count.store( 0 );
+			_pool.run( [this, current_mark]( uint32_t worker_idx ) { mark_thread( worker_idx, current_mark ); } );
+		}
+	};
+
+	//Roots, locking and marking shared by the collectors.
+	class gc_base : public garbage_collector
+	{
+	protected:
+		allocator_ptr				_allocator;
+		//Guards the allocator and the collector's memory lists while the sweeper runs.
+		std::mutex					_mutex;
+		obj_ptr_list				_locked_objects;
+		obj_ptr_list				_dead_objects;
+		//Dead objects handed to the sweeper.
+		obj_ptr_list				_sweeping;
+		gc_thread_pool				_mark_threads;
+		parallel_marker				_marker;
+		shared_ptr<gc_background_thread>	_sweeper;
+		uint16_t					_collector_index;
+		//Set while an incremental mark runs; objects the barrier reports go to _satb.
+		atomic<bool>				_marking;
+		//The first _unscanned_roots locked objects have not been scanned by the running
+		//incremental mark.
+		size_t						_unscanned_roots;
+		std::mutex					_satb_mutex;
+		obj_ptr_list				_satb;
+		//Alternates between mark_left and mark_right each full collection so marks never
+		//have to be cleared before marking.
+		gc_object_flag_values::val	_current_mark;
+		//Bytes held by large objects; guarded by _mutex.
+		size_t						_large_bytes;
+		gc_stats					_stats;
+		gc_collection_callback		_callback;
+
+		static gc_object_flag_values::val other_mark( gc_object_flag_values::val mark )
+		{
+			return mark == gc_object_flag_values::mark_left ? gc_object_flag_values::mark_right
+															: gc_object_flag_values::mark_left;
+		}
+
+		//Returns the allocation; object_memory is where the object goes.  The allocation
+		//starts with its length.
+		uint8_t* allocate_large( size_t len, uint8_t alignment, file_info alloc_info, uint8_t*& object_memory )
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			size_t offset = align_number( sizeof( gc_header ) + sizeof( size_t ), std::max<uint8_t>( alignment, 1 ) );
+			uint8_t* retval = _allocator->allocate( offset + len, std::max<uint8_t>( alignment, sizeof( void* ) ), alloc_info );
+			*reinterpret_cast<size_t*>( retval ) = offset + len;
+			_large_bytes += offset + len;
+			object_memory = retval + offset;
+			return retval;
+		}
+
+		void free_large( gc_object& obj )
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			_large_bytes -= cell_bytes( obj );
+			_allocator->deallocate( reinterpret_cast<uint8_t*>( &obj ) - header( obj ).offset );
+		}
+
+		void collection_finished( const gc_collection_stats& collection )
+		{
+			_stats.add( collection );
+			if ( _callback )
+				_callback( collection );
+		}
+
+		//Finish whatever collection work is outstanding.
+		virtual void settle() = 0;
+		//Memory held from the allocator.
+		virtual size_t reserved_bytes() = 0;
+
+		//Sets up the header in front of object_memory and runs the constructor.
+		//on_failure frees the memory if the constructor throws.
+		template<typename tfailure_handler>
+		gc_object& construct( uint8_t* memory, uint8_t* object_memory, uint16_t size_class, size_t len
+							, object_constructor& constructor, tfailure_handler on_failure )
+		{
+			gc_header* obj_header = reinterpret_cast<gc_header*>( object_memory ) - 1;
+			memset( obj_header, 0, sizeof( gc_header ) );
+			obj_header->size_class = size_class;
+			obj_header->offset = static_cast<uint8_t>( object_memory - memory );
+			obj_header->collector_index = _collector_index;
+
+			gc_object* retval = nullptr;
+			try
+			{
+				retval = constructor( object_memory, len );
+			}
+			catch( ... )
+			{
+				on_failure();
+				throw;
+			}
+			if ( reinterpret_cast<uint8_t*>( retval ) != object_memory )
+				throw runtime_error( "gc object constructor must construct the object at the start of its memory" );
+			return *retval;
+		}
+
+	public:
+		static gc_header& header( gc_object& obj )
+		{
+			return *( reinterpret_cast<gc_header*>( &obj ) - 1 );
+		}
+
+		static size_t cell_bytes( gc_object& obj )
+		{
+			gc_header& obj_header( header( obj ) );
+			if ( obj_header.size_class != gc_slabs::large_class )
+				return gc_slabs::class_size( obj_header.size_class );
+			return *reinterpret_cast<size_t*>( reinterpret_cast<uint8_t*>( &obj ) - obj_header.offset );
+		}
+
+		gc_base( allocator_ptr alloc, const gc_options& options )
+			: _allocator( alloc )
+			, _mark_threads( std::max( options._mark_thread_count, 1U ) )
+			, _marker( _mark_threads )
+			, _unscanned_roots( 0 )
+			, _current_mark( gc_object_flag_values::mark_left )
+			, _large_bytes( 0 )
+		{
+			if ( options._background_sweep )
+				_sweeper = make_shared<gc_background_thread>();
+			_marking.store( false );
+			_collector_index = g_gc_registry.add( this );
+		}
+
+		~gc_base()
+		{
+			g_gc_registry.remove( _collector_index );
+		}
+
+		void shade_object( gc_object& obj )
+		{
+			if ( !_marking.load() || obj.flags().has_value( _current_mark ) ) return;
+			std::lock_guard<std::mutex> lock( _satb_mutex );
+			if ( _marking.load() )
+				_satb.push_back( &obj );
+		}
+
+		virtual void finish_sweep()
+		{
+			if ( _sweeper )
+				_sweeper->wait();
+		}
+
+		virtual void lock( gc_object& obj )
+		{
+			gc_header& obj_header( header( obj ) );
+			if ( obj_header.lock_count == 0 )
+			{
+				obj_header.locked_index = static_cast<uint32_t>( _locked_objects.size() );
+				_locked_objects.push_back( &obj );
+				obj.gc_only_writeable_flags().set_locked( true );
+				//Roots are scanned in place, so one that shows up during a mark is shaded.
+				shade_object( obj );
+			}
+			++obj_header.lock_count;
+		}
+
+		virtual void unlock( gc_object& obj )
+		{
+			gc_header& obj_header( header( obj ) );
+			if ( obj_header.lock_count == 0 )
+				throw runtime_error( "unlocking an object that is not locked" );
+			--obj_header.lock_count;
+			if ( obj_header.lock_count == 0 )
+			{
+				//swap remove so unlocking stays O(1)
+				gc_object* last = _locked_objects.back();
+				_locked_objects[obj_header.locked_index] = last;
+				header( *last ).locked_index = obj_header.locked_index;
+				_locked_objects.pop_back();
+				obj.gc_only_writeable_flags().set_locked( false );
+				//A root the running mark hasn't reached yet still belongs to its snapshot.
+				_unscanned_roots = std::min( _unscanned_roots, _locked_objects.size() );
+				shade_object( obj );
+			}
+		}
+
+		virtual const_gc_object_raw_ptr_buffer locked_objects() { return _locked_objects; }
+
+		virtual allocator_ptr allocator() { return _allocator; }
+
+		virtual gc_stats stats() { return _stats; }
+
+		virtual void set_collection_callback( gc_collection_callback callback ) { _callback = callback; }
+
+		virtual gc_heap_stats heap_stats()
+		{
+			settle();
+			gc_heap_stats retval;
+			for ( uint16_t idx = 0; idx < gc_slabs::class_count; ++idx )
+				retval._size_classes.push_back( gc_size_class_stats( gc_slabs::class_size( idx ) ) );
+			const_gc_object_raw_ptr_buffer objects( all_objects() );
+			for_each( objects.begin(), objects.end(), [&]( gc_object* obj )
+			{
+				uint16_t size_class = header( *obj ).size_class;
+				gc_size_class_stats& entry( size_class == gc_slabs::large_class ? retval._large_objects
+																				: retval._size_classes[size_class] );
+				size_t bytes = cell_bytes( *obj );
+				++entry._objects;
+				entry._bytes += bytes;
+				++retval._objects;
+				retval._object_bytes += bytes;
+			} );
+			retval._reserved_bytes = reserved_bytes();
+			return retval;
+		}
+
+		virtual void write_heap_snapshot( std::ostream& out );
+	};
+
+	//The object graph for heap snapshots, with immediate dominators from the iterative
+	//algorithm of Cooper, Harvey and Kennedy.  Nodes are object indexes plus a root after
+	//them whose successors are the locked objects.
+	class heap_graph : noncopyable
+	{
+		enum : uint32_t { undefined = 0xffffffff };
+
+		//Successors of each node, root last.
+		vector<uint32_t>			_edge_starts;
+		vector<uint32_t>			_edges;
+		vector<uint32_t>			_pred_starts;
+		vector<uint32_t>			_preds;
+		vector<uint32_t>			_postorder;
+		vector<uint32_t>			_postorder_index;
+		vector<uint32_t>			_idom;
+
+		uint32_t root() const { return static_cast<uint32_t>( _edge_starts.size() - 2 ); }
+
+		void depth_first( uint32_t start )
+		{
+			vector<pair<uint32_t, uint32_t> > stack;
+			_postorder_index[start] = 0;
+			stack.push_back( make_pair( start, _edge_starts[start] ) );
+			while( !stack.empty() )
+			{
+				pair<uint32_t, uint32_t>& top( stack.back() );
+				if ( top.second == _edge_starts[top.first + 1] )
+				{
+					_postorder_index[top.first] = static_cast<uint32_t>( _postorder.size() );
+					_postorder.push_back( top.first );
+					stack.pop_back();
+					continue;
+				}
+				uint32_t next = _edges[top.second++];
+				if ( _postorder_index[next] == undefined )
+				{
+					_postorder_index[next] = 0;
+					stack.push_back( make_pair( next, _edge_starts[next] ) );
+				}
+			}
+		}
+
+		uint32_t intersect( uint32_t lhs, uint32_t rhs ) const
+		{
+			while( lhs != rhs )
+			{
+				while( _postorder_index[lhs] < _postorder_index[rhs] ) lhs = _idom[lhs];
+				while( _postorder_index[rhs] < _postorder_index[lhs] ) rhs = _idom[rhs];
+			}
+			return lhs;
+		}
+
+	public:
+		//edge_starts has an entry per object plus two (the root and the end).  Objects the
+		//root's edges don't reach are added to them.
+		heap_graph( vector<uint32_t>& edge_starts, vector<uint32_t>& edges )
+		{
+			_edge_starts.swap( edge_starts );
+			_edges.swap( edges );
+			uint32_t root_node = root();
+			_postorder_index.assign( root_node + 1, undefined );
+			_postorder_index[root_node] = 0;
+			for ( uint32_t idx = _edge_starts[root_node], end = _edge_starts[root_node + 1]; idx < end; ++idx )
+				if ( _postorder_index[_edges[idx]] == undefined ) depth_first( _edges[idx] );
+			for ( uint32_t node = 0; node < root_node; ++node )
+			{
+				if ( _postorder_index[node] == undefined )
+				{
+					_edges.push_back( node );
+					depth_first( node );
+				}
+			}
+			_edge_starts[root_node + 1] = static_cast<uint32_t>( _edges.size() );
+			_postorder_index[root_node] = static_cast<uint32_t>( _postorder.size() );
+			_postorder.push_back( root_node );
+
+			_pred_starts.assign( root_node + 2, 0 );
+			for_each( _edges.begin(), _edges.end(), [this]( uint32_t node ) { ++_pred_starts[node + 1]; } );
+			for ( size_t idx = 1; idx < _pred_starts.size(); ++idx )
+				_pred_starts[idx] += _pred_starts[idx - 1];
+			_preds.resize( _edges.size() );
+			vector<uint32_t> fill( _pred_starts.begin(), _pred_starts.end() - 1 );
+			for ( uint32_t node = 0; node <= root_node; ++node )
+				for ( uint32_t idx = _edge_starts[node], end = _edge_starts[node + 1]; idx < end; ++idx )
+					_preds[fill[_edges[idx]]++] = node;
+
+			_idom.assign( root_node + 1, undefined );
+			_idom[root_node] = root_node;
+			for ( bool changed = true; changed; )
+			{
+				changed = false;
+				for ( size_t order = _postorder.size() - 1; order > 0; --order )
+				{
+					uint32_t node = _postorder[order - 1];
+					uint32_t new_idom = undefined;
+					for ( uint32_t idx = _pred_starts[node], end = _pred_starts[node + 1]; idx < end; ++idx )
+					{
+						uint32_t pred = _preds[idx];
+						if ( _idom[pred] == undefined ) continue;
+						new_idom = new_idom == undefined ? pred : intersect( pred, new_idom );
+					}
+					if ( _idom[node] != new_idom )
+					{
+						_idom[node] = new_idom;
+						changed = true;
+					}
+				}
+			}
+		}
+
+		const vector<uint32_t>& edge_starts() const { return _edge_starts; }
+		const vector<uint32_t>& edges() const { return _edges; }
+
+		//sizes has an entry per object.
+		vector<size_t> retained_sizes( const vector<size_t>& sizes ) const
+		{
+			vector<size_t> retval( sizes );
+			retval.push_back( 0 );
+			//A node's dominators come after it in postorder.
+			for ( size_t order = 0, end = _postorder.size() - 1; order < end; ++order )
+			{
+				uint32_t node = _postorder[order];
+				retval[_idom[node]] += retval[node];
+			}
+			retval.pop_back();
+			return retval;
+		}
+	};
+
+	void gc_base::write_heap_snapshot( std::ostream& out )
+	{
+		settle();
+		const_gc_object_raw_ptr_buffer objects( all_objects() );
+		uint32_t count = static_cast<uint32_t>( objects.size() );
+		unordered_map<gc_object*, uint32_t> ids;
+		ids.reserve( count );
+		for ( uint32_t idx = 0; idx < count; ++idx )
+			ids[objects[idx]] = idx;
+
+		vector<uint32_t> edge_starts( 1, 0 );
+		vector<uint32_t> edges;
+		obj_ptr_list references;
+		mark_buffer buffer( references, gc_object_flag_values::unmarked );
+		auto add_edges = [&]( const obj_ptr_list& targets )
+		{
+			for_each( targets.begin(), targets.end(), [&]( gc_object* target )
+			{
+				auto iter = ids.find( target );
+				if ( iter != ids.end() )
+					edges.push_back( iter->second );
+			} );
+			edge_starts.push_back( static_cast<uint32_t>( edges.size() ) );
+		};
+		for_each( objects.begin(), objects.end(), [&]( gc_object* obj )
+		{
+			references.clear();
+			obj->mark_references( buffer );
+			add_edges( references );
+		} );
+		add_edges( _locked_objects );
+
+		heap_graph graph( edge_starts, edges );
+		vector<size_t> sizes;
+		for_each( objects.begin(), objects.end(), [&]( gc_object* obj ) { sizes.push_back( cell_bytes( *obj ) ); } );
+		vector<size_t> retained( graph.retained_sizes( sizes ) );
+
+		out << "# cclj heap snapshot: id user_flags size retained_size references..." << std::endl;
+		out << "roots";
+		for_each( _locked_objects.begin(), _locked_objects.end(), [&]( gc_object* obj ) { out << " " << ids[obj]; } );
+		out << std::endl;
+		for ( uint32_t idx = 0; idx < count; ++idx )
+		{
+			out << idx << " " << objects[idx]->user_flags() << " " << sizes[idx] << " " << retained[idx];
+			for ( uint32_t edge = graph.edge_starts()[idx], end = graph.edge_starts()[idx + 1]; edge < end; ++edge )
+				out << " " << graph.edges()[edge];
+			out << "\n";
+		}
+		out.flush();
+	}
+
+	class mark_sweep_gc : public gc_base
+	{
+		gc_slabs					_slabs;
+		obj_ptr_list				_all_objects;
+		vector<uint8_t*>			_sweeping_slabs;
+		vector<uint8_t*>			_slab_cells;
+
+		struct incremental_phases
+		{
+			enum val
+			{
+				idle,
+				marking,
+				sweeping,
+				freeing,
+				merging,
+			};
+		};
+
+		incremental_phases::val		_phase;
+		gc_collection_stats			_incremental;
+		obj_ptr_list				_gray;
+		//The objects that existed when the incremental mark finished, partitioned in place
+		//into survivors followed by dead objects.
+		obj_ptr_list				_sweep_list;
+		size_t						_sweep_index;
+		size_t						_survivor_count;
+		size_t						_free_index;
+		//Survivors followed by the objects allocated during the collection; becomes
+		//_all_objects once the merge catches up with allocation.
+		obj_ptr_list				_merged;
+		size_t						_merge_index;
+
+		void free_object_memory( gc_object& obj )
+		{
+			gc_header& obj_header( header( obj ) );
+			if ( obj_header.size_class == gc_slabs::large_class )
+				free_large( obj );
+			else
+				_slabs.deallocate( obj_header.size_class, reinterpret_cast<uint8_t*>( &obj_header ) );
+		}
+
+		void mark()
+		{
+			_marker.mark( _locked_objects, _current_mark );
+		}
+
+		void sweep( gc_collection_stats& collection )
+		{
+			gc_object_flag_values::val previous_mark = other_mark( _current_mark );
+			_dead_objects.clear();
+			auto new_end = remove_if( _all_objects.begin(), _all_objects.end(), [&]( gc_object* obj ) -> bool
+			{
+				gc_object_flags& flags( obj->gc_only_writeable_flags() );
+				if ( flags.has_value( _current_mark ) )
+				{
+					flags.set( previous_mark, false );
+					++collection._objects_marked;
+					collection._bytes_marked += cell_bytes( *obj );
+					return false;
+				}
+				++collection._objects_swept;
+				collection._bytes_swept += cell_bytes( *obj );
+				_dead_objects.push_back( obj );
+				return true;
+			} );
+			_all_objects.erase( new_end, _all_objects.end() );
+			if ( _sweeper )
+			{
+				post_background_reclaim();
+				return;
+			}
+			//Release everything before freeing anything; destructors of dead objects may
+			//still touch other dead objects (refcount pointers in a cycle).
+			for_each( _dead_objects.begin(), _dead_objects.end(), []( gc_object* obj ) { obj->gc_release(); } );
+			for_each( _dead_objects.begin(), _dead_objects.end(), [this]( gc_object* obj ) { free_object_memory( *obj ); } );
+			_dead_objects.clear();
+		}
+
+		//Runs on the sweeper.  Once every dead object is released the cells go back a
+		//slab at a time so allocation can use them before the whole sweep is done.
+		void background_reclaim()
+		{
+			{
+				//Allocation adds slabs under the lock.
+				std::lock_guard<std::mutex> lock( _mutex );
+				_sweeping_slabs = _slabs.slabs();
+			}
+			for_each( _sweeping.begin(), _sweeping.end(), []( gc_object* obj ) { obj->gc_release(); } );
+			sort( _sweeping.begin(), _sweeping.end() );
+			sort( _sweeping_slabs.begin(), _sweeping_slabs.end() );
+			uint8_t* current_slab = nullptr;
+			uint16_t current_class = 0;
+			for_each( _sweeping.begin(), _sweeping.end(), [&]( gc_object* obj )
+			{
+				gc_header& obj_header( header( *obj ) );
+				if ( obj_header.size_class == gc_slabs::large_class )
+				{
+					free_large( *obj );
+					return;
+				}
+				uint8_t* cell = reinterpret_cast<uint8_t*>( &obj_header );
+				uint8_t* slab = *( upper_bound( _sweeping_slabs.begin(), _sweeping_slabs.end(), cell ) - 1 );
+				if ( slab != current_slab )
+				{
+					_slabs.give_back( current_class, _slab_cells );
+					_slab_cells.clear();
+					current_slab = slab;
+					current_class = obj_header.size_class;
+				}
+				_slab_cells.push_back( cell );
+			} );
+			_slabs.give_back( current_class, _slab_cells );
+			_slab_cells.clear();
+			_sweeping.clear();
+		}
+
+		void post_background_reclaim()
+		{
+			_sweeping.swap( _dead_objects );
+			_sweeper->post( [this]() { background_reclaim(); } );
+		}
+
+		//Roots are gray from the start and scanned where they are; black objects have the
+		//current mark and white ones don't.  Objects allocated while marking are black.
+		void start_incremental()
+		{
+			_current_mark = other_mark( _current_mark );
+			_incremental = gc_collection_stats( gc_collection_kinds::incremental );
+			_unscanned_roots = _locked_objects.size();
+			_phase = incremental_phases::marking;
+			_marking.store( true );
+			++incremental_marks;
+		}
+
+		//Move the barrier's objects onto the gray stack.  If there are none marking is
+		//done, which is decided under the lock so the barrier can't add one afterwards.
+		bool take_satb()
+		{
+			std::lock_guard<std::mutex> lock( _satb_mutex );
+			if ( _satb.empty() )
+			{
+				_marking.store( false );
+				return false;
+			}
+			//Only called with an empty gray stack.
+			_gray.swap( _satb );
+			return true;
+		}
+
+		bool mark_step( gc_deadline& deadline )
+		{
+			mark_buffer buffer( _gray, _current_mark );
+			do
+			{
+				//Roots go from the back so unlocking, which moves the last root, never
+				//moves an unscanned one behind the scan.
+				while( !_gray.empty() || _unscanned_roots )
+				{
+					if ( deadline.expired() ) return false;
+					gc_object* obj;
+					if ( _gray.empty() )
+						obj = _locked_objects[--_unscanned_roots];
+					else
+					{
+						obj = _gray.back();
+						_gray.pop_back();
+					}
+					if ( obj->gc_only_writeable_flags().try_set( _current_mark ) )
+						obj->mark_references( buffer );
+				}
+			} while( take_satb() );
+			--incremental_marks;
+			_sweep_list.swap( _all_objects );
+			_sweep_index = 0;
+			_survivor_count = 0;
+			_phase = incremental_phases::sweeping;
+			return true;
+		}
+
+		//Dead objects are released as they are found; their memory is freed once all of
+		//them are.  Nothing here grows a vector, which could copy the whole object list
+		//in one step.
+		bool sweep_step( gc_deadline& deadline )
+		{
+			gc_object_flag_values::val previous_mark = other_mark( _current_mark );
+			for ( size_t end = _sweep_list.size(); _sweep_index < end; ++_sweep_index )
+			{
+				if ( deadline.expired() ) return false;
+				gc_object* obj = _sweep_list[_sweep_index];
+				gc_object_flags& flags( obj->gc_only_writeable_flags() );
+				if ( flags.has_value( _current_mark ) )
+				{
+					flags.set( previous_mark, false );
+					std::swap( _sweep_list[_survivor_count], _sweep_list[_sweep_index] );
+					++_survivor_count;
+					++_incremental._objects_marked;
+					_incremental._bytes_marked += cell_bytes( *obj );
+					continue;
+				}
+				++_incremental._objects_swept;
+				_incremental._bytes_swept += cell_bytes( *obj );
+				if ( !_sweeper )
+					obj->gc_release();
+			}
+			_free_index = _survivor_count;
+			_dead_objects.clear();
+			if ( _sweeper )
+				_dead_objects.reserve( _sweep_list.size() - _survivor_count );
+			_phase = incremental_phases::freeing;
+			return true;
+		}
+
+		//Frees dead objects or collects them for the sweeper.
+		bool free_step( gc_deadline& deadline )
+		{
+			for ( size_t end = _sweep_list.size(); _free_index < end; ++_free_index )
+			{
+				if ( deadline.expired() ) return false;
+				if ( _sweeper )
+					_dead_objects.push_back( _sweep_list[_free_index] );
+				else
+					free_object_memory( *_sweep_list[_free_index] );
+			}
+			if ( _sweeper )
+				post_background_reclaim();
+			begin_merge();
+			_phase = incremental_phases::merging;
+			return true;
+		}
+
+		//Reserving an empty list allocates without copying anything.  Twice what is needed
+		//now leaves room for the mutator to keep allocating while the merge runs.
+		void begin_merge()
+		{
+			_merged.clear();
+			_merged.reserve( 2 * ( _survivor_count + _all_objects.size() ) + 1024 );
+			_merge_index = 0;
+		}
+
+		//Copies the survivors and then the objects allocated since marking finished into
+		//_merged a deadline check at a time.  The merge starts over with a bigger list if
+		//the mutator allocated more than the reserve allowed for.
+		bool merge_step( gc_deadline& deadline )
+		{
+			for ( ;; )
+			{
+				size_t total = _survivor_count + _all_objects.size();
+				if ( _merge_index == total )
+					break;
+				if ( total > _merged.capacity() )
+				{
+					begin_merge();
+					continue;
+				}
+				if ( deadline.expired() ) return false;
+				if ( _merge_index < _survivor_count )
+					_merged.push_back( _sweep_list[_merge_index] );
+				else
+					_merged.push_back( _all_objects[_merge_index - _survivor_count] );
+				++_merge_index;
+			}
+			_all_objects.swap( _merged );
+			_merged.clear();
+			_sweep_list.clear();
+			_phase = incremental_phases::idle;
+			return true;
+		}
+
+		bool advance( gc_deadline& deadline )
+		{
+			if ( _phase == incremental_phases::idle )
+			{
+				//Don't wait on the sweeper inside a step.
+				if ( _sweeper && _sweeper->busy() ) return false;
+				start_incremental();
+			}
+			if ( _phase == incremental_phases::marking && !mark_step( deadline ) ) return false;
+			if ( _phase == incremental_phases::sweeping && !sweep_step( deadline ) ) return false;
+			if ( _phase == incremental_phases::freeing && !free_step( deadline ) ) return false;
+			if ( _phase == incremental_phases::merging && !merge_step( deadline ) ) return false;
+			return true;
+		}
+
+		bool step( gc_deadline deadline )
+		{
+			gc_stopwatch timer;
+			bool finished = advance( deadline );
+			if ( !finished && _phase == incremental_phases::idle ) return false;
+			double elapsed = timer.elapsed_ms();
+			_incremental._work_ms += elapsed;
+			_incremental._pause_ms = std::max( _incremental._pause_ms, elapsed );
+			if ( finished )
+				collection_finished( _incremental );
+			return finished;
+		}
+
+		void finish_incremental()
+		{
+			while( _phase != incremental_phases::idle )
+				step( gc_deadline::unbounded() );
+		}
+
+	public:
+		mark_sweep_gc( allocator_ptr alloc, const gc_options& options )
+			: gc_base( alloc, options )
+			, _slabs( alloc )
+			, _phase( incremental_phases::idle )
+			, _sweep_index( 0 )
+			, _survivor_count( 0 )
+			, _free_index( 0 )
+			, _merge_index( 0 )
+		{
+		}
+
+		~mark_sweep_gc()
+		{
+			_callback = gc_collection_callback();
+			finish_incremental();
+			finish_sweep();
+			for_each( _all_objects.begin(), _all_objects.end(), []( gc_object* obj ) { obj->gc_release(); } );
+			for_each( _all_objects.begin(), _all_objects.end(), [this]( gc_object* obj ) { free_object_memory( *obj ); } );
+		}
+
+		virtual gc_object& allocate_object( size_t len, uint8_t alignment
+											, object_constructor constructor
+											, file_info alloc_info )
+		{
+			uint16_t size_class = gc_slabs::large_class;
+			if ( alignment <= gc_slabs::granularity )
+				size_class = gc_slabs::class_index( len + sizeof( gc_header ) );
+
+			uint8_t* memory;
+			uint8_t* object_memory;
+			if ( size_class == gc_slabs::large_class )
+				memory = allocate_large( len, alignment, alloc_info, object_memory );
+			else
+			{
+				memory = _slabs.try_allocate( size_class );
+				if ( memory == nullptr )
+				{
+					std::lock_guard<std::mutex> lock( _mutex );
+					memory = _slabs.allocate( size_class, alloc_info );
+				}
+				object_memory = memory + sizeof( gc_header );
+			}
+			gc_object& retval = construct( memory, object_memory, size_class, len, constructor, [&]()
+			{
+				if ( size_class == gc_slabs::large_class )
+					free_large( *reinterpret_cast<gc_object*>( object_memory ) );
+				else
+					_slabs.deallocate( size_class, memory );
+			} );
+			if ( _phase == incremental_phases::marking )
+				retval.gc_only_writeable_flags().set( _current_mark, true );
+			_all_objects.push_back( &retval );
+			return retval;
+		}
+
+		virtual void perform_gc()
+		{
+			finish_incremental();
+			gc_stopwatch timer;
+			gc_collection_stats collection;
+			finish_sweep();
+			_current_mark = other_mark( _current_mark );
+			mark();
+			sweep( collection );
+			collection._pause_ms = collection._work_ms = timer.elapsed_ms();
+			collection_finished( collection );
+		}
+
+		virtual void perform_full_gc() { perform_gc(); }
+
+		virtual bool gc_step( uint32_t budget_us ) { return step( gc_deadline( budget_us ) ); }
+
+		virtual const_gc_object_raw_ptr_buffer all_objects() { return _all_objects; }
+
+	protected:
+		virtual void settle()
+		{
+			finish_incremental();
+			finish_sweep();
+		}
+
+		virtual size_t reserved_bytes()
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			return _slabs.slabs().size() * gc_slabs::slab_size + _large_bytes;
+		}
+	};
+
+	//Young objects live in per thread nurseries until a collection either releases them
+	//or sets their mature flag and moves them to the old generation; nothing is copied.
+	//A minor collection marks with the mature flag, so marking stops at old objects and
+	//only walks live young ones.  Old objects refer to young ones through
+	//gc_refcount_ptr, so a young object nothing reachable refers to has a zero refcount;
+	//those are released along with whatever only they referenced.  Young objects that
+	//still have references after that are kept; cycles of young garbage are left for a
+	//full collection.
+	class generational_gc : public gc_base
+	{
+		enum { min_full_gc_objects = 4096 };
+
+		gc_blocks					_blocks;
+		vector<uint8_t*>			_sweeping_blocks;
+		nursery_heap_ptr			_nurseries;
+		obj_ptr_list				_mature_objects;
+		obj_ptr_list				_pending;
+		obj_ptr_list				_children;
+		obj_ptr_list				_all_objects;
+		float						_full_gc_growth;
+		size_t						_full_gc_mature_count;
+
+		void collect( gc_collection_kinds::val kind )
+		{
+			gc_stopwatch timer;
+			gc_collection_stats collection( kind );
+			finish_sweep();
+			if ( kind == gc_collection_kinds::full )
+				full_gc( collection );
+			else
+				minor_gc( collection );
+			collection._pause_ms = collection._work_ms = timer.elapsed_ms();
+			collection_finished( collection );
+		}
+
+		nursery& current_nursery()
+		{
+			//Most threads only ever use one collector.
+			nursery_bindings& thread_bindings( current_nursery_bindings() );
+			vector<pair<nursery_heap_ptr, nursery*> >& bindings( thread_bindings._bindings );
+			if ( !bindings.empty() && bindings.front().first == _nurseries )
+				return *bindings.front().second;
+			return thread_bindings.find_nursery( _nurseries );
+		}
+
+		uint8_t* refill( nursery& young, size_t len, file_info alloc_info )
+		{
+			for(;;)
+			{
+				young.retire_span();
+				while( young.next_span() )
+				{
+					uint8_t* retval = young.try_bump( len );
+					if ( retval ) return retval;
+					young.retire_span();
+				}
+				std::lock_guard<std::mutex> lock( _mutex );
+				young.take_block( _blocks.acquire( alloc_info ) );
+			}
+		}
+
+		void free_object_memory( gc_object& obj )
+		{
+			gc_header& obj_header( header( obj ) );
+			if ( obj_header.size_class == gc_slabs::large_class )
+				free_large( obj );
+			else
+				gc_blocks::set_free( reinterpret_cast<uint8_t*>( &obj_header ), gc_slabs::class_size( obj_header.size_class ) );
+		}
+
+		void release_young( gc_object& obj )
+		{
+			header( obj ).released = 1;
+			_dead_objects.push_back( &obj );
+			obj.gc_release();
+		}
+
+		vector<nursery*> reset_nurseries()
+		{
+			vector<nursery*> retval( _nurseries->nurseries() );
+			for_each( retval.begin(), retval.end(), []( nursery* young ) { young->reset(); } );
+			return retval;
+		}
+
+		void minor_gc( gc_collection_stats& collection )
+		{
+			const gc_object_flag_values::val mature = gc_object_flag_values::mature;
+			vector<nursery*> nurseries( reset_nurseries() );
+			for_each( nurseries.begin(), nurseries.end(), [&]( nursery* young ) { collection._young_objects += young->_objects.size(); } );
+			//Old roots are already mature so this only walks young objects.
+			_marker.mark( _locked_objects, mature );
+
+			//Unreferenced young objects are garbage, and so is anything only they referenced.
+			//Objects mostly refer to older objects, so releasing newest first frees most
+			//garbage without asking objects for their references.
+			_dead_objects.clear();
+			for_each( nurseries.begin(), nurseries.end(), [this]( nursery* young )
+			{
+				for_each( young->_objects.rbegin(), young->_objects.rend(), [this]( gc_object* obj )
+				{
+					if ( !obj->flags().is_mature() && obj->refcount() == 0 )
+						release_young( *obj );
+				} );
+			} );
+			_pending.clear();
+			for_each( nurseries.begin(), nurseries.end(), [this]( nursery* young )
+			{
+				for_each( young->_objects.begin(), young->_objects.end(), [this]( gc_object* obj )
+				{
+					if ( !obj->flags().is_mature() && obj->refcount() == 0 && !header( *obj ).released )
+						_pending.push_back( obj );
+				} );
+			} );
+			mark_buffer children( _children, mature );
+			while( !_pending.empty() )
+			{
+				gc_object* obj = _pending.back();
+				_pending.pop_back();
+				if ( header( *obj ).released ) continue;
+				_children.clear();
+				obj->mark_references( children );
+				release_young( *obj );
+				for_each( _children.begin(), _children.end(), [this]( gc_object* child )
+				{
+					if ( child->refcount() == 0 && !header( *child ).released )
+						_pending.push_back( child );
+				} );
+			}
+
+			//What is left is referenced from old objects; it and everything it reaches survives.
+			for_each( nurseries.begin(), nurseries.end(), [this]( nursery* young )
+			{
+				for_each( young->_objects.begin(), young->_objects.end(), [this]( gc_object* obj )
+				{
+					if ( !obj->flags().is_mature() && !header( *obj ).released )
+						_pending.push_back( obj );
+				} );
+			} );
+			_marker.mark( _pending, mature );
+			_pending.clear();
+
+			for_each( nurseries.begin(), nurseries.end(), [&]( nursery* young )
+			{
+				for_each( young->_objects.begin(), young->_objects.end(), [&]( gc_object* obj )
+				{
+					if ( !header( *obj ).released )
+					{
+						++collection._objects_promoted;
+						collection._bytes_promoted += cell_bytes( *obj );
+						_mature_objects.push_back( obj );
+					}
+				} );
+				young->_objects.clear();
+			} );
+			collection._objects_marked = collection._objects_promoted;
+			collection._bytes_marked = collection._bytes_promoted;
+			collection._objects_swept = _dead_objects.size();
+			for_each( _dead_objects.begin(), _dead_objects.end(), [&]( gc_object* obj )
+			{
+				collection._bytes_swept += cell_bytes( *obj );
+				free_object_memory( *obj );
+			} );
+			_dead_objects.clear();
+			std::lock_guard<std::mutex> lock( _mutex );
+			for_each( nurseries.begin(), nurseries.end(), [this]( nursery* young )
+			{
+				for_each( young->_touched_blocks.begin(), young->_touched_blocks.end(), [this]( uint8_t* block )
+				{
+					_blocks.recycle( block );
+				} );
+				young->_touched_blocks.clear();
+			} );
+		}
+
+		void full_gc( gc_collection_stats& collection )
+		{
+			vector<nursery*> nurseries( reset_nurseries() );
+			_current_mark = other_mark( _current_mark );
+			_marker.mark( _locked_objects, _current_mark );
+
+			gc_object_flag_values::val previous_mark = other_mark( _current_mark );
+			_dead_objects.clear();
+			auto is_dead = [&]( gc_object* obj ) -> bool
+			{
+				gc_object_flags& flags( obj->gc_only_writeable_flags() );
+				size_t bytes = cell_bytes( *obj );
+				if ( flags.has_value( _current_mark ) )
+				{
+					flags.set( previous_mark, false );
+					flags.set( gc_object_flag_values::mature, true );
+					++collection._objects_marked;
+					collection._bytes_marked += bytes;
+					return false;
+				}
+				++collection._objects_swept;
+				collection._bytes_swept += bytes;
+				_dead_objects.push_back( obj );
+				return true;
+			};
+			_mature_objects.erase( remove_if( _mature_objects.begin(), _mature_objects.end(), is_dead ), _mature_objects.end() );
+			for_each( nurseries.begin(), nurseries.end(), [&]( nursery* young )
+			{
+				collection._young_objects += young->_objects.size();
+				for_each( young->_objects.begin(), young->_objects.end(), [&]( gc_object* obj )
+				{
+					if ( !is_dead( obj ) )
+					{
+						++collection._objects_promoted;
+						collection._bytes_promoted += cell_bytes( *obj );
+						_mature_objects.push_back( obj );
+					}
+				} );
+				young->_objects.clear();
+				young->_touched_blocks.clear();
+			} );
+			_full_gc_mature_count = std::max( static_cast<size_t>( _mature_objects.size() * _full_gc_growth )
+											, static_cast<size_t>( min_full_gc_objects ) );
+			{
+				std::lock_guard<std::mutex> lock( _mutex );
+				_sweeping_blocks = _blocks.take_all();
+			}
+			_sweeping.swap( _dead_objects );
+			if ( _sweeper )
+				_sweeper->post( [this]() { reclaim(); } );
+			else
+				reclaim();
+		}
+
+		//Frees what a full collection found dead, on the sweeper if there is one.  The
+		//blocks are out of circulation until each one is recycled here.
+		void reclaim()
+		{
+			//Release everything before freeing anything; destructors of dead objects may
+			//still touch other dead objects (refcount pointers in a cycle).
+			for_each( _sweeping.begin(), _sweeping.end(), []( gc_object* obj ) { obj->gc_release(); } );
+			for_each( _sweeping.begin(), _sweeping.end(), [this]( gc_object* obj ) { free_object_memory( *obj ); } );
+			_sweeping.clear();
+			for_each( _sweeping_blocks.begin(), _sweeping_blocks.end(), [this]( uint8_t* block )
+			{
+				std::lock_guard<std::mutex> lock( _mutex );
+				_blocks.recycle( block );
+			} );
+			_sweeping_blocks.clear();
+			std::lock_guard<std::mutex> lock( _mutex );
+			_blocks.release_empty_blocks();
+		}
+
+	public:
+		generational_gc( allocator_ptr alloc, const gc_options& options )
+			: gc_base( alloc, options )
+			, _blocks( alloc )
+			, _nurseries( make_shared<nursery_heap>() )
+			, _full_gc_growth( std::max( options._full_gc_growth, 1.0f ) )
+			, _full_gc_mature_count( min_full_gc_objects )
+		{
+		}
+
+		~generational_gc()
+		{
+			finish_sweep();
+			all_objects();
+			for_each( _all_objects.begin(), _all_objects.end(), []( gc_object* obj ) { obj->gc_release(); } );
+			for_each( _all_objects.begin(), _all_objects.end(), [this]( gc_object* obj )
+			{
+				if ( header( *obj ).size_class == gc_slabs::large_class )
+					free_large( *obj );
+			} );
+			_nurseries->_closed.store( true );
+		}
+
+		virtual gc_object& allocate_object( size_t len, uint8_t alignment
+											, object_constructor constructor
+											, file_info alloc_info )
+		{
+			nursery& young( current_nursery() );
+			uint16_t size_class = gc_slabs::large_class;
+			if ( alignment <= gc_slabs::granularity )
+				size_class = gc_slabs::class_index( len + sizeof( gc_header ) );
+
+			uint8_t* memory;
+			uint8_t* object_memory;
+			if ( size_class == gc_slabs::large_class )
+			{
+				memory = allocate_large( len, alignment, alloc_info, object_memory );
+				gc_object& retval = construct( memory, object_memory, size_class, len, constructor, [&]()
+				{
+					free_large( *reinterpret_cast<gc_object*>( object_memory ) );
+				} );
+				young._objects.push_back( &retval );
+				return retval;
+			}
+			size_t cell_len = gc_slabs::class_size( size_class );
+			memory = young.try_bump( cell_len );
+			if ( memory == nullptr )
+				memory = refill( young, cell_len, alloc_info );
+			object_memory = memory + sizeof( gc_header );
+			gc_object& retval = construct( memory, object_memory, size_class, len, constructor, [&]()
+			{
+				gc_blocks::set_free( memory, cell_len );
+			} );
+			young._objects.push_back( &retval );
+			return retval;
+		}
+
+		virtual void perform_gc()
+		{
+			collect( _mature_objects.size() >= _full_gc_mature_count ? gc_collection_kinds::full
+																	: gc_collection_kinds::minor );
+		}
+
+		virtual void perform_full_gc() { collect( gc_collection_kinds::full ); }
+
+		virtual bool gc_step( uint32_t )
+		{
+			perform_gc();
+			return true;
+		}
+
+		virtual const_gc_object_raw_ptr_buffer all_objects()
+		{
+			_all_objects = _mature_objects;
+			vector<nursery*> nurseries( _nurseries->nurseries() );
+			for_each( nurseries.begin(), nurseries.end(), [this]( nursery* young )
+			{
+				_all_objects.insert( _all_objects.end(), young->_objects.begin(), young->_objects.end() );
+			} );
+			return _all_objects;
+		}
+
+	protected:
+		virtual void settle() { finish_sweep(); }
+
+		virtual size_t reserved_bytes()
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			return _blocks.block_count() * gc_blocks::block_size + _large_bytes;
+		}
+	};
+}
+
+garbage_collector_ptr garbage_collector::create_mark_sweep( allocator_ptr alloc, const gc_options& options )
+{
+	return make_shared<mark_sweep_gc>( alloc, options );
+}
+
+garbage_collector_ptr garbage_collector::create_generational( allocator_ptr alloc, const gc_options& options )
+{
+	return make_shared<generational_gc>( alloc, options );
+}
+
+atomic<uint32_t> garbage_collector::incremental_marks( 0 );
+
+void garbage_collector::shade( gc_object& obj )
+{
+	gc_base* owner = g_gc_registry.find( gc_base::header( obj ).collector_index );
+	if ( owner )
+		owner->shade_object( obj );
+}
+
+void garbage_collector::write_heap_snapshot( const string& path )
+{
+	std::ofstream out( path.c_str() );
+	if ( !out )
+		throw runtime_error( "failed to open heap snapshot file" );
+	write_heap_snapshot( out );
+}
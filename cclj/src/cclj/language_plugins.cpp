@@ -91,7 +91,7 @@ namespace {
 			// Emit merge block.
 			theFunction->getBasicBlockList().push_back(MergeBB);
 			context._builder.SetInsertPoint(MergeBB);
-			if (true_result.second != &context._type_library->get_void_type())
+			if (!context._type_library->is_void_type(*true_result.second))
 			{
 				PHINode *PN = context._builder.CreatePHI(context.type_ref_type(*true_result.second).get(), 2,
 					"iftmp");
@@ -156,8 +156,9 @@ namespace {
 				if (var_eval.first)
 				{
 					auto alloca = entryBuilder.CreateAlloca(context.type_ref_type(*var_eval.second).get()
-						, 0, var_dec.first->_name.c_str());
+						, 0, StringRef(var_dec.first->_name.c_str(), var_dec.first->_name.size()));
 					context._builder.CreateStore(var_eval.first.get(), alloca);
+					context.add_local(*var_eval.second, *alloca);
 					context._module->add_local_variable(var_dec.first->_name, *var_eval.second, *alloca);
 				}
 				else
@@ -321,6 +322,63 @@ namespace {
 		}
 	};
 
+	//target and the constant indexes or field names after it, as the get and set forms
+	//take them.
+	variable_lookup_chain type_check_lookup_chain(reader_context& context, symbol& target
+													, const vector<cons_cell*>& index_cells)
+	{
+		variable_lookup_chain lookup_chain;
+		vector<string> split_data = base_language_plugins::split_symbol(target);
+		lookup_chain.name = context._name_table->register_name(split_data);
+		for (auto iter = index_cells.begin(), end = index_cells.end(); iter != end; ++iter)
+		{
+			object_ptr index = (*iter)->_value;
+			if (constant* index_constant = object_traits::cast<constant>(index))
+				lookup_chain.lookup_chain.push_back(variable_lookup_entry(index_constant->_value.cast<int64_t>()));
+			else if (symbol* field = object_traits::cast<symbol>(index))
+				lookup_chain.lookup_chain.push_back(variable_lookup_entry(field->_name));
+			else
+				throw runtime_error("lookup indexes must be constants or field names");
+		}
+		return lookup_chain;
+	}
+
+	struct get_ast_node : public ast_node
+	{
+		variable_lookup_chain _chain;
+		get_ast_node(const type_ref& type, const variable_lookup_chain& c) : ast_node(type), _chain(c) {}
+
+		virtual pair<llvm_value_ptr_opt, type_ref_ptr> compile_second_pass(compiler_context& context)
+		{
+			return context._module->load_variable(context, _chain);
+		}
+	};
+
+	CCLJ_BASE_PLUGINS_DESTRUCT_AST_NODE(get_ast_node);
+
+	struct get_plugin : public compiler_plugin
+	{
+		get_plugin(){}
+		//syntax is (get target idx...)
+		virtual ast_node* type_check(reader_context& context, lisp::cons_cell& cell)
+		{
+			cons_cell& symbol_cell = object_traits::cast_ref<cons_cell>(cell._next);
+			symbol& target = object_traits::cast_ref<symbol>(symbol_cell._value);
+			vector<cons_cell*> arg_cells;
+			for (cons_cell* next_cell = object_traits::cast<cons_cell>(symbol_cell._next);
+				next_cell; next_cell = object_traits::cast<cons_cell>(next_cell->_next))
+				arg_cells.push_back(next_cell);
+			if (arg_cells.size() == 0)
+				throw runtime_error("invalid number of arguments to get");
+
+			variable_lookup_chain lookup_chain = type_check_lookup_chain(context, target, arg_cells);
+			option<variable_lookup_typecheck_result> results = context._module->type_check_variable_access(lookup_chain);
+			if (results.empty() || !results->read)
+				throw runtime_error("invalid get");
+			return context._ast_allocator->construct<get_ast_node>(*results->type, lookup_chain);
+		}
+	};
+
 	struct set_ast_node : public ast_node
 	{
 		variable_lookup_chain _chain;
@@ -340,7 +398,7 @@ namespace {
 	struct set_plugin : public compiler_plugin
 	{
 		set_plugin(){}
-		//syntax is (set target expr)
+		//syntax is (set target idx... expr)
 		//target->a->b->c = expr;
 		virtual ast_node* type_check(reader_context& context, lisp::cons_cell& cell)
 		{
@@ -356,9 +414,7 @@ namespace {
 			cons_cell* expr_cell = arg_cells.back();
 			arg_cells.pop_back();
 
-			variable_lookup_chain lookup_chain;
-			vector<string> split_data = base_language_plugins::split_symbol(target);
-			lookup_chain.name = context._name_table->register_name(split_data);
+			variable_lookup_chain lookup_chain = type_check_lookup_chain(context, target, arg_cells);
 			option<variable_lookup_typecheck_result> results = context._module->type_check_variable_access(lookup_chain);
 			if (results.empty() || !results->read)
 				throw runtime_error("invalid set");
@@ -386,7 +442,9 @@ void language_plugins::register_plugins(qualified_name_table_ptr name_table
 	special_forms->insert(make_pair(string_table->register_str("for")
 		, make_shared<for_loop_plugin>()));
 	special_forms->insert(make_pair(string_table->register_str("set")
-		, make_shared<set_plugin>()));
+		, make_shared<set_plugin>()));
+	special_forms->insert(make_pair(string_table->register_str("get")
+		, make_shared<get_plugin>()));
 }
 
 
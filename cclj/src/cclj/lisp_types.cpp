@@ -8,63 +8,76 @@
 #include "precompile.h"
 #include "cclj/lisp_types.h"
 #include "cclj/pool.h"
+#include "cclj/slab_allocator.h"
 
 
 using namespace cclj;
 using namespace cclj::lisp;
 
 namespace  {
+
+	//Each object type gets a pool sized exactly for it so cells are not padded out to
+	//the largest object.
 	class factory_impl : public factory
 	{
 		allocator_ptr			_allocator;
-		pool<sizeof(symbol)>	_object_pool;
+		pool<sizeof(cons_cell)>	_cell_pool;
+		pool<sizeof(array)>		_array_pool;
+		pool<sizeof(symbol)>	_symbol_pool;
+		pool<sizeof(constant)>	_constant_pool;
+		//array contents and small data; never freed individually.
+		slab_allocator<>		_buffers;
 		const cons_cell&		_empty_cell;
-		vector<uint8_t*>		_buffer_allocs;
+		factory_stats			_stats;
+
+		template<typename obj_type>
+		static obj_type* count( obj_type* obj, factory_type_stats& stats )
+		{
+			++stats._count;
+			stats._bytes += sizeof( obj_type );
+			return obj;
+		}
 
 	public:
 		factory_impl( allocator_ptr alloc, const cons_cell& empty_cell )
 			: _allocator( alloc )
-			, _object_pool( alloc, CCLJ_IMMEDIATE_FILE_INFO(), sizeof(void*) )
+			, _cell_pool( alloc, CCLJ_IMMEDIATE_FILE_INFO(), sizeof(void*) )
+			, _array_pool( alloc, CCLJ_IMMEDIATE_FILE_INFO(), sizeof(void*) )
+			, _symbol_pool( alloc, CCLJ_IMMEDIATE_FILE_INFO(), sizeof(void*) )
+			, _constant_pool( alloc, CCLJ_IMMEDIATE_FILE_INFO(), sizeof(void*) )
+			, _buffers( alloc )
 			, _empty_cell( empty_cell )
 		{
 		}
-		~factory_impl()
-		{
-			for_each( _buffer_allocs.begin(), _buffer_allocs.end(),
-				[this]( uint8_t* alloc )
-			{
-				_allocator->deallocate( alloc );
-			} );
-		}
 		
 		virtual const cons_cell& empty_cell() { return _empty_cell; }
-		virtual cons_cell* create_cell() { return _object_pool.construct<cons_cell>(); }
-		virtual array* create_array()  { return _object_pool.construct<array>(); }
-		virtual symbol* create_symbol() { return _object_pool.construct<symbol>(); }
-		virtual constant* create_constant() { return _object_pool.construct<constant>(); }
+		virtual cons_cell* create_cell() { return count( _cell_pool.construct<cons_cell>(), _stats._cells ); }
+		virtual array* create_array()  { return count( _array_pool.construct<array>(), _stats._arrays ); }
+		virtual symbol* create_symbol() { return count( _symbol_pool.construct<symbol>(), _stats._symbols ); }
+		virtual constant* create_constant() { return count( _constant_pool.construct<constant>(), _stats._constants ); }
 		virtual uint8_t* allocate_data( size_t size, uint8_t alignment )
 		{
-			if ( size <= sizeof(type_ref ) && alignment < sizeof(void*) )
-			{
-				return _object_pool.allocate();
-			}
-			else
-			{
-				uint8_t* retval = _allocator->allocate( size, alignment, CCLJ_IMMEDIATE_FILE_INFO() );
-				_buffer_allocs.push_back( retval );
-				return retval;
-			}
+			++_stats._buffers._count;
+			_stats._buffers._bytes += size;
+			return _buffers.allocate( size, alignment, CCLJ_IMMEDIATE_FILE_INFO() );
 		}
 		virtual object_ptr_buffer allocate_obj_buffer(size_t size)
 		{
 			if ( size == 0 )
 				return object_ptr_buffer();
-			object_ptr* new_data = reinterpret_cast<object_ptr*>( 
-				_allocator->allocate( size * sizeof( object_ptr* ), sizeof(void*), CCLJ_IMMEDIATE_FILE_INFO() ) );
-			std::memset( new_data, 0, size * sizeof( object_ptr* ) );
-			_buffer_allocs.push_back( reinterpret_cast<uint8_t*>( new_data ) );
+			object_ptr* new_data = reinterpret_cast<object_ptr*>( allocate_data( size * sizeof( object_ptr ), sizeof(void*) ) );
+			std::memset( new_data, 0, size * sizeof( object_ptr ) );
 			return object_ptr_buffer( new_data, size );
 		}
+
+		virtual factory_stats stats()
+		{
+			factory_stats retval( _stats );
+			retval._reserved_bytes = _cell_pool.reserved_bytes() + _array_pool.reserved_bytes()
+									+ _symbol_pool.reserved_bytes() + _constant_pool.reserved_bytes()
+									+ _buffers.reserved_bytes();
+			return retval;
+		}
 	};
 }
 
@@ -50,6 +50,7 @@ namespace
 		type_ref&			_type;
 		visibility::_enum	_visibility;
 		void*				_user_value;
+		bool				_constant;
 
 
 		llvm::GlobalVariable*	_variable;
@@ -60,6 +61,7 @@ namespace
 			, _type(type)
 			, _visibility(visibility::internal_visiblity)
 			, _user_value(nullptr)
+			, _constant(true)
 			, _variable(nullptr)
 		{
 		}
@@ -70,6 +72,8 @@ namespace
 
 		virtual void set_value(void* value) { _user_value = value; }
 
+		virtual void set_constant(bool constant) { _constant = constant; }
+
 		virtual variable_node& node()
 		{
 			return *this;
@@ -87,14 +91,15 @@ namespace
 			if (!llvm_type)
 				throw runtime_error("Failed to compile variable");
 
+			//Values supplied by the runtime live outside the module.
 			_variable = new GlobalVariable(llvm_type.get()
-				, true
-				, ctx.visibility_to_linkage(_visibility)
+				, _constant
+				, _user_value ? GlobalValue::ExternalLinkage : ctx.visibility_to_linkage(_visibility)
 				, NULL
 				, ctx.qualified_name_to_llvm_name(_name).c_str());
 
 			ctx._llvm_module.getGlobalList().push_back(_variable);
-			ctx._eng.addGlobalMapping(_variable, _user_value);
+			ctx.map_global(*_variable, _user_value);
 		}
 
 		virtual llvm::GlobalVariable& llvm_variable()
@@ -116,9 +121,12 @@ namespace
 		vector<ast_node_ptr>	_body;
 		void*					_external_body;
 		compile_pass_fn			_user_body;
+		intrinsic_fn			_intrinsic_body;
 		visibility::_enum		_visibility;
 
 		llvm::Function*			_function;
+		//An earlier object has this function's code; this compile only declares it.
+		bool					_compiled_earlier;
 
 
 		function_node_impl(qualified_name nm, type_ref& rettype, named_type_buffer args, type_ref& fn_type)
@@ -128,13 +136,14 @@ namespace
 			, _visibility(visibility::internal_visiblity)
 			, _external_body( nullptr )
 			, _function(nullptr)
+			, _compiled_earlier(false)
 		{
 			_arguments.assign(args.begin(), args.end());
 		}
 
 		virtual void set_function_body(ast_node_buffer body) 
 		{
-			if (_user_body)
+			if (_user_body || _intrinsic_body)
 				throw runtime_error("functions may either be defined via external pointers or ast nodes but not both");
 			if (_external_body)
 				throw runtime_error("functions may either be defined via external pointers or ast nodes but not both");
@@ -143,7 +152,7 @@ namespace
 
 		virtual void set_function_body(void* fn_ptr)
 		{
-			if ( _user_body )
+			if ( _user_body || _intrinsic_body )
 				throw runtime_error("functions may either be defined via external pointers or ast nodes but not both");
 			if (_body.empty() == false)
 				throw runtime_error("functions may either be defined via external pointers or ast nodes but not both");
@@ -159,6 +168,15 @@ namespace
 			_user_body = fn;
 		}
 
+		virtual void set_function_intrinsic_body(intrinsic_fn fn)
+		{
+			if (_body.empty() == false || _user_body)
+				throw runtime_error("functions may either be defined via external pointers or ast nodes but not both");
+			if (_external_body)
+				throw runtime_error("functions may either be defined via external pointers or ast nodes but not both");
+			_intrinsic_body = fn;
+		}
+
 		virtual void set_visibility(visibility::_enum visibility) { _visibility = visibility; }
 		virtual function_node& node() { return *this; }
 
@@ -172,6 +190,7 @@ namespace
 		virtual ast_node_buffer get_function_body() { return _body; }
 		virtual void*			get_function_external_body() { return _external_body; }
 		virtual compile_pass_fn get_function_override_body() { return _user_body; }
+		virtual intrinsic_fn	get_function_intrinsic_body() { return _intrinsic_body; }
 		virtual void compile_first_pass(compiler_context& ctx)
 		{
 			vector<llvm_type_ptr> arg_types;
@@ -186,14 +205,21 @@ namespace
 			llvm_type_ptr rettype = ctx.type_ref_type(_return_type).get();
 			FunctionType* fn_type = FunctionType::get(rettype, arg_types, false);
 			string name_mangle(ctx.qualified_name_to_llvm_name(_name, cclj_arg_types));
+			//Later objects call script functions by name.
+			bool exported = _external_body
+				|| (ctx._separate_objects && !_user_body && !_intrinsic_body);
+			auto compiled = ctx._compiled_functions.find(name_mangle);
+			_compiled_earlier = exported && !_external_body && compiled != ctx._compiled_functions.end();
 
 			_function = Function::Create(fn_type
-				, ctx.visibility_to_linkage(_visibility)
+				, exported ? GlobalValue::ExternalLinkage : ctx.visibility_to_linkage(_visibility)
 				, name_mangle.c_str()
 				, &ctx._llvm_module);
 
 			if ( _external_body )
-				ctx._eng.addGlobalMapping(_function, _external_body);
+				ctx.map_global(*_function, _external_body);
+			else if ( _compiled_earlier )
+				ctx.map_global(*_function, compiled->second);
 		}
 
 		static void initialize_function(compiler_context& context, Function& fn, data_buffer<named_type> fn_args )
@@ -216,49 +242,82 @@ namespace
 				// Create an alloca for this variable.
 				if (arg_def.type == nullptr) throw runtime_error("Invalid function argument");
 				AllocaInst *Alloca = nullptr;
-				if (arg_def.type != &context._type_library->get_void_type())
+				if (!context._type_library->is_void_type(*arg_def.type))
 				{
 					Alloca = entry_block_builder.CreateAlloca(context.type_ref_type(*arg_def.type).get()
 						, 0, arg_def.name.c_str());
 
 					// Store the initial value into the alloca.
 					context._builder.CreateStore(AI, Alloca);
+					context.add_local(*arg_def.type, *Alloca);
 				}
 				context._module->add_local_variable(arg_def.name, *arg_def.type, *Alloca );
 			}
 		}
 
+		//Everything but external functions; intrinsics included.
+		bool has_compiled_body() const { return _external_body == nullptr; }
+
+		//Intrinsics wait for compile_intrinsic.
 		virtual void compile_second_pass(compiler_context& ctx)
 		{
-			if (_external_body == nullptr)
+			if (_external_body == nullptr && !_intrinsic_body && !_compiled_earlier)
+				compile_body(ctx, *_function);
+		}
+
+		//Once every call site is compiled an intrinsic nobody references is removed, otherwise
+		//it gets a body that expands the intrinsic on its own arguments.
+		void compile_intrinsic(compiler_context& ctx)
+		{
+			if (!_intrinsic_body)
+				return;
+			if (_function->use_empty())
 			{
-				pair<llvm_value_ptr_opt, type_ref_ptr> last_statement(nullptr, nullptr);
-				{
-					compiler_scope_watcher _fn_scope(ctx);
-					module::compilation_variable_scope fn_context(ctx._module);
-					initialize_function(ctx, *_function, _arguments);
+				_function->eraseFromParent();
+				_function = nullptr;
+			}
+			else
+				compile_body(ctx, *_function);
+		}
 
-					if (_user_body)
-					{
-						last_statement = _user_body(ctx);
-					}
-					else
+		//fn is this function in the context's llvm module.
+		void compile_body(compiler_context& ctx, llvm::Function& fn)
+		{
+			pair<llvm_value_ptr_opt, type_ref_ptr> last_statement(nullptr, nullptr);
+			{
+				compiler_scope_watcher _fn_scope(ctx);
+				module::compilation_variable_scope fn_context(ctx._module);
+				ctx.begin_gc_frame();
+				initialize_function(ctx, fn, _arguments);
+
+				if (_user_body)
+				{
+					last_statement = _user_body(ctx);
+				}
+				else if (_intrinsic_body)
+				{
+					vector<llvm_value_ptr> args;
+					for (Function::arg_iterator iter = fn.arg_begin(), end = fn.arg_end(); iter != end; ++iter)
+						args.push_back(iter);
+					last_statement = make_pair(_intrinsic_body(ctx, args), &_return_type);
+				}
+				else
+				{
+					for (auto iter = _body.begin(), end = _body.end(); iter != end; ++iter)
 					{
-						for (auto iter = _body.begin(), end = _body.end(); iter != end; ++iter)
-						{
-							ast_node& item = **iter;
-							last_statement = item.compile_second_pass(ctx);
-						}
+						ast_node& item = **iter;
+						last_statement = item.compile_second_pass(ctx);
 					}
 				}
-				Value* retval = nullptr;
-				if (last_statement.first.valid())
-					retval = ctx._builder.CreateRet(last_statement.first.get());
-				else
-					ctx._builder.CreateRetVoid();
-				verifyFunction(*_function);
-				ctx._fpm.run(*_function);
 			}
+			ctx.finish_gc_frame(fn);
+			Value* retval = nullptr;
+			if (last_statement.first.valid())
+				retval = ctx._builder.CreateRet(last_statement.first.get());
+			else
+				ctx._builder.CreateRetVoid();
+			verifyFunction(fn);
+			ctx._fpm.run(fn);
 		}
 
 		virtual llvm::Function& llvm()
@@ -675,6 +734,7 @@ namespace
 		named_type_list_list			_local_variable_typecheck_stack;
 		type_datatype_map				_datatypes;
 		local_variable_entry_list_list	_local_variable_compile_stack;
+		//Functions whose bodies wait for their first call.
 
 
 		module_impl(string_table_ptr st
@@ -747,8 +807,37 @@ namespace
 			return dt;
 		}
 
+		bool holds_managed_pointer(type_ref& type)
+		{
+			if (_type_library->is_managed_pointer_type(type))
+				return true;
+			if (_type_library->is_tuple_type(type))
+			{
+				for (auto iter = type._specializations.begin(), end = type._specializations.end(); iter != end; ++iter)
+				{
+					if (holds_managed_pointer(**iter))
+						return true;
+				}
+				return false;
+			}
+			datatype_node_ptr dtype = find_datatype(type);
+			if (dtype)
+			{
+				vector<named_type> fields = dtype->fields();
+				for (auto iter = fields.begin(), end = fields.end(); iter != end; ++iter)
+				{
+					if (holds_managed_pointer(*iter->type))
+						return true;
+				}
+			}
+			return false;
+		}
+
 		virtual variable_node_factory& define_variable(qualified_name name, type_ref& type)
 		{
+			//Nothing scans module variables for the collector.
+			if (holds_managed_pointer(type))
+				throw runtime_error("module variables cannot hold managed pointers");
 			return *add_symbol_t(name, new variable_node_impl(name, type));
 		}
 		virtual function_factory& define_function(qualified_name name, named_type_buffer arguments, type_ref& rettype)
@@ -765,7 +854,7 @@ namespace
 			for (size_t idx = 0, end = arguments.size(); idx < end; ++idx)
 				arg_buffer.push_back(arguments[idx].type);
 
-			type_ref& fn_type = _type_library->get_type_ref("fn", arg_buffer);
+			type_ref& fn_type = _type_library->get_type_ref(_type_library->well_known()._fn, arg_buffer);
 
 			for (size_t idx = 0, end = existing.size(); idx < end; ++idx)
 			{
@@ -844,6 +933,11 @@ namespace
 			return variable_lookup_typecheck_result();
 		}
 
+		bool is_indexable_pointer(type_ref& type)
+		{
+			return _type_library->is_pointer_type(type) || _type_library->is_managed_pointer_type(type);
+		}
+
 		virtual option<variable_lookup_typecheck_result> type_check_variable_access(const variable_lookup_chain& lookup_args)
 		{
 			type_ref_ptr base_variable_type = nullptr;
@@ -922,9 +1016,10 @@ namespace
 				case variable_lookup_entry_type::int64:
 				{
 					//the actual uint32 value is ignored at this point.
-					if (_type_library->is_pointer_type(*base_variable_type))
+					if (is_indexable_pointer(*base_variable_type))
 					{
-						base_variable_type = &_type_library->deref_ptr_type(*base_variable_type);
+						//Only the variable itself can be indexed as a pointer; see lookup_compile_variable.
+						base_variable_type = idx == 0 ? &_type_library->deref_ptr_type(*base_variable_type) : nullptr;
 					}
 					else
 					{
@@ -942,7 +1037,7 @@ namespace
 				}
 					break;
 				case variable_lookup_entry_type::value:
-					if (_type_library->is_pointer_type(*base_variable_type))
+					if (idx == 0 && is_indexable_pointer(*base_variable_type))
 					{
 						base_variable_type = &_type_library->deref_ptr_type(*base_variable_type);
 					}
@@ -990,17 +1085,21 @@ namespace
 			llvm::Value*			initial_resolution;
 			type_ref_ptr			final_type;
 			bool					is_stack;
+			//The chain indexes through the pointer a local holds, so the GEP starts from
+			//the loaded pointer rather than the local's slot.
+			bool					load_base;
 			vector<llvm::Value*>	GEPArgs;
 
 			variable_lookup_resolution_result()
 				: initial_resolution(nullptr)
 				, final_type(nullptr)
 				, is_stack(false)
+				, load_base(false)
 			{
 			}
 		};
 
-		variable_lookup_resolution_result lookup_compile_variable(const variable_lookup_chain& lookup_args)
+		variable_lookup_resolution_result lookup_compile_variable(compiler_context& context, const variable_lookup_chain& lookup_args)
 		{
 			variable_lookup_resolution_result retval;
 
@@ -1042,7 +1141,7 @@ namespace
 					case module_symbol_type::variable:
 					{
 						variable_node_ptr variable = symbol.data<variable_node_ptr>();
-						retval.initial_resolution = &variable->llvm_variable();
+						retval.initial_resolution = &context.module_variable(*variable);
 						retval.final_type = &variable->type();
 					}
 						break;
@@ -1053,7 +1152,11 @@ namespace
 			if (retval.initial_resolution && lookup_args.lookup_chain.size())
 			{
 				//bailing to only handle variable lookups. Accessors can come later.
-				if (retval.is_stack)
+				//Module variables are bound to the address they name, so only locals holding
+				//a pointer need a load before indexing.
+				if (retval.is_stack && is_indexable_pointer(*retval.final_type))
+					retval.load_base = true;
+				else if (retval.is_stack)
 					retval.GEPArgs.push_back(llvm::ConstantInt::get(llvm::IntegerType::getInt32Ty(llvm::getGlobalContext()), 0));
 				for (size_t idx = 0, end = lookup_args.lookup_chain.size(); 
 					idx < end && retval.final_type != nullptr ; ++idx)
@@ -1083,10 +1186,10 @@ namespace
 					case variable_lookup_entry_type::int64:
 					{
 						auto val_idx = static_cast<int32_t>( lookup_entry.data<int64_t>() );
-						if (_type_library->is_pointer_type(*retval.final_type))
+						if (is_indexable_pointer(*retval.final_type))
 						{
 							retval.GEPArgs.push_back(llvm::ConstantInt::get(llvm::IntegerType::getInt32Ty(llvm::getGlobalContext()), val_idx));
-							retval.final_type = &_type_library->deref_ptr_type(*retval.final_type);
+							retval.final_type = idx == 0 ? &_type_library->deref_ptr_type(*retval.final_type) : nullptr;
 						}
 						else
 						{
@@ -1106,7 +1209,8 @@ namespace
 						auto value = lookup_entry.data<llvm::Value*>();
 						//need to cast this to a 32 bit integer else kaboom in the gep instr itself.
 						retval.GEPArgs.push_back(value);
-						retval.final_type = &_type_library->deref_ptr_type(*retval.final_type);
+						retval.final_type = idx == 0 && is_indexable_pointer(*retval.final_type)
+							? &_type_library->deref_ptr_type(*retval.final_type) : nullptr;
 					}
 						break;
 					}
@@ -1119,15 +1223,22 @@ namespace
 		}
 
 
+		static llvm::Value* lookup_base(compiler_context& context, const variable_lookup_resolution_result& lookup_result)
+		{
+			if (lookup_result.load_base)
+				return context._builder.CreateLoad(lookup_result.initial_resolution);
+			return lookup_result.initial_resolution;
+		}
+
 		virtual pair<llvm::Value*, type_ref_ptr> load_variable(compiler_context& context, const variable_lookup_chain& lookup_args)
 		{
-			variable_lookup_resolution_result lookup_result = lookup_compile_variable(lookup_args);
+			variable_lookup_resolution_result lookup_result = lookup_compile_variable(context, lookup_args);
 			if (lookup_result.initial_resolution)
 			{
 				llvm::Value* loaded_value = nullptr;
 				if (lookup_result.GEPArgs.size())
 				{
-					llvm::Value* new_ptr = context._builder.CreateGEP(lookup_result.initial_resolution, lookup_result.GEPArgs);
+					llvm::Value* new_ptr = context._builder.CreateGEP(lookup_base(context, lookup_result), lookup_result.GEPArgs);
 					loaded_value = context._builder.CreateLoad(new_ptr);
 				}
 				else
@@ -1143,12 +1254,12 @@ namespace
 
 		virtual void store_variable(cclj::compiler_context& context, const variable_lookup_chain& lookup_args, llvm::Value& value)
 		{
-			variable_lookup_resolution_result lookup_result = lookup_compile_variable(lookup_args);
+			variable_lookup_resolution_result lookup_result = lookup_compile_variable(context, lookup_args);
 			if (lookup_result.initial_resolution)
 			{
 				if (lookup_result.GEPArgs.size())
 				{
-					llvm::Value* new_ptr = context._builder.CreateGEP(lookup_result.initial_resolution, lookup_result.GEPArgs);
+					llvm::Value* new_ptr = context._builder.CreateGEP(lookup_base(context, lookup_result), lookup_result.GEPArgs);
 					context._builder.CreateStore(&value, new_ptr);
 				}
 				else
@@ -1204,18 +1315,27 @@ namespace
 				}
 			});
 			//qualified_name nm, type_ref& rettype, named_type_buffer args, type_ref& fn_type
-			type_ref& fn_type = _type_library->get_type_ref("fn");
+			type_ref& fn_type = _type_library->get_type_ref(_type_library->well_known()._fn);
 			vector<string_table_str> name_args;
 			name_args.push_back(_string_table->register_str("module_init"));
 			qualified_name nm = _name_table->register_name(name_args);
-			if (_init_rettype == nullptr)
+			//The forms an earlier object already ran are gone.
+			if (_init_rettype == nullptr || _init_statements.empty())
 				_init_rettype = &_type_library->get_void_type();
 			_init_function = make_shared<function_node_impl>(nm, *_init_rettype, named_type_buffer(), fn_type);
 			_init_function->set_function_body(_init_statements);
+			//The entry point; the module passes would otherwise delete it as unused.
+			_init_function->set_visibility(visibility::external_visibility);
 			_init_function->compile_first_pass(ctx);
 		}
 		virtual void compile_second_pass(compiler_context& ctx)
 		{
+			//The cached object already has every body.
+			if (ctx._cached_object)
+			{
+				_init_statements.clear();
+				return;
+			}
 			for_each(_symbol_map.ordered_begin(), _symbol_map.ordered_end(), [&](symbol_map_type::ordered_entry_type& symbol_entry)
 			{
 				module_symbol_internal& symbol = symbol_entry->second;
@@ -1228,7 +1348,11 @@ namespace
 					vector<function_node_ptr>& fn_data = symbol.data<vector<function_node_ptr> >();
 					for_each(fn_data.begin(), fn_data.end(), [&](function_node_ptr fn)
 					{
-						fn->compile_second_pass(ctx);
+						function_node_impl* fn_impl = static_cast<function_node_impl*>(fn);
+						if (ctx._lazy_compilation && fn_impl->has_compiled_body())
+							ctx._lazy_functions[&fn_impl->llvm()] = fn_impl;
+						else
+							fn->compile_second_pass(ctx);
 					});
 				}
 					break;
@@ -1240,6 +1364,32 @@ namespace
 				}
 			});
 			_init_function->compile_second_pass(ctx);
+			if (ctx._separate_objects)
+				_init_statements.clear();
+			//Call sites compiled later may still use an intrinsic.
+			if (ctx._lazy_compilation)
+				return;
+			for_each(_symbol_map.ordered_begin(), _symbol_map.ordered_end(), [&](symbol_map_type::ordered_entry_type& symbol_entry)
+			{
+				module_symbol_internal& symbol = symbol_entry->second;
+				if (symbol.type() == module_symbol_type::function)
+				{
+					vector<function_node_ptr>& fn_data = symbol.data<vector<function_node_ptr> >();
+					for_each(fn_data.begin(), fn_data.end(), [&](function_node_ptr fn)
+					{
+						static_cast<function_node_impl*>(fn)->compile_intrinsic(ctx);
+					});
+				}
+			});
+		}
+		virtual void compile_lazy_function(compiler_context& ctx, llvm::Function& fn)
+		{
+			auto iter = ctx._lazy_functions.find(&fn);
+			if (iter == ctx._lazy_functions.end())
+				throw runtime_error("function is not waiting for lazy compilation");
+			function_node_impl* fn_impl = static_cast<function_node_impl*>(iter->second);
+			ctx._lazy_functions.erase(iter);
+			fn_impl->compile_body(ctx, fn);
 		}
 		//Returns the initialization function
 		virtual llvm::Function& llvm()
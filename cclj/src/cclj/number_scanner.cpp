@@ -0,0 +1,87 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#include "precompile.h"
+#include "cclj/number_scanner.h"
+
+using namespace cclj;
+
+namespace
+{
+	//Every power of ten up to 1e22 is exactly representable as a double so
+	//mantissa * 10^exp (or mantissa / 10^exp) below 2^53 rounds correctly.
+	const double exact_powers_of_ten[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+	const int32_t max_exact_power_of_ten = 22;
+	const uint64_t max_exact_mantissa = 1ULL << 53;
+
+	double parse_double_slow( const char* token, size_t token_len )
+	{
+		string temp( token, token_len );
+		return strtod( temp.c_str(), nullptr );
+	}
+}
+
+numeric_literal number_scanner::finish( const char* token, size_t token_len ) const
+{
+	switch( _state )
+	{
+	case states::zero:
+	case states::decimal:
+	case states::hex:
+	case states::binary:
+		{
+			if ( _truncated )
+				throw runtime_error( "integer literal does not fit in 64 bits" );
+			numeric_literal retval;
+			retval._type = numeric_literal_types::integer;
+			retval._integer = _negative ? ( ~_mantissa + 1 ) : _mantissa;
+			return retval;
+		}
+	case states::dot:
+	case states::fraction:
+	case states::exponent_digits:
+		{
+			int32_t power = _decimal_exponent + ( _exponent_negative ? -_exponent : _exponent );
+			double value;
+			if ( !_truncated
+				&& _mantissa <= max_exact_mantissa
+				&& power <= max_exact_power_of_ten
+				&& power >= -max_exact_power_of_ten )
+			{
+				value = static_cast<double>( _mantissa );
+				if ( power < 0 )
+					value /= exact_powers_of_ten[-power];
+				else
+					value *= exact_powers_of_ten[power];
+				if ( _negative )
+					value = -value;
+			}
+			else
+				value = parse_double_slow( token, token_len );
+			return numeric_literal::from_floating( value );
+		}
+	default:
+		return numeric_literal();
+	}
+}
+
+numeric_literal number_scanner::scan( const char* token, size_t token_len )
+{
+	number_scanner scanner;
+	for ( size_t idx = 0; idx < token_len && !scanner.is_symbol(); ++idx )
+		scanner.next( token[idx] );
+	return scanner.finish( token, token_len );
+}
+
+numeric_literal number_scanner::scan( const char* token )
+{
+	if ( token == nullptr ) return numeric_literal();
+	return scan( token, strlen( token ) );
+}
@@ -44,7 +44,7 @@ namespace
 			{
 									 cons_cell& arg_cell = object_traits::cast_ref<cons_cell>(item);
 									 symbol& fn_name = object_traits::cast_ref<symbol>(arg_cell._value);
-									 if (fn_name._name == context._string_table->register_str("unquote"))
+									 if (fn_name._name == context._string_table->well_known()._unquote)
 									 {
 										 cons_cell& uq_arg = object_traits::cast_ref<cons_cell>(arg_cell._next);
 										 symbol& uq_arg_sym = object_traits::cast_ref<symbol>(uq_arg._value);
@@ -111,7 +111,7 @@ namespace
 		static object_ptr lisp_apply(reader_context& context, cons_cell& cell)
 		{
 			symbol& app_name = object_traits::cast_ref<symbol>(cell._value);
-			if (app_name._name == context._string_table->register_str("quote"))
+			if (app_name._name == context._string_table->well_known()._quote)
 				return quote(context, object_traits::cast_ref<cons_cell>(cell._next));
 			else
 			{
@@ -126,7 +126,7 @@ namespace
 
 		static double eval_constant(reader_context& /*context*/, constant& src)
 		{
-			return std::stod(src._unparsed_number.c_str());
+			return src._value.cast<double>();
 		}
 
 		static object_ptr double_to_constant(reader_context& context, double& val)
@@ -137,9 +137,10 @@ namespace
 			char data_buf[1024];
 			sprintf(data_buf, "%f", val);
 			retval->_unparsed_number = context._string_table->register_str(data_buf);
+			retval->_value = numeric_literal::from_floating(val);
 			retval->_unevaled_type = typeval;
 			typeval->_value = type_name;
-			type_name->_name = context._string_table->register_str("f64");
+			type_name->_name = context._string_table->well_known()._f64;
 			return retval;
 		}
 
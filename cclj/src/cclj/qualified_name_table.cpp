@@ -7,6 +7,8 @@
 //==============================================================================
 #include "precompile.h"
 #include "cclj/qualified_name_table.h"
+#include "cclj/flat_hash_map.h"
+#include <deque>
 
 using namespace cclj;
 
@@ -18,11 +20,12 @@ namespace
 		size_t _hash_code;
 		qualified_name_key(data_buffer<string_table_str> buf)
 			: _buffer(buf)
-			, _hash_code(0)
+			, _hash_code(buf.size())
 		{
+			//Order matters; a.b and b.a must not collide.
 			for_each(buf.begin(), buf.end(), [this](string_table_str st)
 			{
-				_hash_code = _hash_code ^ std::hash<string_table_str>()(st);
+				_hash_code = hash_combine(_hash_code, std::hash<string_table_str>()(st));
 			});
 		}
 		qualified_name_key() : _hash_code(0) {}
@@ -39,26 +42,22 @@ namespace
 			return retval;
 		}
 	};
-}
 
-namespace std
-{
-	template<> struct hash<qualified_name_key>
+	struct qualified_name_key_hash
 	{
 		size_t operator()(const qualified_name_key& key) const
 		{
 			return key.hash_code();
 		}
 	};
-}
 
-namespace
-{
-	typedef unordered_map<qualified_name_key, vector<string_table_str> > qualified_name_key_map;
+	//Keys point into _storage, which is a deque so registered names never move.
+	typedef flat_hash_map<qualified_name_key, qualified_name, qualified_name_key_hash> qualified_name_key_map;
 	struct qualified_name_table_impl : public qualified_name_table
 	{
 		string_table_ptr		_string_table;
 		qualified_name_key_map _names;
+		std::deque<vector<string_table_str> > _storage;
 
 		qualified_name_table_impl(string_table_ptr st) : _string_table( st ) {}
 
@@ -66,15 +65,14 @@ namespace
 
 		virtual qualified_name register_name(string_table_str_buffer name)
 		{
-			qualified_name_key_map::iterator existing = _names.find(name);
-			if (existing == _names.end())
-			{
-				vector<string_table_str> data;
-				data.assign(name.begin(), name.end());
-				existing = _names.insert(make_pair(string_table_str_buffer(data), vector<string_table_str>())).first;
-				existing->second.swap(data);
-			}
-			return qualified_name::unsafe_create_qualified_name(existing->second);
+			qualified_name_key key(name);
+			qualified_name* existing = _names.find(key);
+			if (existing)
+				return *existing;
+			_storage.push_back(vector<string_table_str>(name.begin(), name.end()));
+			string_table_str_buffer stored(_storage.back());
+			return _names.insert(qualified_name_key(stored)
+								, qualified_name::unsafe_create_qualified_name(stored));
 		}
 	};
 }
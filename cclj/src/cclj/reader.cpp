@@ -0,0 +1,586 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#include "precompile.h"
+#include "cclj/reader.h"
+#include "cclj/number_scanner.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <thread>
+#include <exception>
+
+using namespace cclj;
+using namespace cclj::lisp;
+
+namespace {
+
+	struct reader
+	{
+		string_table_ptr	_str_table;
+		factory_ptr			_factory;
+		//Tokens are registered directly out of the source buffer; the reader never
+		//copies the text it is reading.
+		const char*			_str;
+		size_t				_cur_ptr;
+		size_t				_end_ptr;
+
+		reader( string_table_ptr st, factory_ptr f, const char* data, size_t len )
+			: _str_table( st )
+			, _factory( f )
+			, _str( data )
+			, _cur_ptr( 0 )
+			, _end_ptr( len )
+		{
+		}
+		
+
+		static bool is_white(char data)
+		{
+			return data == ' '
+					|| data == '\t'
+					|| data == '\n'
+					|| data == '\r';
+		}
+		static bool is_delimiter(char data )
+		{
+			return is_white( data )
+				|| data == '|'
+				|| data == '['
+				|| data == '('
+				|| data == ']'
+				|| data == ')'
+				|| data == ';';
+		}
+		char current_char()
+		{
+			if ( _cur_ptr < _end_ptr )
+				return _str[_cur_ptr];
+			throw runtime_error( "str access out of bounds" );
+		}
+		void eatwhite()
+		{
+			while( _cur_ptr != _end_ptr && ( is_white( current_char() ) || current_char() == ';' ) )
+			{
+				if ( current_char() == ';' )
+					for ( ; _cur_ptr != _end_ptr && current_char() != '\n'; ++_cur_ptr ) {}
+				else
+					 for ( ; _cur_ptr != _end_ptr && is_white( current_char() ); ++_cur_ptr ) {}
+			}
+		}
+
+		void find_delimiter()
+		{
+			for ( ; _cur_ptr != _end_ptr && !is_delimiter( current_char() ); ++_cur_ptr ) {}
+		}
+
+		//Find the end of the token classifying it as a number or symbol on the way.
+		void find_delimiter( number_scanner& scanner )
+		{
+			for ( ; _cur_ptr != _end_ptr && !is_delimiter( current_char() ); ++_cur_ptr ) 
+			{
+				scanner.next( current_char() );
+			}
+		}
+
+		bool atend()
+		{
+			return _cur_ptr >= _end_ptr || _cur_ptr == string::npos;
+		}
+
+		bool isnum()
+		{
+			return current_char() >= '0' && current_char() <= '9';
+		}
+
+		bool isplusminus()
+		{
+			return current_char() == '-' || current_char() == '+';
+		}
+
+		cons_cell* parse_type()
+		{
+			object_ptr item = parse_next_item();
+			if ( item->type() == types::symbol )
+			{
+				cons_cell* retval = _factory->create_cell();
+				retval->_value = item;
+				if ( current_char() == '[' )
+				{
+					cons_cell* next_cell = _factory->create_cell();
+					retval->_next = next_cell;
+					next_cell->_value = parse_next_item();
+				}
+				return retval;
+			}
+			else if ( item->type() == types::array )
+			{
+				cons_cell* retval = _factory->create_cell();
+				cons_cell* next_cell = _factory->create_cell();
+				retval->_next = next_cell;
+				next_cell->_value = item;
+				return retval;
+			}
+			return &object_traits::cast_ref<cons_cell>( item );
+		}
+
+
+		
+		object_ptr parse_number_or_symbol(size_t token_start, size_t token_end, const number_scanner& scanner)
+		{
+			if ( token_start >= _end_ptr || token_start == string::npos ) throw runtime_error( "fail" );
+			if ( token_end > _end_ptr ) token_end = _end_ptr;
+			const char* token = _str + token_start;
+			size_t token_len = token_end - token_start;
+			numeric_literal literal = scanner.finish( token, token_len );
+
+			//Parse each token.
+			if ( literal.is_numeric() )
+			{
+				constant* new_constant = _factory->create_constant();
+				new_constant->_unparsed_number = _str_table->register_str( token, token_len );
+				new_constant->_value = literal;
+				//Define the type.  If the data is suffixed, then we have it.
+				if( current_char() == '|' )
+				{
+					++_cur_ptr;
+					new_constant->_unevaled_type = parse_type();
+				}
+				else
+				{
+					new_constant->_unevaled_type = _factory->create_cell();
+					symbol* type_name = _factory->create_symbol();
+					if ( literal.is_floating() )
+						type_name->_name = _str_table->well_known()._f64;
+					else
+						type_name->_name = _str_table->well_known()._i64;
+					new_constant->_unevaled_type->_value = type_name;
+				}
+
+				return new_constant;
+			}
+			//symbol
+			else
+			{
+				//symbols are far harder to parse.
+				auto symbol_name = _str_table->register_str( token, token_len );
+
+				cons_cell* type_info = nullptr;
+				if ( !atend() && current_char() == '|' )
+				{
+					++_cur_ptr;
+					type_info = parse_type();
+				}
+				symbol* retval = _factory->create_symbol();
+				retval->_name = symbol_name;
+				retval->_unevaled_type = type_info;
+				return retval;
+			}
+
+		}
+
+		object_ptr parse_next_item()
+		{
+			eatwhite();
+			size_t token_start = _cur_ptr;
+			size_t token_char = current_char();
+			switch( token_char )
+			{
+			case '(': return parse_list();
+			case '[': return parse_array();
+				break;
+			default:
+				{
+					number_scanner scanner;
+					find_delimiter( scanner );
+					return parse_number_or_symbol( token_start, _cur_ptr, scanner );
+				}
+			}
+		}
+
+		object_ptr parse_array() 
+		{ 
+			array* retval = _factory->create_array();
+			++_cur_ptr;
+			if ( atend() ) throw runtime_error( "fail" );
+			if ( current_char() == ']' ) {
+				++_cur_ptr;
+				return retval;
+			}
+
+			vector<object_ptr> array_contents;
+			eatwhite();
+
+			while( current_char() != ']' )
+			{
+				array_contents.push_back( parse_next_item() );
+				eatwhite();
+			}
+			++_cur_ptr;
+
+			if ( array_contents.size() )
+			{
+				retval->_data = _factory->allocate_obj_buffer( array_contents.size() );
+				memcpy( retval->_data.begin(), &array_contents[0], array_contents.size() * sizeof( object_ptr ) );
+			}
+			return retval; 
+		}
+
+		object_ptr parse_list()
+		{
+			if ( current_char() != '(' ) throw runtime_error( "fail" );
+			++_cur_ptr;
+			eatwhite();
+			if ( atend() ) throw runtime_error( "fail" );
+
+			if (current_char() == ')' ) { ++_cur_ptr; return const_cast<cons_cell*>( &_factory->empty_cell() ); };
+
+			if ( current_char() == '(' ) throw runtime_error( "nested lists; invalid parsing" );
+			
+			cons_cell* retval = _factory->create_cell();
+			cons_cell* next_cell = nullptr;
+			while( current_char() != ')' )
+			{
+				if ( next_cell == nullptr )
+					next_cell = retval;
+				else
+				{
+					auto temp = _factory->create_cell();
+					next_cell->_next = temp;
+					next_cell = temp;
+				}
+				next_cell->_value = parse_next_item();
+				eatwhite();
+			}
+			//inc past the )
+			++_cur_ptr;
+			return retval;
+		}
+		//Returns the next top level form or nullptr at the end of the data.
+		object_ptr read_form()
+		{
+			while( atend() == false )
+			{
+				eatwhite();
+				find_delimiter();
+				if ( atend() == false )
+				{
+					char token_char = current_char();
+					if ( token_char == '(' )
+						return parse_list();
+					else if ( token_char == '[' )
+						return parse_array();
+					else if ( token_char == ')' || token_char == ']' || token_char == '|' )
+						throw runtime_error( "invalid program, unexpected character at top level" );
+				}
+			}
+			return nullptr;
+		}
+	};
+
+
+	struct buffer_form_reader : public form_reader
+	{
+		reader _reader;
+		buffer_form_reader( string_table_ptr st, factory_ptr f, const char* data, size_t len )
+			: _reader( st, f, data, len )
+		{
+		}
+		virtual object_ptr next_form() { return _reader.read_form(); }
+	};
+
+	//Read only mapping of an entire file.
+	struct mapped_file : noncopyable
+	{
+		const char*		_data;
+		size_t			_size;
+#ifdef _WIN32
+		HANDLE			_file;
+		HANDLE			_mapping;
+#endif
+
+		mapped_file( const string& path )
+			: _data( nullptr )
+			, _size( 0 )
+		{
+#ifdef _WIN32
+			_mapping = nullptr;
+			_file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr
+								, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+			if ( _file == INVALID_HANDLE_VALUE ) throw runtime_error( "failed to open file: " + path );
+			LARGE_INTEGER file_size;
+			if ( !GetFileSizeEx( _file, &file_size ) )
+			{
+				CloseHandle( _file );
+				throw runtime_error( "failed to size file: " + path );
+			}
+			_size = static_cast<size_t>( file_size.QuadPart );
+			if ( _size == 0 ) return;
+			_mapping = CreateFileMappingA( _file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+			if ( _mapping )
+				_data = reinterpret_cast<const char*>( MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, 0 ) );
+			if ( _data == nullptr )
+			{
+				if ( _mapping ) CloseHandle( _mapping );
+				CloseHandle( _file );
+				throw runtime_error( "failed to map file: " + path );
+			}
+#else
+			int fd = open( path.c_str(), O_RDONLY );
+			if ( fd < 0 ) throw runtime_error( "failed to open file: " + path );
+			struct stat st;
+			if ( fstat( fd, &st ) != 0 )
+			{
+				close( fd );
+				throw runtime_error( "failed to size file: " + path );
+			}
+			_size = static_cast<size_t>( st.st_size );
+			if ( _size )
+			{
+				void* mapping = mmap( nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0 );
+				if ( mapping == MAP_FAILED )
+				{
+					close( fd );
+					throw runtime_error( "failed to map file: " + path );
+				}
+				madvise( mapping, _size, MADV_SEQUENTIAL );
+				_data = reinterpret_cast<const char*>( mapping );
+			}
+			//The mapping keeps the file referenced.
+			close( fd );
+#endif
+		}
+
+		~mapped_file()
+		{
+#ifdef _WIN32
+			if ( _data ) UnmapViewOfFile( _data );
+			if ( _mapping ) CloseHandle( _mapping );
+			CloseHandle( _file );
+#else
+			if ( _data ) munmap( const_cast<char*>( _data ), _size );
+#endif
+		}
+	};
+
+	struct file_form_reader : public form_reader
+	{
+		mapped_file		_file;
+		reader			_reader;
+		file_form_reader( string_table_ptr st, factory_ptr f, const string& path )
+			: _file( path )
+			, _reader( st, f, _file._data, _file._size )
+		{
+		}
+		virtual object_ptr next_form() { return _reader.read_form(); }
+	};
+
+	//Finds the extent of top level forms by bracket depth so the stream reader only
+	//needs to hold the current form.  Brackets inside comments are ignored.
+	struct form_splitter
+	{
+		uint32_t	_depth;
+		bool		_in_comment;
+		form_splitter() : _depth( 0 ), _in_comment( false ) {}
+
+		//Returns true if this character closes a top level form.  form_start is set when
+		//it opens one.
+		bool next( char data, bool& form_start )
+		{
+			form_start = false;
+			if ( _in_comment )
+			{
+				if ( data == '\n' ) _in_comment = false;
+				return false;
+			}
+			switch( data )
+			{
+			case ';':
+				_in_comment = true;
+				return false;
+			case '(':
+			case '[':
+				form_start = _depth == 0;
+				++_depth;
+				return false;
+			case ')':
+			case ']':
+				if ( _depth == 0 ) throw runtime_error( "invalid program, unbalanced close bracket" );
+				--_depth;
+				return _depth == 0;
+			default:
+				return false;
+			}
+		}
+	};
+
+	struct form_extent
+	{
+		size_t _begin;
+		size_t _end;
+		form_extent( size_t b, size_t e ) : _begin( b ), _end( e ) {}
+	};
+
+	vector<form_extent> find_top_level_forms( const char* data, size_t len )
+	{
+		vector<form_extent> retval;
+		form_splitter splitter;
+		size_t form_begin = 0;
+		for ( size_t idx = 0; idx < len; ++idx )
+		{
+			bool form_start;
+			if ( splitter.next( data[idx], form_start ) )
+				retval.push_back( form_extent( form_begin, idx + 1 ) );
+			if ( form_start ) 
+				form_begin = idx;
+		}
+		if ( splitter._depth ) throw runtime_error( "invalid program, unexpected end of input" );
+		return retval;
+	}
+
+	struct stream_form_reader : public form_reader
+	{
+		string_table_ptr	_str_table;
+		factory_ptr			_factory;
+		std::istream&		_stream;
+		size_t				_chunk_size;
+		vector<char>		_buffer;
+		size_t				_scan_pos;
+		size_t				_form_start;
+		form_splitter		_splitter;
+
+		stream_form_reader( string_table_ptr st, factory_ptr f, std::istream& stream, size_t chunk_size )
+			: _str_table( st )
+			, _factory( f )
+			, _stream( stream )
+			, _chunk_size( std::max( chunk_size, static_cast<size_t>( 1 ) ) )
+			, _scan_pos( 0 )
+			, _form_start( 0 )
+		{
+		}
+
+		//Drop everything before the current form and append the next chunk.
+		bool fill()
+		{
+			size_t keep_from = _splitter._depth ? _form_start : _scan_pos;
+			_buffer.erase( _buffer.begin(), _buffer.begin() + keep_from );
+			_scan_pos -= keep_from;
+			_form_start -= std::min( _form_start, keep_from );
+			if ( !_stream.good() ) return false;
+			size_t old_size = _buffer.size();
+			_buffer.resize( old_size + _chunk_size );
+			_stream.read( &_buffer[old_size], static_cast<std::streamsize>( _chunk_size ) );
+			size_t read_amount = static_cast<size_t>( _stream.gcount() );
+			_buffer.resize( old_size + read_amount );
+			return read_amount != 0;
+		}
+
+		virtual object_ptr next_form()
+		{
+			for(;;)
+			{
+				for ( size_t end = _buffer.size(); _scan_pos < end; ++_scan_pos )
+				{
+					bool form_start;
+					bool form_end = _splitter.next( _buffer[_scan_pos], form_start );
+					if ( form_start ) _form_start = _scan_pos;
+					if ( form_end )
+					{
+						++_scan_pos;
+						reader form_reader( _str_table, _factory, &_buffer[_form_start], _scan_pos - _form_start );
+						return form_reader.read_form();
+					}
+				}
+				if ( !fill() )
+				{
+					if ( _splitter._depth ) throw runtime_error( "invalid program, unexpected end of input" );
+					return nullptr;
+				}
+			}
+		}
+	};
+}
+
+form_reader_ptr form_reader::create_buffer_reader( string_table_ptr st, factory_ptr f, const char* data, size_t len )
+{
+	return make_shared<buffer_form_reader>( st, f, data, len );
+}
+
+form_reader_ptr form_reader::create_file_reader( string_table_ptr st, factory_ptr f, const string& path )
+{
+	return make_shared<file_form_reader>( st, f, path );
+}
+
+form_reader_ptr form_reader::create_stream_reader( string_table_ptr st, factory_ptr f, std::istream& stream, size_t chunk_size )
+{
+	return make_shared<stream_form_reader>( st, f, stream, chunk_size );
+}
+
+vector<object_ptr> form_reader::read_parallel( string_table_ptr st, const vector<factory_ptr>& factories
+												, const char* data, size_t len )
+{
+	if ( factories.empty() ) throw runtime_error( "read_parallel requires at least one factory" );
+	vector<form_extent> extents = find_top_level_forms( data, len );
+	vector<object_ptr> retval( extents.size(), nullptr );
+	if ( extents.empty() ) return retval;
+
+	size_t thread_count = std::min( factories.size(), extents.size() );
+	string_table_ptr shared_table = string_table::create_synchronized( st );
+	vector<std::exception_ptr> errors( thread_count );
+	//Hand each thread a contiguous run of forms holding about the same number of bytes.
+	size_t bytes_per_thread = ( len + thread_count - 1 ) / thread_count;
+	vector<size_t> first_form( thread_count + 1, extents.size() );
+	first_form[0] = 0;
+	for ( size_t idx = 0, thread_idx = 1; idx < extents.size() && thread_idx < thread_count; ++idx )
+	{
+		if ( extents[idx]._begin >= bytes_per_thread * thread_idx )
+		{
+			first_form[thread_idx] = idx;
+			++thread_idx;
+		}
+	}
+	for ( size_t thread_idx = thread_count - 1; thread_idx > 0; --thread_idx )
+		first_form[thread_idx] = std::min( first_form[thread_idx], first_form[thread_idx+1] );
+
+	auto parse_range = [&]( size_t thread_idx )
+	{
+		try
+		{
+			string_table_ptr local_table = string_table::create_cache( shared_table );
+			for ( size_t idx = first_form[thread_idx], end = first_form[thread_idx+1]; idx < end; ++idx )
+			{
+				const form_extent& extent( extents[idx] );
+				reader form_reader( local_table, factories[thread_idx], data + extent._begin, extent._end - extent._begin );
+				retval[idx] = form_reader.read_form();
+			}
+		}
+		catch( ... )
+		{
+			errors[thread_idx] = std::current_exception();
+		}
+	};
+
+	vector<std::thread> threads;
+	for ( size_t thread_idx = 1; thread_idx < thread_count; ++thread_idx )
+		threads.push_back( std::thread( parse_range, thread_idx ) );
+	//The calling thread takes the first range.
+	parse_range( 0 );
+	for_each( threads.begin(), threads.end(), []( std::thread& thread ) { thread.join(); } );
+
+	for_each( errors.begin(), errors.end(), []( const std::exception_ptr& error )
+	{
+		if ( error ) std::rethrow_exception( error );
+	} );
+	return retval;
+}
@@ -0,0 +1,126 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#include "precompile.h"
+#include "cclj/runtime.h"
+
+using namespace cclj;
+
+namespace
+{
+	//Memory gc-alloc hands out; the caller's bytes follow this header.  Compiled code
+	//stores managed pointers into blocks without telling anyone, so marking treats every
+	//aligned word of the block as a possible pointer.
+	class managed_block : public gc_object
+	{
+		runtime&	_runtime;
+		uint32_t	_size;
+	public:
+		enum { data_offset = 32 };
+
+		managed_block( runtime& rt, uint32_t size )
+			: _runtime( rt )
+			, _size( size )
+		{
+		}
+
+		~managed_block()
+		{
+			_runtime.forget_block( data() );
+		}
+
+		virtual void mark_references( mark_buffer& buffer )
+		{
+			void** words = reinterpret_cast<void**>( data() );
+			for ( uint32_t idx = 0, end = _size / sizeof( void* ); idx < end; ++idx )
+			{
+				if ( words[idx] && _runtime.is_managed( words[idx] ) )
+					buffer.mark( from_data( words[idx] ) );
+			}
+		}
+
+		uint8_t* data() { return reinterpret_cast<uint8_t*>( this ) + data_offset; }
+
+		static managed_block& from_data( void* data )
+		{
+			return *reinterpret_cast<managed_block*>( reinterpret_cast<uint8_t*>( data ) - data_offset );
+		}
+	};
+
+	static_assert( sizeof( managed_block ) <= managed_block::data_offset, "managed block header too large" );
+}
+
+runtime::runtime( allocator_ptr alloc, size_t collection_bytes, gc_shadow_frame** shadow_stack )
+	: _allocator( alloc )
+	, _managed_heap( garbage_collector::create_mark_sweep( alloc ) )
+	, _shadow_stack( shadow_stack )
+	, _collection_bytes( collection_bytes )
+	, _managed_bytes( 0 )
+{
+}
+
+void* runtime::allocate( uint32_t size, uint8_t alignment )
+{
+	return _allocator->allocate( size, alignment, CCLJ_IMMEDIATE_FILE_INFO() );
+}
+
+void runtime::deallocate( void* data )
+{
+	_allocator->deallocate( data );
+}
+
+void* runtime::gc_allocate( uint32_t size )
+{
+	if ( _managed_bytes >= _collection_bytes )
+		collect();
+	gc_object& block = _managed_heap->allocate_object( managed_block::data_offset + size, managed_block::data_offset
+														, [this, size]( uint8_t* mem, size_t ) { return new (mem) managed_block( *this, size ); }
+														, CCLJ_IMMEDIATE_FILE_INFO() );
+	_managed_bytes += size;
+	uint8_t* retval = static_cast<managed_block&>( block ).data();
+	memset( retval, 0, size );
+	_live_blocks.insert( retval );
+	return retval;
+}
+
+void runtime::forget_block( const void* data )
+{
+	_live_blocks.erase( data );
+}
+
+void runtime::collect()
+{
+	vector<gc_object*> roots;
+	for ( gc_shadow_frame* frame = *_shadow_stack; frame; frame = frame->_previous )
+	{
+		for ( uint32_t idx = 0; idx < frame->_root_count; ++idx )
+		{
+			void* data = *reinterpret_cast<void**>( frame->_roots[idx] );
+			if ( data )
+				roots.push_back( &managed_block::from_data( data ) );
+		}
+	}
+	for_each( roots.begin(), roots.end(), [this]( gc_object* root ) { _managed_heap->lock( *root ); } );
+	_managed_heap->perform_gc();
+	for_each( roots.begin(), roots.end(), [this]( gc_object* root ) { _managed_heap->unlock( *root ); } );
+	_managed_bytes = 0;
+}
+
+void* runtime::rt_malloc( void* rt, uint32_t size, uint8_t alignment )
+{
+	return reinterpret_cast<runtime*>( rt )->allocate( size, alignment );
+}
+
+void runtime::rt_free( void* rt, void* data )
+{
+	reinterpret_cast<runtime*>( rt )->deallocate( data );
+}
+
+void* runtime::rt_gc_alloc( void* rt, uint32_t size )
+{
+	return reinterpret_cast<runtime*>( rt )->gc_allocate( size );
+}
@@ -7,51 +7,236 @@
 //==============================================================================
 #include "precompile.h"
 #include "cclj/string_table.h"
+#include "cclj/noncopyable.h"
+#include "cclj/algo_util.h"
+#include <mutex>
 
 using namespace cclj;
 
-namespace 
+namespace
 {
-	struct str_table_key
+	//fnv-1a over the span.
+	size_t hash_span( const char* data, size_t len )
 	{
-		string str;
-		size_t hash_code;
+		uint64_t retval = 14695981039346656037ULL;
+		for ( size_t idx = 0; idx < len; ++idx )
+		{
+			retval ^= static_cast<uint8_t>( data[idx] );
+			retval *= 1099511628211ULL;
+		}
+		return static_cast<size_t>( retval );
+	}
+
+	//Strings are laid out as [uint32_t length][characters][0] in large malloc'd blocks
+	//and never move, which is what gives string_table_str its identity.
+	class string_arena : noncopyable
+	{
+		vector<uint8_t*>	_blocks;
+		uint8_t*			_current;
+		size_t				_remaining;
+		enum { block_size = 64 * 1024 };
+
+	public:
+		string_arena() : _current( nullptr ), _remaining( 0 ) {}
+		~string_arena()
+		{
+			for_each( _blocks.begin(), _blocks.end(), []( uint8_t* block ) { free( block ); } );
+		}
 
-		str_table_key( const string& val ) 
-			: str( val )
-			, hash_code( std::hash<string>()( str ) )
+		const char* store( const char* data, size_t len )
 		{
+			if ( len > numeric_limits<uint32_t>::max() ) throw runtime_error( "string too long for string table" );
+			size_t needed = align_number( sizeof( uint32_t ) + len + 1, sizeof( uint32_t ) );
+			uint8_t* retval;
+			if ( needed > block_size / 4 )
+			{
+				//Big strings get their own block so they don't waste the rest of the current one.
+				retval = reinterpret_cast<uint8_t*>( malloc( needed ) );
+				_blocks.push_back( retval );
+			}
+			else
+			{
+				if ( needed > _remaining )
+				{
+					_current = reinterpret_cast<uint8_t*>( malloc( block_size ) );
+					_blocks.push_back( _current );
+					_remaining = block_size;
+				}
+				retval = _current;
+				_current += needed;
+				_remaining -= needed;
+			}
+			*reinterpret_cast<uint32_t*>( retval ) = static_cast<uint32_t>( len );
+			char* chars = reinterpret_cast<char*>( retval + sizeof( uint32_t ) );
+			memcpy( chars, data, len );
+			chars[len] = 0;
+			return chars;
 		}
-		bool operator==( const str_table_key& other ) const { return str == other.str; }
-		bool operator!=( const str_table_key& other ) const { return str != other.str; }
 	};
-}
 
-namespace std 
-{
-	template<> struct hash<str_table_key>
+	//Open addressing (linear probing, power of 2 capacity) set of interned strings.
+	//Lookups take a span so they never allocate.
+	class interned_set : noncopyable
 	{
-		size_t operator()( const str_table_key& key ) const { return key.hash_code; }
+		struct entry
+		{
+			const char*	str;
+			size_t		hash_code;
+			entry() : str( nullptr ), hash_code( 0 ) {}
+		};
+
+		vector<entry>	_entries;
+		size_t			_count;
+
+		size_t probe( const char* data, size_t len, size_t hash_code ) const
+		{
+			size_t mask = _entries.size() - 1;
+			for ( size_t idx = hash_code & mask; ; idx = ( idx + 1 ) & mask )
+			{
+				const entry& item( _entries[idx] );
+				if ( item.str == nullptr ) return idx;
+				if ( item.hash_code == hash_code
+					&& string_table_str::unsafe_create_string_table_str( item.str ).size() == len
+					&& memcmp( item.str, data, len ) == 0 )
+					return idx;
+			}
+		}
+
+		void grow()
+		{
+			vector<entry> old_entries( _entries.size() * 2 );
+			old_entries.swap( _entries );
+			size_t mask = _entries.size() - 1;
+			for_each( old_entries.begin(), old_entries.end(), [&]( const entry& item )
+			{
+				if ( item.str == nullptr ) return;
+				size_t idx = item.hash_code & mask;
+				while( _entries[idx].str ) idx = ( idx + 1 ) & mask;
+				_entries[idx] = item;
+			} );
+		}
+
+	public:
+		interned_set() : _entries( 256 ), _count( 0 ) {}
+
+		const char* find( const char* data, size_t len, size_t hash_code ) const
+		{
+			return _entries[probe( data, len, hash_code )].str;
+		}
+
+		//str must be a table string equal to the span that missed in find.
+		void insert( const char* str, size_t hash_code )
+		{
+			//Keep the load factor under 1/2 so probe sequences stay short.
+			if ( ( _count + 1 ) * 2 > _entries.size() )
+				grow();
+			entry& item( _entries[probe( str, string_table_str::unsafe_create_string_table_str( str ).size(), hash_code )] );
+			item.str = str;
+			item.hash_code = hash_code;
+			++_count;
+		}
 	};
-}
 
-namespace 
-{
-	typedef unordered_map<str_table_key,string> TKeyStrMap;
 	struct str_table_impl : public string_table
 	{
-		TKeyStrMap str_table;
-		str_table_impl(){}
-		
-		virtual string_table_str register_str( const char* data )
+		string_arena		_arena;
+		interned_set		_strings;
+
+		str_table_impl()
 		{
-			if ( is_trivial( data ) ) { return string_table_str(); }
-			str_table_key theKey( data );
-			pair<TKeyStrMap::iterator, bool> inserter = str_table.insert( make_pair( theKey, string() ) );
-			if ( inserter.second ) inserter.first->second.assign( data );
-			return string_table_str::unsafe_create_string_table_str( inserter.first->second.c_str() );
+			_well_known.initialize( *this );
+		}
+
+		virtual string_table_str register_str( const char* data, size_t len )
+		{
+			if ( data == nullptr || len == 0 ) { return string_table_str(); }
+			size_t hash_code = hash_span( data, len );
+			const char* retval = _strings.find( data, len, hash_code );
+			if ( retval == nullptr )
+			{
+				retval = _arena.store( data, len );
+				_strings.insert( retval, hash_code );
+			}
+			return string_table_str::unsafe_create_string_table_str( retval );
+		}
+	};
+
+	struct synchronized_str_table : public string_table
+	{
+		string_table_ptr	_table;
+		std::mutex			_mutex;
+		synchronized_str_table( string_table_ptr table ) 
+			: _table( table ) 
+		{
+			_well_known = table->well_known();
+		}
+
+		virtual string_table_str register_str( const char* data, size_t len )
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			return _table->register_str( data, len );
 		}
 	};
+
+	struct cached_str_table : public string_table
+	{
+		string_table_ptr	_backing;
+		interned_set		_cache;
+		cached_str_table( string_table_ptr backing ) 
+			: _backing( backing ) 
+		{
+			_well_known = backing->well_known();
+		}
+
+		virtual string_table_str register_str( const char* data, size_t len )
+		{
+			if ( data == nullptr || len == 0 ) { return string_table_str(); }
+			size_t hash_code = hash_span( data, len );
+			const char* retval = _cache.find( data, len, hash_code );
+			if ( retval == nullptr )
+			{
+				retval = _backing->register_str( data, len ).c_str();
+				_cache.insert( retval, hash_code );
+			}
+			return string_table_str::unsafe_create_string_table_str( retval );
+		}
+	};
+}
+
+void well_known_symbols::initialize( string_table& table )
+{
+	_ptr = table.register_str( "ptr" );
+	_gcptr = table.register_str( "gcptr" );
+	_void = table.register_str( "void" );
+	_tuple = table.register_str( "tuple" );
+	_unqual = table.register_str( "unqual" );
+	_fn = table.register_str( "fn" );
+	_quote = table.register_str( "quote" );
+	_unquote = table.register_str( "unquote" );
+	_scope_value = table.register_str( "scope-value" );
+	_lhs = table.register_str( "lhs" );
+	_rhs = table.register_str( "rhs" );
+	_f32 = table.register_str( "f32" );
+	_f64 = table.register_str( "f64" );
+	_i1 = table.register_str( "i1" );
+	_i8 = table.register_str( "i8" );
+	_u8 = table.register_str( "u8" );
+	_i16 = table.register_str( "i16" );
+	_u16 = table.register_str( "u16" );
+	_i32 = table.register_str( "i32" );
+	_u32 = table.register_str( "u32" );
+	_i64 = table.register_str( "i64" );
+	_u64 = table.register_str( "u64" );
 }
 
-string_table_ptr string_table::create() { return make_shared<str_table_impl>(); }
\ No newline at end of file
+string_table_ptr string_table::create() { return make_shared<str_table_impl>(); }
+
+string_table_ptr string_table::create_synchronized( string_table_ptr table )
+{
+	return make_shared<synchronized_str_table>( table );
+}
+
+string_table_ptr string_table::create_cache( string_table_ptr backing )
+{
+	return make_shared<cached_str_table>( backing );
+}
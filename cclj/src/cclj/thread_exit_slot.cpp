@@ -0,0 +1,63 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#include "precompile.h"
+#include "cclj/thread_exit_slot.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+using namespace cclj;
+
+namespace {
+
+	uintptr_t create_key( thread_exit_slot::exit_fn on_exit )
+	{
+#ifdef _WIN32
+		DWORD retval = FlsAlloc( on_exit );
+		if ( retval == FLS_OUT_OF_INDEXES )
+			throw runtime_error( "failed to allocate a fiber local storage index" );
+		return static_cast<uintptr_t>( retval );
+#else
+		pthread_key_t retval;
+		if ( pthread_key_create( &retval, on_exit ) )
+			throw runtime_error( "failed to create a thread key" );
+		return static_cast<uintptr_t>( retval );
+#endif
+	}
+
+	void delete_key( uintptr_t key )
+	{
+#ifdef _WIN32
+		FlsFree( static_cast<DWORD>( key ) );
+#else
+		pthread_key_delete( static_cast<pthread_key_t>( key ) );
+#endif
+	}
+}
+
+void thread_exit_slot::set( void* value )
+{
+	uintptr_t key = _key.load();
+	if ( key == 0 )
+	{
+		//Two threads may race to create the key; the loser deletes its own.
+		uintptr_t created = create_key( _on_exit ) + 1;
+		if ( _key.compare_exchange_strong( key, created ) )
+			key = created;
+		else
+			delete_key( created - 1 );
+	}
+#ifdef _WIN32
+	FlsSetValue( static_cast<DWORD>( key - 1 ), value );
+#else
+	pthread_setspecific( static_cast<pthread_key_t>( key - 1 ), value );
+#endif
+}
@@ -7,6 +7,7 @@
 //==============================================================================
 #include "precompile.h"
 #include "cclj/lisp_types.h"
+#include "cclj/flat_hash_map.h"
 
 
 using namespace cclj;
@@ -19,15 +20,17 @@ namespace  {
 		string_table_str	_name;
 		type_ref_ptr_buffer _specializations;
 		size_t				_hash_code;
+		type_map_key() : _hash_code( 0 ) {}
 		type_map_key( string_table_str n, type_ref_ptr_buffer s )
 			: _name( n )
 			, _specializations( s )
 		{
-			_hash_code = std::hash<string_table_str>()( _name );
+			//Order matters; fn[i32 f32] and fn[f32 i32] must not collide.
+			_hash_code = hash_combine( std::hash<string_table_str>()( _name ), _specializations.size() );
 			for_each( _specializations.begin(), _specializations.end(), [this]
 			( type_ref_ptr ref )
 			{
-				_hash_code = _hash_code ^ reinterpret_cast<size_t>( ref );
+				_hash_code = hash_combine( _hash_code, reinterpret_cast<size_t>( ref ) );
 			} );
 		}
 
@@ -48,23 +51,17 @@ namespace  {
 			return false;
 		}
 	};
-}
 
-namespace std
-{
-	template<> struct hash<type_map_key>
+	struct type_map_key_hash
 	{
 		size_t operator()( const type_map_key& k ) const { return k._hash_code; }
 	};
-}
-
-namespace {
 
 	class type_library_impl : public type_library
 	{
 		allocator_ptr		_allocator;
 		string_table_ptr	_str_table;
-		typedef unordered_map<type_map_key, type_ref_ptr> type_map;
+		typedef flat_hash_map<type_map_key, type_ref_ptr, type_map_key_hash> type_map;
 		type_map _types;
 	public:
 		type_library_impl( allocator_ptr alloc, string_table_ptr str_t )
@@ -75,20 +72,50 @@ namespace {
 
 		~type_library_impl()
 		{
-			for_each( _types.begin(), _types.end(), 
-			[this](type_map::value_type& type )
+			_types.visit( [this]( const type_map_key&, type_ref_ptr type )
 			{
-				_allocator->deallocate( type.second );
+				_allocator->deallocate( type );
 			} );
 		}
 		
 		virtual string_table_ptr string_table() { return _str_table; }
 
+		virtual const well_known_symbols& well_known() { return _str_table->well_known(); }
+
+		void classify( type_ref& type )
+		{
+			const well_known_symbols& symbols( well_known() );
+			size_t num_specs = type._specializations.size();
+			if ( type._name == symbols._ptr && num_specs == 1 )
+				type._kind = type_kinds::pointer;
+			else if ( type._name == symbols._gcptr && num_specs == 1 )
+				type._kind = type_kinds::managed_pointer;
+			else if ( type._name == symbols._tuple )
+				type._kind = type_kinds::tuple;
+			else if ( type._name == symbols._fn )
+				type._kind = type_kinds::fn;
+			else if ( num_specs == 0 )
+			{
+				if ( type._name == symbols._void )
+					type._kind = type_kinds::void_type;
+				else if ( type._name == symbols._unqual )
+					type._kind = type_kinds::unqual;
+#define CCLJ_HANDLE_LIST_NUMERIC_TYPE(name)						\
+				else if ( type._name == symbols._##name )			\
+				{													\
+					type._kind = type_kinds::base_numeric;			\
+					type._base_numeric_type = base_numeric_types::name;	\
+				}
+				CCLJ_LIST_ITERATE_BASE_NUMERIC_TYPES
+#undef CCLJ_HANDLE_LIST_NUMERIC_TYPE
+			}
+		}
+
 		virtual type_ref& get_type_ref( string_table_str name, type_ref_ptr_buffer _specializations )
 		{
 			type_map_key theKey( name, _specializations );
-			type_map::iterator iter = _types.find( theKey );
-			if ( iter != _types.end() ) return *iter->second;
+			type_ref_ptr* existing = _types.find( theKey );
+			if ( existing ) return **existing;
 			size_t type_size = sizeof( type_ref );
 			size_t array_size = sizeof( type_ref_ptr ) * _specializations.size();
 			uint8_t* mem = _allocator->allocate( type_size + array_size, sizeof(void*), CCLJ_IMMEDIATE_FILE_INFO() );
@@ -100,8 +127,9 @@ namespace {
 				memcpy( array_data, _specializations.begin(), array_size );
 				retval->_specializations = type_ref_ptr_buffer( array_data, _specializations.size() );
 			}
+			classify( *retval );
 			theKey = type_map_key( name, retval->_specializations );
-			_types.insert( make_pair( theKey, retval ) );
+			_types.insert( theKey, retval );
 			return *retval;
 		}
 	};
@@ -115,7 +143,7 @@ type_library_ptr type_library::create_type_library( allocator_ptr allocator, str
 string type_ref::to_string()
 {
 	string retval;
-	retval.append( _name.c_str() );
+	retval.append( _name.c_str(), _name.size() );
 	if ( _specializations.size() )
 	{
 		retval.append( "[" );
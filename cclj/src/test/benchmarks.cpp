@@ -0,0 +1,603 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#include "precompile.h"
+#include "cclj/cclj.h"
+#include "cclj/compiler.h"
+#include "cclj/type_library.h"
+#include "cclj/allocator.h"
+#include "cclj/garbage_collector.h"
+#include "corpus_files.h"
+#include <chrono>
+#include <thread>
+#include <sstream>
+
+using namespace cclj;
+using std::cout;
+using std::endl;
+using std::stringstream;
+
+//Benchmarks are disabled by default; run them with
+//cclj_tests --gtest_also_run_disabled_tests --gtest_filter=benchmarks.*
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock bench_clock;
+
+	double elapsed_ms( bench_clock::time_point start )
+	{
+		return std::chrono::duration<double, std::milli>( bench_clock::now() - start ).count();
+	}
+
+	//Synthetic source of roughly the requested size made of small top level functions.
+	string generate_reader_source( size_t approx_size )
+	{
+		string retval;
+		retval.reserve( approx_size + 128 );
+		for ( size_t idx = 0; retval.size() < approx_size; ++idx )
+		{
+			stringstream form;
+			form << "(defn fn" << idx << "|f32 [a|f32 b|f32] (+ a b 1.5|f32))\n";
+			retval.append( form.str() );
+		}
+		return retval;
+	}
+}
+
+TEST(benchmarks, DISABLED_reader_scaling)
+{
+	size_t sizes[] = { 1024, 10 * 1024, 100 * 1024, 1024 * 1024, 10 * 1024 * 1024, 100 * 1024 * 1024 };
+	for ( size_t idx = 0, end = sizeof(sizes)/sizeof(*sizes); idx < end; ++idx )
+	{
+		string source = generate_reader_source( sizes[idx] );
+		auto compiler_ptr = compiler::create();
+		auto start = bench_clock::now();
+		auto forms = compiler_ptr->read( source );
+		double ms = elapsed_ms( start );
+		double mb = static_cast<double>( source.size() ) / ( 1024.0 * 1024.0 );
+		cout << "reader: " << source.size() << " bytes, " << forms.size() << " forms, "
+			<< ms << " ms, " << ( ms > 0.0 ? mb / ( ms / 1000.0 ) : 0.0 ) << " MB/s" << endl;
+		ASSERT_FALSE( forms.empty() );
+	}
+}
+
+TEST(benchmarks, DISABLED_parallel_reader)
+{
+	string source;
+	for ( size_t idx = 0; idx < 50000; ++idx )
+	{
+		stringstream form;
+		form << "(defn fn" << idx << "|f32 [a|f32 b|f32] (+ a b 1.5|f32))\n";
+		source.append( form.str() );
+	}
+	double mb = static_cast<double>( source.size() ) / ( 1024.0 * 1024.0 );
+	uint32_t thread_counts[] = { 1, 2, 4, 8 };
+	for ( size_t idx = 0, end = sizeof(thread_counts)/sizeof(*thread_counts); idx < end; ++idx )
+	{
+		auto compiler_ptr = compiler::create();
+		auto start = bench_clock::now();
+		auto forms = compiler_ptr->read_parallel( source, thread_counts[idx] );
+		double ms = elapsed_ms( start );
+		cout << "parallel reader: " << thread_counts[idx] << " threads, " << forms.size() << " forms, "
+			<< ms << " ms, " << ( ms > 0.0 ? mb / ( ms / 1000.0 ) : 0.0 ) << " MB/s" << endl;
+		ASSERT_EQ( 50000U, forms.size() );
+	}
+}
+
+TEST(benchmarks, DISABLED_type_check)
+{
+	size_t form_counts[] = { 1000, 10000, 50000 };
+	for ( size_t idx = 0, end = sizeof(form_counts)/sizeof(*form_counts); idx < end; ++idx )
+	{
+		string source;
+		for ( size_t form_idx = 0; form_idx < form_counts[idx]; ++form_idx )
+		{
+			stringstream form;
+			form << "(defn fn" << form_idx << "|f32 [a|f32 b|f32] (let [c (* a b)] (if (< c 10.0|f32) (+ c 1.5|f32) (- c b))))\n";
+			source.append( form.str() );
+		}
+		auto compiler_ptr = compiler::create();
+		auto forms = compiler_ptr->read( source );
+		auto start = bench_clock::now();
+		compiler_ptr->type_check( forms );
+		double ms = elapsed_ms( start );
+		cout << "type check: " << forms.size() << " forms, " << ms << " ms, "
+			<< ( ms > 0.0 ? static_cast<double>( forms.size() ) / ( ms / 1000.0 ) : 0.0 ) << " forms/s" << endl;
+	}
+}
+
+TEST(benchmarks, DISABLED_macro_expansion)
+{
+	//The macros from corpus/macro_fn2.cclj; every use runs the compile time recursion
+	//and builds a constant during type checking.
+	const char* macros =
+		"(def-macro-fn recurse-add-macro [a] (if (> a 0) (+ a (recurse-add-macro (- a 1))) 0))\n"
+		"(defmacro compile-time-recurse-add[a b] (let [added (recurse-add-macro (eval a)) type-data (get-type b)] (create-constant added type-data )))\n";
+	size_t use_counts[] = { 100, 1000, 10000 };
+	for ( size_t idx = 0, end = sizeof(use_counts)/sizeof(*use_counts); idx < end; ++idx )
+	{
+		string source( macros );
+		for ( size_t use_idx = 0; use_idx < use_counts[idx]; ++use_idx )
+			source.append( "(+ (compile-time-recurse-add (+ 5 4) |f32) 10|f32)\n" );
+		auto compiler_ptr = compiler::create();
+		auto forms = compiler_ptr->read( source );
+		auto start = bench_clock::now();
+		compiler_ptr->type_check( forms );
+		double ms = elapsed_ms( start );
+		cout << "macro expansion: " << use_counts[idx] << " uses, " << ms << " ms, "
+			<< ( ms > 0.0 ? static_cast<double>( use_counts[idx] ) / ( ms / 1000.0 ) : 0.0 ) << " uses/s" << endl;
+	}
+}
+
+//The loop from corpus/dynamic_mem.cclj's sum without the memory access; every iteration
+//is one compare, one integer add and one float add.
+TEST(benchmarks, DISABLED_arithmetic_loop)
+{
+	uint32_t iterations[] = { 1000, 10000000, 100000000 };
+	double base_ms = 0;
+	for ( size_t idx = 0, end = sizeof(iterations)/sizeof(*iterations); idx < end; ++idx )
+	{
+		stringstream source;
+		source << "(defn sum|f32 [len|u32]\n"
+			"  (let [retval 0|f32\n"
+			"        ignored (for [idx 0|u32] (< idx len) [(set idx (+ idx 1|u32))] (set retval (+ retval 1|f32)))]\n"
+			"    retval))\n"
+			"(sum " << iterations[idx] << "|u32)\n";
+		auto compiler_ptr = compiler::create();
+		auto start = bench_clock::now();
+		compiler_ptr->execute( source.str() );
+		double ms = elapsed_ms( start );
+		//The smallest run is mostly compile time.
+		if ( idx == 0 )
+			base_ms = ms;
+		double loop_ns = ( ms - base_ms ) * 1000000.0 / static_cast<double>( iterations[idx] );
+		cout << "arithmetic loop: " << iterations[idx] << " iterations, " << ms << " ms, "
+			<< ( idx == 0 ? 0.0 : loop_ns ) << " ns/iteration" << endl;
+	}
+}
+
+namespace
+{
+	//Visits every object reachable from the form using object_traits::cast at each step
+	//like the type checker and macro expansion do.
+	size_t walk_form( lisp::object_ptr obj )
+	{
+		using namespace cclj::lisp;
+		size_t retval = 1;
+		for ( cons_cell* cell = object_traits::cast<cons_cell>( obj ); cell; cell = object_traits::cast<cons_cell>( cell->_next ) )
+			retval += walk_form( cell->_value );
+		if ( array* item = object_traits::cast<array>( obj ) )
+			for_each( item->_data.begin(), item->_data.end(), [&]( object_ptr entry ) { retval += walk_form( entry ); } );
+		if ( symbol* item = object_traits::cast<symbol>( obj ) )
+			if ( item->_unevaled_type ) retval += walk_form( item->_unevaled_type );
+		if ( constant* item = object_traits::cast<constant>( obj ) )
+			if ( item->_unevaled_type ) retval += walk_form( item->_unevaled_type );
+		return retval;
+	}
+}
+
+TEST(benchmarks, DISABLED_form_traversal)
+{
+	string source;
+	for ( size_t idx = 0; idx < 100000; ++idx )
+	{
+		stringstream form;
+		form << "(defn fn" << idx << "|f32 [a|f32 b|f32] (let [c (* a b)] (if (< c 10.0|f32) (+ c 1.5|f32) (- c b))))\n";
+		source.append( form.str() );
+	}
+	auto compiler_ptr = compiler::create();
+	auto forms = compiler_ptr->read( source );
+	auto start = bench_clock::now();
+	size_t visited = 0;
+	for ( size_t pass = 0; pass < 20; ++pass )
+		for_each( forms.begin(), forms.end(), [&]( lisp::object_ptr form ) { visited += walk_form( form ); } );
+	double ms = elapsed_ms( start );
+	cout << "form traversal: " << visited << " objects, " << ms << " ms, "
+		<< ( ms > 0.0 ? static_cast<double>( visited ) / ( ms / 1000.0 ) : 0.0 ) << " objects/s" << endl;
+}
+
+TEST(benchmarks, DISABLED_type_interning)
+{
+	//1000 base types and every two argument fn over them; 1,001,000 types total.
+	//The second pass finds every one of them again.
+	auto str_table = string_table::create();
+	auto type_lib = type_library::create_type_library( allocator::create_checking_allocator(), str_table );
+	vector<type_ref_ptr> base_types;
+	for ( size_t idx = 0; idx < 1000; ++idx )
+	{
+		stringstream name;
+		name << "type" << idx;
+		base_types.push_back( &type_lib->get_type_ref( name.str().c_str() ) );
+	}
+	for ( size_t pass = 0; pass < 2; ++pass )
+	{
+		auto start = bench_clock::now();
+		size_t count = 0;
+		for ( size_t lhs = 0; lhs < 1000; ++lhs )
+		{
+			for ( size_t rhs = 0; rhs < 1000; ++rhs )
+			{
+				type_ref_ptr specs[2] = { base_types[lhs], base_types[rhs] };
+				type_lib->get_type_ref( str_table->well_known()._fn, type_ref_ptr_buffer( specs, 2 ) );
+				++count;
+			}
+		}
+		double ms = elapsed_ms( start );
+		cout << "type interning " << ( pass ? "lookup" : "insert" ) << ": " << count << " types, "
+			<< ms << " ms, " << ( ms > 0.0 ? static_cast<double>( count ) / ( ms / 1000.0 ) : 0.0 ) << " types/s" << endl;
+	}
+}
+
+namespace
+{
+	//Interleaved allocations and frees of the sizes the compiler asks for most (cells,
+	//type_refs, slab pages) with a working set that stays around 4k live allocations.
+	double run_allocator_benchmark( allocator_ptr alloc, size_t count )
+	{
+		size_t sizes[] = { 16, 24, 32, 48, 64, 96, 128, 4096 };
+		vector<uint8_t*> live( 4096, nullptr );
+		uint32_t rand_state = 1;
+		auto start = bench_clock::now();
+		for ( size_t idx = 0; idx < count; ++idx )
+		{
+			rand_state = rand_state * 1664525 + 1013904223;
+			uint8_t*& slot( live[( rand_state >> 8 ) % live.size()] );
+			alloc->deallocate( slot );
+			slot = alloc->allocate( sizes[( rand_state >> 20 ) % 8], sizeof( void* ), CCLJ_IMMEDIATE_FILE_INFO() );
+		}
+		double ms = elapsed_ms( start );
+		for_each( live.begin(), live.end(), [&]( uint8_t* ptr ) { alloc->deallocate( ptr ); } );
+		return ms;
+	}
+}
+
+TEST(benchmarks, DISABLED_allocators)
+{
+	size_t count = 10000000;
+	double checking_ms = run_allocator_benchmark( allocator::create_checking_allocator(), count );
+	double fast_ms = run_allocator_benchmark( allocator::create_fast_allocator(), count );
+	double sampled_ms = run_allocator_benchmark( allocator::create_fast_allocator( 1024 ), count );
+	cout << "allocators: " << count << " allocations, checking " << checking_ms << " ms, fast "
+		<< fast_ms << " ms, fast sampling 1/1024 " << sampled_ms << " ms" << endl;
+}
+
+TEST(benchmarks, DISABLED_thread_caching_allocator)
+{
+	//Every thread runs the same allocate/free loop; one allocation in 16 is handed to
+	//the next thread to free so the cross thread path is exercised.  With per thread
+	//caches total throughput should scale with the thread count.
+	size_t per_thread = 2000000;
+	double single_thread_rate = 0.0;
+	uint32_t thread_counts[] = { 1, 2, 4, 8, 16 };
+	for ( size_t count_idx = 0, count_end = sizeof(thread_counts)/sizeof(*thread_counts); count_idx < count_end; ++count_idx )
+	{
+		uint32_t thread_count = thread_counts[count_idx];
+		auto alloc = allocator::create_thread_caching_allocator();
+		vector<std::atomic<uint8_t*> > handoff( thread_count );
+		for_each( handoff.begin(), handoff.end(), []( std::atomic<uint8_t*>& slot ) { slot.store( nullptr ); } );
+		auto start = bench_clock::now();
+		vector<std::thread> threads;
+		for ( uint32_t thread_idx = 0; thread_idx < thread_count; ++thread_idx )
+		{
+			threads.push_back( std::thread( [&, thread_idx]()
+			{
+				size_t sizes[] = { 16, 24, 32, 48, 64, 96, 128, 4096 };
+				vector<uint8_t*> live( 1024, nullptr );
+				uint32_t rand_state = thread_idx + 1;
+				for ( size_t idx = 0; idx < per_thread; ++idx )
+				{
+					rand_state = rand_state * 1664525 + 1013904223;
+					uint8_t*& slot( live[( rand_state >> 8 ) % live.size()] );
+					if ( slot && ( rand_state & 0xf ) == 0 )
+						slot = handoff[( thread_idx + 1 ) % thread_count].exchange( slot );
+					alloc->deallocate( slot );
+					slot = alloc->allocate( sizes[( rand_state >> 20 ) % 8], sizeof( void* ), CCLJ_IMMEDIATE_FILE_INFO() );
+				}
+				for_each( live.begin(), live.end(), [&]( uint8_t* ptr ) { alloc->deallocate( ptr ); } );
+			} ) );
+		}
+		for_each( threads.begin(), threads.end(), []( std::thread& thread ) { thread.join(); } );
+		double ms = elapsed_ms( start );
+		for_each( handoff.begin(), handoff.end(), [&]( std::atomic<uint8_t*>& slot ) { alloc->deallocate( slot.load() ); } );
+		double rate = ms > 0.0 ? static_cast<double>( per_thread * thread_count ) / ( ms / 1000.0 ) : 0.0;
+		if ( thread_count == 1 ) single_thread_rate = rate;
+		cout << "thread caching allocator: " << thread_count << " threads, " << rate << " allocations/s, "
+			<< ( single_thread_rate > 0.0 ? rate / single_thread_rate : 0.0 ) << "x" << endl;
+	}
+}
+
+namespace
+{
+	class bench_gc_object : public gc_object
+	{
+	public:
+		vector<gc_refcount_ptr<bench_gc_object> > _references;
+		virtual void mark_references( mark_buffer& buffer )
+		{
+			for_each( _references.begin(), _references.end(), [&]( gc_refcount_ptr<bench_gc_object>& ref ) { buffer.mark( ref ); } );
+		}
+	};
+
+	bench_gc_object* create_bench_object( garbage_collector& gc )
+	{
+		return static_cast<bench_gc_object*>( &gc.allocate_object( sizeof( bench_gc_object ), sizeof( void* ), []( uint8_t* mem, size_t )
+		{
+			return new (mem) bench_gc_object();
+		}, CCLJ_IMMEDIATE_FILE_INFO() ) );
+	}
+
+	//wide: one root with every object as a direct child.
+	//deep: 64 roots each heading a long chain.
+	//random: chains plus random cross links.
+	void build_bench_graph( garbage_collector& gc, const char* shape, size_t count, vector<gc_lock_ptr<bench_gc_object> >& roots
+							, garbage_collector_ptr gc_ptr )
+	{
+		vector<bench_gc_object*> objects;
+		for ( size_t idx = 0; idx < count; ++idx )
+			objects.push_back( create_bench_object( gc ) );
+		string shape_name( shape );
+		uint32_t rand_state = 1;
+		if ( shape_name == "wide" )
+		{
+			objects[0]->_references.assign( objects.begin() + 1, objects.end() );
+			roots.push_back( gc_lock_ptr<bench_gc_object>( gc_ptr, objects[0] ) );
+			return;
+		}
+		size_t chain_length = count / 64;
+		for ( size_t idx = 0; idx < count; ++idx )
+		{
+			if ( idx % chain_length == 0 )
+				roots.push_back( gc_lock_ptr<bench_gc_object>( gc_ptr, objects[idx] ) );
+			else
+				objects[idx - 1]->_references.push_back( objects[idx] );
+			if ( shape_name == "random" )
+			{
+				rand_state = rand_state * 1664525 + 1013904223;
+				objects[idx]->_references.push_back( objects[( rand_state >> 8 ) % count] );
+			}
+		}
+	}
+}
+
+TEST(benchmarks, DISABLED_parallel_mark)
+{
+	const char* shapes[] = { "wide", "deep", "random" };
+	uint32_t thread_counts[] = { 1, 2, 4, 8 };
+	size_t object_count = 2000000;
+	for ( size_t shape_idx = 0; shape_idx < 3; ++shape_idx )
+	{
+		for ( size_t count_idx = 0; count_idx < 4; ++count_idx )
+		{
+			gc_options options;
+			options._mark_thread_count = thread_counts[count_idx];
+			auto gc = garbage_collector::create_mark_sweep( allocator::create_fast_allocator(), options );
+			{
+				vector<gc_lock_ptr<bench_gc_object> > roots;
+				build_bench_graph( *gc, shapes[shape_idx], object_count, roots, gc );
+				//Nothing is garbage so the collection time is almost all mark.
+				gc->perform_gc();
+				auto start = bench_clock::now();
+				gc->perform_gc();
+				double ms = elapsed_ms( start );
+				cout << "parallel mark: " << shapes[shape_idx] << " graph, " << object_count << " objects, "
+					<< thread_counts[count_idx] << " threads, " << ms << " ms" << endl;
+			}
+		}
+	}
+}
+
+//A large long lived heap plus mostly short lived allocation with a slowly growing set
+//of survivors, collected every round by each collector.
+TEST(benchmarks, DISABLED_generational_gc)
+{
+	const char* names[] = { "mark sweep", "generational" };
+	size_t rounds = 50;
+	size_t objects_per_round = 200000;
+	size_t long_lived_objects = 1000000;
+	for ( int gc_idx = 0; gc_idx < 2; ++gc_idx )
+	{
+		auto alloc = allocator::create_fast_allocator();
+		auto gc = gc_idx == 0 ? garbage_collector::create_mark_sweep( alloc ) : garbage_collector::create_generational( alloc );
+		{
+			gc_lock_ptr<bench_gc_object> root( gc, create_bench_object( *gc ) );
+			gc_lock_ptr<bench_gc_object> long_lived( gc, create_bench_object( *gc ) );
+			for ( size_t idx = 0; idx < long_lived_objects; ++idx )
+				long_lived->_references.push_back( create_bench_object( *gc ) );
+			gc->perform_full_gc();
+			double alloc_ms = 0;
+			double gc_ms = 0;
+			double max_pause_ms = 0;
+			for ( size_t round = 0; round < rounds; ++round )
+			{
+				auto start = bench_clock::now();
+				bench_gc_object* previous = nullptr;
+				for ( size_t idx = 0; idx < objects_per_round; ++idx )
+				{
+					bench_gc_object* item = create_bench_object( *gc );
+					//Short chains of garbage; one object in a hundred is kept.
+					if ( previous && idx % 8 ) item->_references.push_back( previous );
+					if ( idx % 100 == 0 ) root->_references.push_back( item );
+					previous = item;
+				}
+				alloc_ms += elapsed_ms( start );
+				start = bench_clock::now();
+				gc->perform_gc();
+				double pause = elapsed_ms( start );
+				gc_ms += pause;
+				max_pause_ms = std::max( max_pause_ms, pause );
+			}
+			cout << names[gc_idx] << ": " << rounds * objects_per_round << " objects, allocation " << alloc_ms
+				<< " ms, collection " << gc_ms << " ms, max pause " << max_pause_ms << " ms, "
+				<< root->_references.size() << " survivors" << endl;
+		}
+	}
+}
+
+//Full collection pauses with and without the background sweeper.  Time spent waiting for
+//the previous sweep is reported separately; it is only large when the sweeper has no
+//core of its own.
+TEST(benchmarks, DISABLED_background_sweep)
+{
+	size_t rounds = 100;
+	size_t objects_per_round = 100000;
+	for ( int gc_idx = 0; gc_idx < 2; ++gc_idx )
+	{
+		for ( int background = 0; background < 2; ++background )
+		{
+			gc_options options;
+			options._background_sweep = background != 0;
+			auto alloc = allocator::create_fast_allocator();
+			auto gc = gc_idx == 0 ? garbage_collector::create_mark_sweep( alloc, options )
+									: garbage_collector::create_generational( alloc, options );
+			vector<double> pauses;
+			double wait_ms = 0;
+			{
+				gc_lock_ptr<bench_gc_object> root( gc, create_bench_object( *gc ) );
+				for ( size_t round = 0; round < rounds; ++round )
+				{
+					bench_gc_object* previous = nullptr;
+					for ( size_t idx = 0; idx < objects_per_round; ++idx )
+					{
+						bench_gc_object* item = create_bench_object( *gc );
+						if ( previous && idx % 8 ) item->_references.push_back( previous );
+						if ( idx % 1000 == 0 ) root->_references.push_back( item );
+						previous = item;
+					}
+					auto start = bench_clock::now();
+					gc->finish_sweep();
+					wait_ms += elapsed_ms( start );
+					start = bench_clock::now();
+					gc->perform_full_gc();
+					pauses.push_back( elapsed_ms( start ) );
+				}
+				gc->finish_sweep();
+			}
+			sort( pauses.begin(), pauses.end() );
+			cout << ( gc_idx == 0 ? "mark sweep" : "generational" ) << ( background ? ", background sweep" : ", synchronous sweep" )
+				<< ": median pause " << pauses[pauses.size() / 2] << " ms, p99 pause " << pauses[pauses.size() * 99 / 100] << " ms, waited on the sweeper " << wait_ms << " ms" << endl;
+		}
+	}
+}
+
+//Stop the world pause against the slices of an incremental collection of the same heap.
+TEST(benchmarks, DISABLED_incremental_gc)
+{
+	size_t live_objects = 1000000;
+	size_t garbage_objects = 1000000;
+	uint32_t budgets[] = { 0, 250, 1000 };
+	for ( int budget_idx = 0; budget_idx < 3; ++budget_idx )
+	{
+		uint32_t budget = budgets[budget_idx];
+		auto gc = garbage_collector::create_mark_sweep( allocator::create_fast_allocator() );
+		{
+			//An 8 way tree; one object with a million references would be scanned in one
+			//go and blow any budget.
+			gc_lock_ptr<bench_gc_object> root( gc, create_bench_object( *gc ) );
+			vector<bench_gc_object*> nodes( 1, root.get() );
+			for ( size_t idx = 1; idx < live_objects; ++idx )
+			{
+				nodes.push_back( create_bench_object( *gc ) );
+				nodes[( idx - 1 ) / 8]->_references.push_back( nodes.back() );
+			}
+			nodes.clear();
+			for ( size_t idx = 0; idx < garbage_objects; ++idx )
+				create_bench_object( *gc );
+			if ( budget == 0 )
+			{
+				auto start = bench_clock::now();
+				gc->perform_gc();
+				cout << "stop the world: pause " << elapsed_ms( start ) << " ms" << endl;
+				continue;
+			}
+			vector<double> slices;
+			bool done = false;
+			while( !done )
+			{
+				auto start = bench_clock::now();
+				done = gc->gc_step( budget );
+				slices.push_back( elapsed_ms( start ) * 1000 );
+			}
+			double total = 0;
+			for_each( slices.begin(), slices.end(), [&]( double slice ) { total += slice; } );
+			sort( slices.begin(), slices.end() );
+			cout << "incremental, " << budget << " us budget: " << slices.size() << " slices, total " << total / 1000
+				<< " ms, p99 slice " << slices[slices.size() * 99 / 100] << " us, max slice " << slices.back() << " us" << endl;
+		}
+	}
+}
+
+//Compile time and run time of the corpus at each optimization level.
+TEST(benchmarks, DISABLED_optimization_levels)
+{
+	const char* level_names[] = { "O0", "O1", "O2", "O3", "Os" };
+	const char* corpus[] = { "basic1", "basic2", "basic3", "basic4", "for_loop", "gc_alloc" };
+	const int runs = 20;
+	for ( int level = optimization_levels::O0; level <= optimization_levels::Os; ++level )
+	{
+		double compile_ms = 0;
+		double run_ms = 0;
+		for ( size_t idx = 0, end = sizeof(corpus)/sizeof(*corpus); idx < end; ++idx )
+		{
+			compiler_options options;
+			options._optimization_level = static_cast<optimization_levels::_enum>( level );
+			auto compiler_ptr = compiler::create( options );
+			auto reader = compiler_ptr->create_file_reader( corpus_source_file( corpus[idx] ) );
+			for ( lisp::object_ptr form = reader->next_form(); form; form = reader->next_form() )
+				compiler_ptr->type_check_form( form );
+			auto start = bench_clock::now();
+			auto compile_result = compiler_ptr->compile();
+			//The JIT generates machine code on the first call.
+			typedef float (*anon_fn_type)();
+			anon_fn_type exec_fn = reinterpret_cast<anon_fn_type>( compile_result.first );
+			exec_fn();
+			double file_compile_ms = elapsed_ms( start );
+			start = bench_clock::now();
+			for ( int run = 0; run < runs; ++run )
+				exec_fn();
+			double file_run_ms = elapsed_ms( start ) / runs;
+			cout << level_names[level] << " " << corpus[idx] << ": compile " << file_compile_ms << " ms, run "
+				<< file_run_ms << " ms" << endl;
+			compile_ms += file_compile_ms;
+			run_ms += file_run_ms;
+		}
+		cout << level_names[level] << " total: compile " << compile_ms << " ms, run " << run_ms << " ms" << endl;
+	}
+}
+
+//Time to the first result of a module that defines many functions and calls one.
+TEST(benchmarks, DISABLED_lazy_compilation)
+{
+	string source = many_functions_source( 2000, 1000 );
+	for ( int lazy = 0; lazy < 2; ++lazy )
+	{
+		compiler_options options;
+		options._lazy_compilation = lazy != 0;
+		auto compiler_ptr = compiler::create( options );
+		auto start = bench_clock::now();
+		ASSERT_EQ( 1004.0f, compiler_ptr->execute( source ) );
+		cout << ( lazy ? "lazy" : "eager" ) << ": " << elapsed_ms( start ) << " ms" << endl;
+	}
+}
+
+//Cold start compiles into a fresh object cache, warm start maps the objects cold start wrote.
+TEST(benchmarks, DISABLED_object_cache)
+{
+	compiler_options options;
+	options._object_cache_dir = temp_path( "cclj_object_cache_bench_" );
+	temp_path_remover remover;
+	remover._paths.push_back( options._object_cache_dir );
+	string source = many_functions_source( 2000, 1000 );
+	for ( int warm = 0; warm < 2; ++warm )
+	{
+		auto compiler_ptr = compiler::create( options );
+		auto start = bench_clock::now();
+		ASSERT_EQ( 1004.0f, compiler_ptr->execute( source ) );
+		ASSERT_EQ( 125.0f, compiler_ptr->execute_file( corpus_source_file( "for_loop" ) ) );
+		cout << ( warm ? "warm" : "cold" ) << ": " << elapsed_ms( start ) << " ms, "
+			<< compiler_ptr->object_cache_hits() << " hits" << endl;
+	}
+}
@@ -0,0 +1,179 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#include "precompile.h"
+#include "corpus_files.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+#include <cstring>
+#include <chrono>
+#include <cstdlib>
+
+using namespace cclj;
+using std::endl;
+
+string executable_path()
+{
+#ifdef _WIN32
+	char temp_buf[1024];
+	GetModuleFileNameA ( NULL, temp_buf, 1024 );
+	return temp_buf;
+#else
+	char buf[1024];
+	ssize_t len = readlink( "/proc/self/exe", buf, sizeof( buf ) );
+	return string( buf, len > 0 ? static_cast<size_t>( len ) : 0 );
+#endif
+}
+
+bool is_directory(const string& str )
+{
+#ifdef _WIN32
+	DWORD atts = GetFileAttributesA( str.c_str() );
+	return atts != INVALID_FILE_ATTRIBUTES && ( atts &  FILE_ATTRIBUTE_DIRECTORY );
+#else
+	struct stat st;
+	std::memset( &st, 0, sizeof( st ) );
+	stat( str.c_str(), &st );
+	return S_ISDIR(st.st_mode);
+#endif
+}
+
+string parent_path( const string& str )
+{
+	if ( str.size() < 3 ) return "";
+	size_t pos = str.find_last_of( "\\/" );
+	if ( pos != string::npos )
+		return str.substr(0, pos );
+	return "";
+}
+
+string append_path( const string& base, const string& append )
+{
+	string retval = base;
+	if ( retval.size() == 0 ) return retval;
+
+	if ( retval.find_last_of( "\\/" ) != retval.size() - 1 )
+		retval.append( "/" );
+
+	retval.append( append );
+
+	return retval;
+}
+
+string temp_path( const char* prefix )
+{
+	static atomic<uint32_t> counter( 0 );
+#ifdef _WIN32
+	char temp_buf[MAX_PATH + 1];
+	DWORD len = GetTempPathA( sizeof( temp_buf ), temp_buf );
+	string dir( temp_buf, len );
+#else
+	const char* env_dir = getenv( "TMPDIR" );
+	string dir( env_dir && *env_dir ? env_dir : "/tmp" );
+#endif
+	stringstream name;
+	name << prefix << std::chrono::system_clock::now().time_since_epoch().count() << "_" << ++counter;
+	return append_path( dir, name.str() );
+}
+
+void remove_path( const string& path )
+{
+#ifdef _WIN32
+	DWORD atts = GetFileAttributesA( path.c_str() );
+	if ( atts == INVALID_FILE_ATTRIBUTES )
+		return;
+	if ( atts & FILE_ATTRIBUTE_DIRECTORY )
+	{
+		WIN32_FIND_DATAA find_data;
+		HANDLE find_handle = FindFirstFileA( append_path( path, "*" ).c_str(), &find_data );
+		if ( find_handle != INVALID_HANDLE_VALUE )
+		{
+			do
+			{
+				string name( find_data.cFileName );
+				if ( name != "." && name != ".." )
+					remove_path( append_path( path, name ) );
+			} while ( FindNextFileA( find_handle, &find_data ) );
+			FindClose( find_handle );
+		}
+		RemoveDirectoryA( path.c_str() );
+	}
+	else
+		DeleteFileA( path.c_str() );
+#else
+	struct stat st;
+	if ( lstat( path.c_str(), &st ) )
+		return;
+	if ( S_ISDIR( st.st_mode ) )
+	{
+		DIR* dir = opendir( path.c_str() );
+		if ( dir )
+		{
+			for ( dirent* entry = readdir( dir ); entry; entry = readdir( dir ) )
+			{
+				string name( entry->d_name );
+				if ( name != "." && name != ".." )
+					remove_path( append_path( path, name ) );
+			}
+			closedir( dir );
+		}
+		rmdir( path.c_str() );
+	}
+	else
+		unlink( path.c_str() );
+#endif
+}
+
+namespace
+{
+
+string corpus_dir()
+{
+	string exec_path( executable_path() );
+	string dir = parent_path( exec_path );
+	while( !dir.empty() )
+	{
+		string test = dir;
+		test = append_path( test, "corpus" );
+		if ( is_directory( test ) )
+			return test;
+		dir = parent_path( dir );
+	}
+	throw runtime_error( "Failed to find test dir" );
+}
+
+}
+
+string corpus_file( const char* fname )
+{
+	auto test_file = corpus_dir();
+	test_file = append_path( test_file, fname );
+	return test_file;
+}
+
+string corpus_source_file( const char* fname )
+{
+	string nameExt( fname );
+	nameExt.append( ".cclj" );
+	return corpus_file( nameExt.c_str() );
+}
+
+string many_functions_source( int count, int called )
+{
+	stringstream source;
+	for ( int idx = 0; idx < count; ++idx )
+		source << "(defn fn-" << idx << "|f32 [val|f32] (+ (* val val) " << idx << "|f32))" << endl;
+	source << "(fn-" << called << " 2|f32)" << endl;
+	return source.str();
+}
@@ -0,0 +1,38 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#ifndef CCLJ_TEST_CORPUS_FILES_H
+#define CCLJ_TEST_CORPUS_FILES_H
+#pragma once
+#include "cclj/cclj.h"
+
+//Paths the tests and benchmarks share.  The corpus directory is the first directory
+//named corpus found walking up from the test executable.
+std::string executable_path();
+bool is_directory( const std::string& str );
+std::string parent_path( const std::string& str );
+std::string append_path( const std::string& base, const std::string& append );
+std::string corpus_file( const char* fname );
+//fname.cclj in the corpus directory.
+std::string corpus_source_file( const char* fname );
+
+//A path under the system temp directory starting with prefix that nothing exists at yet.
+std::string temp_path( const char* prefix );
+//Deletes the file or directory tree at path, if there is one.
+void remove_path( const std::string& path );
+
+//Removes its paths on scope exit, so a failing assert still cleans up.
+struct temp_path_remover
+{
+	std::vector<std::string> _paths;
+	~temp_path_remover() { for ( size_t idx = 0; idx < _paths.size(); ++idx ) remove_path( _paths[idx] ); }
+};
+
+//Source defining fn-0 through fn-<count - 1> followed by a call to fn-<called>.
+std::string many_functions_source( int count, int called );
+
+#endif
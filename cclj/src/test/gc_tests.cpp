@@ -0,0 +1,607 @@
+//==============================================================================
+//  Copyright 2013, Chris Nuernberger
+//	ALL RIGHTS RESERVED
+//
+//  This code is licensed under the BSD license.  Terms of the
+//	license are located under the top cclj directory
+//==============================================================================
+#include "precompile.h"
+#include "cclj/garbage_collector.h"
+#include "cclj/runtime.h"
+#include <thread>
+
+using namespace cclj;
+
+namespace
+{
+	class test_object : public gc_object
+	{
+		int*	_live_count;
+	public:
+		vector<gc_refcount_ptr<test_object> > _references;
+
+		test_object( int* live_count ) : _live_count( live_count ) { ++*_live_count; }
+		~test_object() { --*_live_count; }
+
+		virtual void mark_references( mark_buffer& buffer )
+		{
+			for_each( _references.begin(), _references.end(), [&]( gc_refcount_ptr<test_object>& ref )
+			{
+				buffer.mark( ref );
+			} );
+		}
+	};
+
+	test_object& create_test_object( garbage_collector& gc, int& live_count )
+	{
+		gc_object& retval = gc.allocate_object( sizeof( test_object ), sizeof( void* ), [&]( uint8_t* mem, size_t )
+		{
+			return new (mem) test_object( &live_count );
+		}, CCLJ_IMMEDIATE_FILE_INFO() );
+		return static_cast<test_object&>( retval );
+	}
+}
+
+TEST(gc_tests, cycles)
+{
+	int live_count = 0;
+	auto alloc = allocator::create_checking_allocator();
+	{
+		auto gc = garbage_collector::create_mark_sweep( alloc );
+		test_object& first = create_test_object( *gc, live_count );
+		test_object& second = create_test_object( *gc, live_count );
+		first._references.push_back( &second );
+		second._references.push_back( &first );
+		first._references.push_back( &first );
+		ASSERT_EQ( 2, live_count );
+		gc->perform_gc();
+		ASSERT_EQ( 0, live_count );
+		ASSERT_EQ( 0U, gc->all_objects().size() );
+	}
+}
+
+TEST(gc_tests, locked_roots)
+{
+	int live_count = 0;
+	auto alloc = allocator::create_checking_allocator();
+	{
+		auto gc = garbage_collector::create_mark_sweep( alloc );
+		test_object& root = create_test_object( *gc, live_count );
+		test_object& child = create_test_object( *gc, live_count );
+		create_test_object( *gc, live_count );
+		root._references.push_back( &child );
+		{
+			gc_lock_ptr<test_object> root_lock( gc, root );
+			gc_lock_ptr<test_object> second_lock( root_lock );
+			ASSERT_TRUE( root.flags().is_locked() );
+			ASSERT_EQ( 1U, gc->locked_objects().size() );
+			//Marks alternate between collections; both epochs must keep the roots.
+			for ( int idx = 0; idx < 3; ++idx )
+			{
+				gc->perform_gc();
+				ASSERT_EQ( 2, live_count );
+			}
+			second_lock = gc_lock_ptr<test_object>();
+			gc->perform_gc();
+			ASSERT_EQ( 2, live_count );
+		}
+		ASSERT_FALSE( root.flags().is_locked() );
+		ASSERT_EQ( 0U, gc->locked_objects().size() );
+		gc->perform_gc();
+		ASSERT_EQ( 0, live_count );
+	}
+}
+
+TEST(gc_tests, refcounted_interior_references)
+{
+	int live_count = 0;
+	auto alloc = allocator::create_checking_allocator();
+	{
+		auto gc = garbage_collector::create_mark_sweep( alloc );
+		gc_lock_ptr<test_object> root( gc, create_test_object( *gc, live_count ) );
+		test_object& middle = create_test_object( *gc, live_count );
+		test_object& leaf = create_test_object( *gc, live_count );
+		root->_references.push_back( &middle );
+		middle._references.push_back( &leaf );
+		middle._references.push_back( &leaf );
+		ASSERT_EQ( 1, middle.refcount() );
+		ASSERT_EQ( 2, leaf.refcount() );
+		for ( int idx = 0; idx < 3; ++idx )
+		{
+			gc->perform_gc();
+			ASSERT_EQ( 3, live_count );
+		}
+		root->_references.clear();
+		ASSERT_EQ( 0, middle.refcount() );
+		gc->perform_gc();
+		ASSERT_EQ( 1, live_count );
+		ASSERT_EQ( 1U, gc->all_objects().size() );
+	}
+	ASSERT_EQ( 0, live_count );
+}
+
+TEST(gc_tests, parallel_mark)
+{
+	int live_count = 0;
+	auto alloc = allocator::create_checking_allocator();
+	{
+		gc_options options;
+		options._mark_thread_count = 4;
+		auto gc = garbage_collector::create_mark_sweep( alloc, options );
+		//Random graph with a few long chains so threads have to steal.
+		vector<test_object*> objects;
+		for ( int idx = 0; idx < 20000; ++idx )
+			objects.push_back( &create_test_object( *gc, live_count ) );
+		uint32_t rand_state = 7;
+		for ( size_t idx = 0, end = objects.size(); idx < end; ++idx )
+		{
+			if ( idx % 1000 != 999 )
+				objects[idx]->_references.push_back( objects[idx + 1] );
+			rand_state = rand_state * 1664525 + 1013904223;
+			if ( ( rand_state >> 16 ) % 4 == 0 )
+				objects[idx]->_references.push_back( objects[( rand_state >> 8 ) % end] );
+		}
+		vector<gc_lock_ptr<test_object> > roots;
+		for ( size_t idx = 0, end = objects.size(); idx < end; idx += 2000 )
+			roots.push_back( gc_lock_ptr<test_object>( gc, objects[idx] ) );
+
+		//Count what should survive with a plain traversal.
+		unordered_set<test_object*> reachable;
+		vector<test_object*> pending;
+		for_each( roots.begin(), roots.end(), [&]( gc_lock_ptr<test_object>& root ) { pending.push_back( root.get() ); } );
+		while( !pending.empty() )
+		{
+			test_object* obj = pending.back();
+			pending.pop_back();
+			if ( !reachable.insert( obj ).second ) continue;
+			for_each( obj->_references.begin(), obj->_references.end(), [&]( gc_refcount_ptr<test_object>& ref ) { pending.push_back( ref.get() ); } );
+		}
+		objects.clear();
+		for ( int idx = 0; idx < 3; ++idx )
+		{
+			gc->perform_gc();
+			ASSERT_EQ( static_cast<int>( reachable.size() ), live_count );
+		}
+		roots.clear();
+		gc->perform_gc();
+		ASSERT_EQ( 0, live_count );
+	}
+}
+
+TEST(gc_tests, generational_minor_collection)
+{
+	int live_count = 0;
+	auto alloc = allocator::create_checking_allocator();
+	{
+		auto gc = garbage_collector::create_generational( alloc );
+		gc_lock_ptr<test_object> root( gc, create_test_object( *gc, live_count ) );
+		test_object& kept = create_test_object( *gc, live_count );
+		root->_references.push_back( &kept );
+		//A chain of garbage; only its head has no references.
+		test_object* previous = nullptr;
+		for ( int idx = 0; idx < 100; ++idx )
+		{
+			test_object& item = create_test_object( *gc, live_count );
+			if ( previous ) item._references.push_back( previous );
+			previous = &item;
+		}
+		ASSERT_EQ( 102, live_count );
+		gc->perform_gc();
+		ASSERT_EQ( 2, live_count );
+		ASSERT_TRUE( root->flags().is_mature() );
+		ASSERT_TRUE( kept.flags().is_mature() );
+
+		//Young objects referenced only from old ones survive minor collections.
+		test_object& young = create_test_object( *gc, live_count );
+		kept._references.push_back( &young );
+		create_test_object( *gc, live_count );
+		ASSERT_FALSE( young.flags().is_mature() );
+		gc->perform_gc();
+		ASSERT_EQ( 3, live_count );
+		ASSERT_TRUE( young.flags().is_mature() );
+
+		//Old garbage waits for a full collection.
+		root->_references.clear();
+		gc->perform_gc();
+		ASSERT_EQ( 3, live_count );
+		gc->perform_full_gc();
+		ASSERT_EQ( 1, live_count );
+		ASSERT_EQ( 1U, gc->all_objects().size() );
+	}
+	ASSERT_EQ( 0, live_count );
+}
+
+TEST(gc_tests, generational_young_cycles)
+{
+	int live_count = 0;
+	auto alloc = allocator::create_checking_allocator();
+	{
+		auto gc = garbage_collector::create_generational( alloc );
+		test_object& first = create_test_object( *gc, live_count );
+		test_object& second = create_test_object( *gc, live_count );
+		first._references.push_back( &second );
+		second._references.push_back( &first );
+		gc->perform_gc();
+		ASSERT_EQ( 2, live_count );
+		gc->perform_full_gc();
+		ASSERT_EQ( 0, live_count );
+		ASSERT_EQ( 0U, gc->all_objects().size() );
+	}
+}
+
+TEST(gc_tests, generational_threaded_allocation)
+{
+	const int thread_count = 4;
+	const int objects_per_thread = 20000;
+	int live_counts[thread_count] = { 0 };
+	auto alloc = allocator::create_checking_allocator();
+	{
+		auto gc = garbage_collector::create_generational( alloc );
+		vector<gc_lock_ptr<test_object> > roots;
+		for ( int idx = 0; idx < thread_count; ++idx )
+			roots.push_back( gc_lock_ptr<test_object>( gc, create_test_object( *gc, live_counts[idx] ) ) );
+		//Run twice so the second round allocates in memory the first round freed.
+		for ( int round = 1; round <= 2; ++round )
+		{
+			vector<std::thread> threads;
+			for ( int thread_idx = 0; thread_idx < thread_count; ++thread_idx )
+			{
+				threads.push_back( std::thread( [&, thread_idx]()
+				{
+					test_object& root( *roots[thread_idx] );
+					for ( int idx = 0; idx < objects_per_thread; ++idx )
+					{
+						test_object& item = create_test_object( *gc, live_counts[thread_idx] );
+						if ( idx % 10 == 0 )
+							root._references.push_back( &item );
+					}
+				} ) );
+			}
+			for_each( threads.begin(), threads.end(), []( std::thread& thread ) { thread.join(); } );
+			gc->perform_gc();
+			for ( int idx = 0; idx < thread_count; ++idx )
+				ASSERT_EQ( 1 + round * objects_per_thread / 10, live_counts[idx] );
+		}
+	}
+	for ( int idx = 0; idx < thread_count; ++idx )
+		ASSERT_EQ( 0, live_counts[idx] );
+}
+
+TEST(gc_tests, background_sweep)
+{
+	for ( int gc_idx = 0; gc_idx < 2; ++gc_idx )
+	{
+		//Separate counts; the sweeper decrements one while this thread increments the other.
+		int garbage_count = 0;
+		int live_count = 0;
+		auto alloc = allocator::create_checking_allocator();
+		{
+			gc_options options;
+			options._background_sweep = true;
+			auto gc = gc_idx == 0 ? garbage_collector::create_mark_sweep( alloc, options )
+									: garbage_collector::create_generational( alloc, options );
+			gc_lock_ptr<test_object> root( gc, create_test_object( *gc, live_count ) );
+			for ( int round = 1; round <= 4; ++round )
+			{
+				//Garbage chains with cycles in them.
+				test_object* previous = nullptr;
+				for ( int idx = 0; idx < 10000; ++idx )
+				{
+					test_object& item = create_test_object( *gc, garbage_count );
+					if ( previous )
+					{
+						item._references.push_back( previous );
+						if ( idx % 2 ) previous->_references.push_back( &item );
+					}
+					previous = &item;
+				}
+				gc->perform_full_gc();
+				//Keep allocating while the sweeper runs.
+				for ( int idx = 0; idx < 1000; ++idx )
+					root->_references.push_back( &create_test_object( *gc, live_count ) );
+				gc->finish_sweep();
+				ASSERT_EQ( 0, garbage_count );
+				ASSERT_EQ( 1 + round * 1000, live_count );
+			}
+		}
+		ASSERT_EQ( 0, live_count );
+	}
+}
+
+namespace
+{
+	vector<test_object*> reachable_from( test_object& root )
+	{
+		vector<test_object*> retval;
+		unordered_set<test_object*> seen;
+		vector<test_object*> pending( 1, &root );
+		while( !pending.empty() )
+		{
+			test_object* obj = pending.back();
+			pending.pop_back();
+			if ( !seen.insert( obj ).second ) continue;
+			retval.push_back( obj );
+			for_each( obj->_references.begin(), obj->_references.end(), [&]( gc_refcount_ptr<test_object>& ref ) { pending.push_back( ref.get() ); } );
+		}
+		return retval;
+	}
+}
+
+TEST(gc_tests, incremental_mark_with_mutation)
+{
+	int live_count = 0;
+	auto alloc = allocator::create_checking_allocator();
+	{
+		auto gc = garbage_collector::create_mark_sweep( alloc );
+		gc_lock_ptr<test_object> root( gc, create_test_object( *gc, live_count ) );
+		test_object* previous = root.get();
+		for ( int idx = 0; idx < 2000; ++idx )
+		{
+			test_object& item = create_test_object( *gc, live_count );
+			previous->_references.push_back( &item );
+			previous = idx % 10 ? &item : root.get();
+		}
+		uint32_t rand_state = 11;
+		auto next_random = [&]( size_t limit ) -> size_t
+		{
+			rand_state = rand_state * 1664525 + 1013904223;
+			return ( rand_state >> 8 ) % limit;
+		};
+		int steps = 0;
+		int finished = 0;
+		while( finished < 5 )
+		{
+			//Reachable objects are alive, so walking them would trip the checking
+			//allocator or a sanitizer if the collector freed one too early.
+			vector<test_object*> objects( reachable_from( *root ) );
+			for ( int op = 0; op < 10; ++op )
+			{
+				test_object* source = objects[next_random( objects.size() )];
+				test_object* dest = objects[next_random( objects.size() )];
+				switch( next_random( 3 ) )
+				{
+				case 0:
+					//Move a reference; without the barrier the moved object could be missed
+					//when dest is already black.
+					if ( !source->_references.empty() )
+					{
+						size_t ref_idx = next_random( source->_references.size() );
+						gc_refcount_ptr<test_object> moved( source->_references[ref_idx] );
+						source->_references.erase( source->_references.begin() + ref_idx );
+						dest->_references.push_back( moved );
+					}
+					break;
+				case 1:
+					if ( !source->_references.empty() )
+						source->_references.pop_back();
+					break;
+				default:
+					dest->_references.push_back( &create_test_object( *gc, live_count ) );
+					break;
+				}
+			}
+			//A zero budget ends each step at the first clock check, so the collection is
+			//spread out however fast the machine is.
+			if ( gc->gc_step( 0 ) )
+				++finished;
+			++steps;
+		}
+		//The collection must actually have been spread over several steps.
+		ASSERT_GT( steps, 10 );
+		gc->perform_gc();
+		vector<test_object*> objects( reachable_from( *root ) );
+		ASSERT_EQ( static_cast<int>( objects.size() ), live_count );
+		ASSERT_EQ( objects.size(), gc->all_objects().size() );
+	}
+	ASSERT_EQ( 0, live_count );
+}
+
+//Roots locked and unlocked while an incremental mark is scanning them in place.
+TEST(gc_tests, incremental_root_changes)
+{
+	int live_count = 0;
+	auto alloc = allocator::create_checking_allocator();
+	{
+		auto gc = garbage_collector::create_mark_sweep( alloc );
+		vector<test_object*> roots;
+		for ( int idx = 0; idx < 500; ++idx )
+		{
+			test_object& root = create_test_object( *gc, live_count );
+			root._references.push_back( &create_test_object( *gc, live_count ) );
+			gc->lock( root );
+			roots.push_back( &root );
+		}
+		//A few parents at a time are unlocked, which moves roots the mark hasn't reached,
+		//and then their children are locked behind the scan.  Only the snapshot keeps the
+		//last batch alive.
+		vector<test_object*> children;
+		size_t next_root = 0;
+		auto hand_over = [&]()
+		{
+			size_t end = std::min( next_root + 5, roots.size() );
+			for ( size_t idx = next_root; idx < end; ++idx )
+				gc->unlock( *roots[idx] );
+			for ( ; next_root < end; ++next_root )
+			{
+				test_object* child = roots[next_root]->_references.back().get();
+				gc->lock( *child );
+				children.push_back( child );
+			}
+		};
+		int steps = 0;
+		while( !gc->gc_step( 0 ) )
+		{
+			++steps;
+			hand_over();
+		}
+		ASSERT_GT( steps, 10 );
+		while( next_root < roots.size() )
+			hand_over();
+		gc->perform_gc();
+		ASSERT_EQ( 500, live_count );
+		for_each( children.begin(), children.end(), [&]( test_object* child )
+		{
+			ASSERT_TRUE( child->_references.empty() );
+			gc->unlock( *child );
+		} );
+		gc->perform_gc();
+		ASSERT_EQ( 0, live_count );
+	}
+}
+
+TEST(gc_tests, stats_and_heap_snapshot)
+{
+	int live_count = 0;
+	auto alloc = allocator::create_checking_allocator();
+	{
+		auto gc = garbage_collector::create_mark_sweep( alloc );
+		vector<gc_collection_stats> collections;
+		gc->set_collection_callback( [&]( const gc_collection_stats& collection ) { collections.push_back( collection ); } );
+		//root -> first -> { second, third } -> fourth, plus a garbage cycle.
+		gc_lock_ptr<test_object> root( gc, create_test_object( *gc, live_count ) );
+		test_object& first = create_test_object( *gc, live_count );
+		test_object& second = create_test_object( *gc, live_count );
+		test_object& third = create_test_object( *gc, live_count );
+		test_object& fourth = create_test_object( *gc, live_count );
+		root->_references.push_back( &first );
+		first._references.push_back( &second );
+		first._references.push_back( &third );
+		second._references.push_back( &fourth );
+		third._references.push_back( &fourth );
+		third.set_user_flags( 7 );
+		test_object& garbage = create_test_object( *gc, live_count );
+		garbage._references.push_back( &create_test_object( *gc, live_count ) );
+		garbage._references.front()->_references.push_back( &garbage );
+
+		gc->perform_gc();
+		ASSERT_EQ( 5, live_count );
+		ASSERT_EQ( 1U, collections.size() );
+		ASSERT_EQ( 5U, collections[0]._objects_marked );
+		ASSERT_EQ( 2U, collections[0]._objects_swept );
+		ASSERT_EQ( collections[0]._bytes_marked * 2, collections[0]._bytes_swept * 5 );
+		gc_stats stats( gc->stats() );
+		ASSERT_EQ( 1U, stats._collections );
+		ASSERT_EQ( 2U, stats._objects_swept );
+
+		gc_heap_stats heap( gc->heap_stats() );
+		ASSERT_EQ( 5U, heap._objects );
+		ASSERT_EQ( collections[0]._bytes_marked, heap._object_bytes );
+		ASSERT_TRUE( heap._reserved_bytes >= heap._object_bytes );
+		size_t cell_size = heap._object_bytes / heap._objects;
+		auto size_class = find_if( heap._size_classes.begin(), heap._size_classes.end(), [&]( const gc_size_class_stats& entry )
+		{
+			return entry._objects != 0;
+		} );
+		ASSERT_EQ( cell_size, size_class->_cell_size );
+		ASSERT_EQ( 5U, size_class->_objects );
+
+		//Objects are written in allocation order.
+		stringstream snapshot;
+		gc->write_heap_snapshot( snapshot );
+		string line;
+		std::getline( snapshot, line );
+		std::getline( snapshot, line );
+		ASSERT_EQ( string( "roots 0" ), line );
+		vector<vector<size_t> > rows;
+		while( std::getline( snapshot, line ) )
+		{
+			stringstream row( line );
+			rows.push_back( vector<size_t>() );
+			for ( size_t value; row >> value; )
+				rows.back().push_back( value );
+		}
+		ASSERT_EQ( 5U, rows.size() );
+		ASSERT_EQ( 7U, rows[3][1] );
+		size_t expected_retained[] = { 5, 4, 1, 1, 1 };
+		for ( size_t idx = 0; idx < 5; ++idx )
+		{
+			ASSERT_EQ( idx, rows[idx][0] );
+			ASSERT_EQ( cell_size, rows[idx][2] );
+			ASSERT_EQ( expected_retained[idx] * cell_size, rows[idx][3] );
+		}
+		ASSERT_EQ( 6U, rows[1].size() );
+		ASSERT_EQ( 2U, rows[1][4] );
+		ASSERT_EQ( 3U, rows[1][5] );
+	}
+	{
+		auto gc = garbage_collector::create_generational( alloc );
+		gc_lock_ptr<test_object> root( gc, create_test_object( *gc, live_count ) );
+		root->_references.push_back( &create_test_object( *gc, live_count ) );
+		for ( int idx = 0; idx < 8; ++idx )
+			create_test_object( *gc, live_count );
+		gc->perform_gc();
+		gc_collection_stats collection( gc->stats()._last_collection );
+		ASSERT_EQ( gc_collection_kinds::minor, collection._kind );
+		ASSERT_EQ( 10U, collection._young_objects );
+		ASSERT_EQ( 2U, collection._objects_promoted );
+		ASSERT_EQ( 8U, collection._objects_swept );
+		ASSERT_DOUBLE_EQ( 0.2, gc->stats().promotion_rate() );
+		ASSERT_EQ( 2U, gc->heap_stats()._objects );
+	}
+	ASSERT_EQ( 0, live_count );
+}
+
+//Compiled code's view of the heap: only blocks a shadow stack slot points at survive.
+TEST(gc_tests, runtime_shadow_stack_roots)
+{
+	gc_shadow_frame* shadow_stack = nullptr;
+	runtime rt( allocator::create_checking_allocator(), 1024, &shadow_stack );
+	void* slots[2] = { nullptr, nullptr };
+	void* slot_addresses[2] = { &slots[0], &slots[1] };
+	gc_shadow_frame frame = { nullptr, slot_addresses, 2 };
+	shadow_stack = &frame;
+	slots[0] = runtime::rt_gc_alloc( &rt, 64 );
+	ASSERT_EQ( 0U, reinterpret_cast<size_t>( slots[0] ) % 16 );
+	memset( slots[0], 0xab, 64 );
+	for ( int idx = 0; idx < 100; ++idx )
+		slots[1] = runtime::rt_gc_alloc( &rt, 100 );
+	ASSERT_LT( 0U, rt.managed_heap()->stats()._collections );
+	rt.collect();
+	//slots[0] and whatever slots[1] last pointed at.
+	ASSERT_EQ( 2U, rt.managed_heap()->heap_stats()._objects );
+	ASSERT_EQ( 0xab, reinterpret_cast<uint8_t*>( slots[0] )[63] );
+	shadow_stack = nullptr;
+	rt.collect();
+	ASSERT_EQ( 0U, rt.managed_heap()->heap_stats()._objects );
+	void* data = runtime::rt_malloc( &rt, 32, 8 );
+	runtime::rt_free( &rt, data );
+}
+
+TEST(gc_tests, runtime_block_references)
+{
+	gc_shadow_frame* shadow_stack = nullptr;
+	runtime rt( allocator::create_checking_allocator(), 1024, &shadow_stack );
+	void* root = nullptr;
+	void* root_address = &root;
+	gc_shadow_frame frame = { nullptr, &root_address, 1 };
+	shadow_stack = &frame;
+	root = runtime::rt_gc_alloc( &rt, 64 );
+	//A chain only the root block points at.  Each link sits in the last full word of its
+	//block; 36 byte blocks end in a partial word.
+	void** link = reinterpret_cast<void**>( root );
+	for ( int idx = 0; idx < 3; ++idx )
+	{
+		void* next = runtime::rt_gc_alloc( &rt, 36 );
+		memset( next, idx + 1, 36 );
+		link[idx ? 3 : 7] = next;
+		link = reinterpret_cast<void**>( next );
+	}
+	for ( int idx = 0; idx < 100; ++idx )
+		runtime::rt_gc_alloc( &rt, 100 );
+	rt.collect();
+	ASSERT_EQ( 4U, rt.managed_heap()->heap_stats()._objects );
+	uint8_t* item = reinterpret_cast<uint8_t*>( reinterpret_cast<void**>( root )[7] );
+	ASSERT_EQ( 1, item[35] );
+	item = reinterpret_cast<uint8_t*>( reinterpret_cast<void**>( item )[3] );
+	ASSERT_EQ( 2, item[35] );
+	//A cycle nothing roots goes away.
+	void* cycle = runtime::rt_gc_alloc( &rt, 16 );
+	reinterpret_cast<void**>( cycle )[0] = runtime::rt_gc_alloc( &rt, 16 );
+	reinterpret_cast<void**>( reinterpret_cast<void**>( cycle )[0] )[0] = cycle;
+	reinterpret_cast<void**>( root )[7] = nullptr;
+	rt.collect();
+	ASSERT_EQ( 1U, rt.managed_heap()->heap_stats()._objects );
+	ASSERT_FALSE( rt.is_managed( cycle ) );
+	ASSERT_TRUE( rt.is_managed( root ) );
+	shadow_stack = nullptr;
+}